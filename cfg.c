@@ -79,6 +79,7 @@ bool linear_filter = false;
 bool transparent_dialogs = false;
 bool mdef_fix = true;
 bool fancy_transparency = true;
+bool cull_groups = true;
 bool compress_textures = false;
 uint texture_cache_size = 256;
 bool use_pbo = true;
@@ -87,12 +88,24 @@ bool skip_frames = false;
 bool more_ff7_debug = false;
 bool show_applog = true;
 bool direct_mode = false;
+bool mmap_lgp = true;
+bool lgp_prefetch = true;
+uint asset_cache_size = 32;
 bool show_missing_textures = false;
 bool ff7_popup = false;
 bool info_popup = false;
 char *load_library;
 bool opengl_debug = false;
 bool movie_sync_debug = false;
+bool render_thread = false;
+char *capture_file;
+uint capture_start = 0;
+uint capture_frames = 1;
+uint deferred_soft_cap = 1024;
+char *oit_source;
+char *oit_modes;
+char *io_trace_file;
+char *metrics_file;
 
 cfg_opt_t opts[] = {
 		CFG_SIMPLE_STR("mod_path", &mod_path),
@@ -144,6 +157,7 @@ cfg_opt_t opts[] = {
 		CFG_SIMPLE_BOOL("transparent_dialogs", &transparent_dialogs),
 		CFG_SIMPLE_BOOL("mdef_fix", &mdef_fix),
 		CFG_SIMPLE_BOOL("fancy_transparency", &fancy_transparency),
+		CFG_SIMPLE_BOOL("cull_groups", &cull_groups),
 		CFG_SIMPLE_BOOL("compress_textures", &compress_textures),
 		CFG_SIMPLE_INT("texture_cache_size", &texture_cache_size),
 		CFG_SIMPLE_BOOL("use_pbo", &use_pbo),
@@ -152,12 +166,24 @@ cfg_opt_t opts[] = {
 		CFG_SIMPLE_BOOL("more_ff7_debug", &more_ff7_debug),
 		CFG_SIMPLE_BOOL("show_applog", &show_applog),
 		CFG_SIMPLE_BOOL("direct_mode", &direct_mode),
+		CFG_SIMPLE_BOOL("mmap_lgp", &mmap_lgp),
+		CFG_SIMPLE_BOOL("lgp_prefetch", &lgp_prefetch),
+		CFG_SIMPLE_INT("asset_cache_size", &asset_cache_size),
 		CFG_SIMPLE_BOOL("show_missing_textures", &show_missing_textures),
 		CFG_SIMPLE_BOOL("ff7_popup", &ff7_popup),
 		CFG_SIMPLE_BOOL("info_popup", &info_popup),
 		CFG_SIMPLE_STR("load_library", &load_library),
 		CFG_SIMPLE_BOOL("opengl_debug", &opengl_debug),
 		CFG_SIMPLE_BOOL("movie_sync_debug", &movie_sync_debug),
+		CFG_SIMPLE_BOOL("render_thread", &render_thread),
+		CFG_SIMPLE_STR("capture_file", &capture_file),
+		CFG_SIMPLE_INT("capture_start", &capture_start),
+		CFG_SIMPLE_INT("capture_frames", &capture_frames),
+		CFG_SIMPLE_INT("deferred_soft_cap", &deferred_soft_cap),
+		CFG_SIMPLE_STR("oit_source", &oit_source),
+		CFG_SIMPLE_STR("oit_modes", &oit_modes),
+		CFG_SIMPLE_STR("io_trace_file", &io_trace_file),
+		CFG_SIMPLE_STR("metrics_file", &metrics_file),
 
 		CFG_END()
 };
@@ -194,6 +220,14 @@ void read_cfg()
 
 	load_library = strdup("");
 
+	capture_file = strdup("");
+
+	oit_source = strdup("shaders/oit.frag");
+	oit_modes = strdup("");
+
+	io_trace_file = strdup("");
+	metrics_file = strdup("");
+
 	if(!ff8) _snprintf(filename, sizeof(filename), "%s/ff7_opengl.cfg", basedir);
 	else _snprintf(filename, sizeof(filename), "%s/ff8_opengl.cfg", basedir);
 	
@@ -209,5 +243,6 @@ void read_cfg()
 	window_size_x = 0;
 	window_size_y = 0;
 	fullscreen = false;
+	render_thread = false;
 #endif
 }
@@ -74,6 +74,7 @@ extern bool linear_filter;
 extern bool transparent_dialogs;
 extern bool mdef_fix;
 extern bool fancy_transparency;
+extern bool cull_groups;
 extern bool compress_textures;
 extern uint texture_cache_size;
 extern bool use_pbo;
@@ -82,12 +83,24 @@ extern bool skip_frames;
 extern bool more_ff7_debug;
 extern bool show_applog;
 extern bool direct_mode;
+extern bool mmap_lgp;
+extern bool lgp_prefetch;
+extern uint asset_cache_size;
 extern bool show_missing_textures;
 extern bool ff7_popup;
 extern bool info_popup;
 extern char *load_library;
 extern bool opengl_debug;
 extern bool movie_sync_debug;
+extern bool render_thread;
+extern char *capture_file;
+extern uint capture_start;
+extern uint capture_frames;
+extern uint deferred_soft_cap;
+extern char *oit_source;
+extern char *oit_modes;
+extern char *io_trace_file;
+extern char *metrics_file;
 
 void read_cfg();
 
@@ -40,6 +40,8 @@
 #include "music.h"
 #include "saveload.h"
 #include "matrix.h"
+#include "limiter.h"
+#include "metrics.h"
 
 // global FF7/FF8 flag, available after version check
 bool ff8 = false;
@@ -60,10 +62,14 @@ uint output_size_y;
 // output window
 bool indirect_rendering = false;
 
-// device context & window handles
+// device context, rendering context & window handles
 HDC hDC = 0;
+HGLRC hRC = 0;
 HWND hwnd = 0;
 
+// background color set by the game, used when clearing the back buffer
+float bg_color[4];
+
 // game-specific data, see ff7_data.h/ff8_data.h
 uint text_colors[NUM_TEXTCOLORS];
 unsigned char font_map[256];
@@ -100,13 +106,6 @@ struct texture_format *texture_format;
 // install directory for the current game
 char basedir[BASEDIR_LENGTH];
 
-// global data used for profiling macros, see compile_cfg.h for more info
-#ifdef PROFILE
-time_t profile_start;
-time_t profile_end;
-time_t profile_total;
-#endif PROFILE
-
 // support code for the HEAP_DEBUG option, see compile_cfg.h for more info
 #ifdef HEAP_DEBUG
 uint allocs = 0;
@@ -160,85 +159,214 @@ void *ext_calloc(uint size, uint num, const char *file, uint line)
 }
 #endif
 
+// linear allocator for temporary per-frame rendering data, game thread only
+// everything allocated here is released at once by frame_reset at the end of
+// common_flip
+#define FRAME_ARENA_INITIAL (1024 * 1024)
+#define FRAME_ARENA_BLOCKS 32
+
+struct frame_block
+{
+	unsigned char *data;
+	uint size;
+	uint used;
+};
+
+struct frame_block frame_blocks[FRAME_ARENA_BLOCKS];
+uint frame_block;
+
+void *frame_alloc(uint size)
+{
+	struct frame_block *block = &frame_blocks[frame_block];
+	void *ret;
+
+	size = (size + 15) & ~15;
+
+	if(block->used + size > block->size)
+	{
+		// block sizes double, running out of blocks is not a concern
+		uint new_size = max(FRAME_ARENA_INITIAL, block->size * 2);
+
+		while(new_size < size) new_size *= 2;
+
+		// earlier allocations have to stay put, continue in the next block
+		if(block->used) block = &frame_blocks[++frame_block];
+
+		block->data = driver_realloc(block->data, new_size);
+		block->size = new_size;
+		block->used = 0;
+	}
+
+	ret = &block->data[block->used];
+	block->used += size;
+
+	return ret;
+}
+
+void frame_reset()
+{
+	uint i;
+	uint total = 0;
+
+	// this frame needed more than one block, replace them all with a single
+	// block large enough to hold everything so the heap is left alone from
+	// now on
+	if(frame_block)
+	{
+		for(i = 0; i <= frame_block; i++)
+		{
+			total += frame_blocks[i].size;
+			driver_free(frame_blocks[i].data);
+			frame_blocks[i].data = 0;
+			frame_blocks[i].size = 0;
+			frame_blocks[i].used = 0;
+		}
+
+		frame_blocks[0].data = driver_malloc(total);
+		frame_blocks[0].size = total;
+		frame_block = 0;
+	}
+
+	frame_blocks[0].used = 0;
+}
+
+// hash tables over modes[], see build_mode_index
+struct mode_index_entry
+{
+	uint main_loop;
+	uint mode;
+	// index into modes[] plus one, 0 for an empty slot
+	uint index;
+};
+
+// matches on main loop and mode, main loop only and mode only
+struct mode_index_entry mode_index_exact[MODE_INDEX_SIZE];
+struct mode_index_entry mode_index_main_loop[MODE_INDEX_SIZE];
+struct mode_index_entry mode_index_mode[MODE_INDEX_SIZE];
+bool mode_index_valid = false;
+
+uint mode_index_hash(uint main_loop, uint mode)
+{
+	return ((main_loop >> 2) * 2654435761U ^ mode * 40503) & (MODE_INDEX_SIZE - 1);
+}
+
+// the first mode added for a key wins, same as a linear scan of modes[]
+void mode_index_add(struct mode_index_entry *index, uint main_loop, uint mode, uint i)
+{
+	uint slot = mode_index_hash(main_loop, mode);
+
+	while(index[slot].index)
+	{
+		if(index[slot].main_loop == main_loop && index[slot].mode == mode) return;
+
+		slot = (slot + 1) & (MODE_INDEX_SIZE - 1);
+	}
+
+	index[slot].main_loop = main_loop;
+	index[slot].mode = mode;
+	index[slot].index = i + 1;
+}
+
+struct game_mode *mode_index_find(struct mode_index_entry *index, uint main_loop, uint mode)
+{
+	uint slot = mode_index_hash(main_loop, mode);
+
+	while(index[slot].index)
+	{
+		if(index[slot].main_loop == main_loop && index[slot].mode == mode) return &modes[index[slot].index - 1];
+
+		slot = (slot + 1) & (MODE_INDEX_SIZE - 1);
+	}
+
+	return 0;
+}
+
+void build_mode_index()
+{
+	uint i;
+
+	memset(mode_index_exact, 0, sizeof(mode_index_exact));
+	memset(mode_index_main_loop, 0, sizeof(mode_index_main_loop));
+	memset(mode_index_mode, 0, sizeof(mode_index_mode));
+
+	for(i = 0; i < num_modes; i++)
+	{
+		struct game_mode *m = &modes[i];
+
+		mode_index_add(mode_index_exact, m->main_loop, m->mode, i);
+		if(m->main_loop) mode_index_add(mode_index_main_loop, m->main_loop, 0, i);
+		mode_index_add(mode_index_mode, 0, m->mode, i);
+	}
+
+	mode_index_valid = true;
+}
+
+// called whenever modes[] changes, the index is rebuilt on the next lookup
+void invalidate_mode_index()
+{
+	mode_index_valid = false;
+}
+
 // figure out which game module is currently running by looking at the game's
 // own mode variable and the address of the current main function
 struct game_mode *getmode()
 {
 	static uint last_mode = 0;
 	VOBJ(game_obj, game_object, common_externals.get_game_object());
-	uint i;
+	uint main_loop = (uint)VREF(game_object, main_obj_A0C).main_loop;
+	uint mode = *common_externals._mode;
+	struct game_mode *m;
+
+	if(!mode_index_valid) build_mode_index();
 
 	// find exact match, mode and main loop both match
-	for(i = 0; i < num_modes; i++)
+	if(m = mode_index_find(mode_index_exact, main_loop, mode))
 	{
-		struct game_mode *m = &modes[i];
-
-		if(m->main_loop == (uint)VREF(game_object, main_obj_A0C).main_loop && m->mode == *common_externals._mode)
+		if(last_mode != m->mode)
 		{
-			if(last_mode != m->mode)
-			{
-				if(m->trace) trace("%s\n", m->name);
-				last_mode = m->mode;
-			}
-
-			return m;
+			if(m->trace) trace("%s\n", m->name);
+			last_mode = m->mode;
 		}
+
+		return m;
 	}
 
 	// if there is no exact match, try to find a match by main loop only
-	for(i = 0; i < num_modes; i++)
+	if(main_loop && (m = mode_index_find(mode_index_main_loop, main_loop, 0)))
 	{
-		struct game_mode *m = &modes[i];
-
-		if(m->main_loop && m->main_loop == (uint)VREF(game_object, main_obj_A0C).main_loop)
+		if(last_mode != m->mode)
 		{
-			if(last_mode != m->mode)
-			{
 #ifndef RELEASE
-				if(m->mode != *common_externals._mode && m->trace)
-				{
-					uint j;
-					struct game_mode *_m;
-
-					for(j = 0; j < num_modes - 1; j++)
-					{
-						_m = &modes[j];
-
-						if(_m->mode == *common_externals._mode) break;
-					}
+			if(m->mode != mode && m->trace)
+			{
+				struct game_mode *_m = mode_index_find(mode_index_mode, 0, mode);
 
-					trace("mismatched mode, %s -> %s\n", _m->name, m->name);
-				}
-#endif
-				if(m->trace) trace("%s\n", m->name);
-				last_mode = m->mode;
+				trace("mismatched mode, %s -> %s\n", _m ? _m->name : "unknown", m->name);
 			}
-
-			return m;
+#endif
+			if(m->trace) trace("%s\n", m->name);
+			last_mode = m->mode;
 		}
+
+		return m;
 	}
 
 	// finally, ignore main loop and try to match by mode only
-	for(i = 0; i < num_modes; i++)
+	if(m = mode_index_find(mode_index_mode, 0, mode))
 	{
-		struct game_mode *m = &modes[i];
-
-		if(m->mode == *common_externals._mode)
+		if(last_mode != m->mode)
 		{
-			if(last_mode != m->mode)
-			{
-				if(m->trace) trace("%s\n", m->name);
-				last_mode = m->mode;
-			}
-
-			return m;
+			if(m->trace) trace("%s\n", m->name);
+			last_mode = m->mode;
 		}
+
+		return m;
 	}
 
-	if(*common_externals._mode != last_mode)
+	if(mode != last_mode)
 	{
-		unexpected("unknown mode (%i, 0x%x)\n", *common_externals._mode, (uint)VREF(game_object, main_obj_A0C).main_loop);
-		last_mode = *common_externals._mode;
+		unexpected("unknown mode (%i, 0x%x)\n", mode, main_loop);
+		last_mode = mode;
 	}
 
 	if(!ff8) return &modes[4];
@@ -269,26 +397,8 @@ bool common_init(struct game_obj *game_object)
 {
 	if(trace_all) trace("dll_gfx: init\n");
 
-	glEnableClientState(GL_COLOR_ARRAY);
-	glEnableClientState(GL_VERTEX_ARRAY);
-	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-
-	glDepthFunc(GL_LEQUAL);
-	glFrontFace(GL_CW);
-	glEnable(GL_BLEND);
-	glEnable(GL_TEXTURE_2D);
-
-	glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
-
-	if(use_mipmaps) glHint(GL_GENERATE_MIPMAP_HINT, GL_NICEST);
-
-#ifdef SINGLE_STEP
-	glDrawBuffer(GL_FRONT);
-#endif
-
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	glOrtho(0.0, (double)width, (double)height, 0.0, 1.0, -1.0);
+	// the render thread sets up its own context
+	if(!gl_is_recording()) gl_init_render_state();
 
 	gl_set_blend_func(BLEND_NONE);
 
@@ -296,8 +406,13 @@ bool common_init(struct game_obj *game_object)
 	common_externals.make_pixelformat(32, 0xFF0000, 0xFF00, 0xFF, 0xFF000000, texture_format);
 	common_externals.add_texture_format(texture_format, game_object);
 
-	if(indirect_rendering) gl_prepare_render();
-	else glViewport(x_offset, y_offset, output_size_x, output_size_y);
+	// per-frame counters averaged by metrics.c
+	metrics_add_counter("texture reloads", &stats.texture_reloads);
+	metrics_add_counter("palette writes", &stats.palette_writes);
+	metrics_add_counter("palette changes", &stats.palette_changes);
+	metrics_add_counter("zsort layers", &stats.deferred);
+	metrics_add_counter("culled vertices", &stats.culled_vertices);
+	metrics_add_counter("vertices", &stats.vertex_count);
 
 	return true;
 }
@@ -308,6 +423,20 @@ void common_cleanup(struct game_obj *game_object)
 {
 	if(trace_all) trace("dll_gfx: cleanup\n");
 
+	gl_stop_capture();
+	gl_stop_render_thread();
+
+	if(!ff8) ff7_io_trace_dump();
+
+	if(*metrics_file)
+	{
+		char filename[BASEDIR_LENGTH + 1024];
+
+		_snprintf(filename, sizeof(filename), "%s/%s", basedir, metrics_file);
+
+		if(!metrics_dump(filename)) error("couldn't open %s for writing\n", filename);
+	}
+
 	if(!ff8) ff7_release_movie_objects();
 
 	unreplace_functions();
@@ -331,16 +460,74 @@ bool common_unlock(uint surface)
 	return true;
 }
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x2
+#endif
+
+typedef HANDLE (WINAPI *create_waitable_timer_ex_proc)(LPSECURITY_ATTRIBUTES, LPCSTR, DWORD, DWORD);
+
+HANDLE limiter_timer;
+
+time_t limiter_now(void *context)
+{
+	time_t now;
+
+	qpc_get_time(&now);
+
+	return now;
+}
+
+void limiter_sleep(void *context, uint us)
+{
+	LARGE_INTEGER due;
+
+	if(!limiter_timer)
+	{
+		Sleep(us / 1000);
+		return;
+	}
+
+	// relative due time in 100ns units
+	due.QuadPart = -((LONGLONG)us * 10);
+
+	if(!SetWaitableTimer(limiter_timer, &due, 0, 0, 0, false)) Sleep(us / 1000);
+	else WaitForSingleObject(limiter_timer, INFINITE);
+}
+
+// use a high resolution waitable timer where available (Windows 10 1803 and
+// later), a regular one otherwise
+void limiter_create_timer()
+{
+	create_waitable_timer_ex_proc create_timer_ex = (create_waitable_timer_ex_proc)GetProcAddress(GetModuleHandleA("kernel32.dll"), "CreateWaitableTimerExA");
+
+	if(create_timer_ex) limiter_timer = create_timer_ex(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+	if(!limiter_timer) limiter_timer = CreateWaitableTimer(0, true, 0);
+
+	if(!limiter_timer) glitch("couldn't create frame limiter timer, falling back to Sleep\n");
+}
+
 // called by the game at the end of each frame to swap the front and back
 // buffers
 void common_flip(struct game_obj *game_object)
 {
 	VOBJ(game_obj, game_object, game_object);
-	static time_t last_gametime;
+	static struct limiter_clock limiter_clock;
+	static struct frame_limiter limiter;
 	static struct timeb last_frame;
 	static uint fps_counters[3] = {0, 0, 0};
+	static time_t last_flip;
+	time_t flip_time;
 	time_t last_seconds = last_frame.time;
 	struct game_mode *mode = getmode();
+#ifdef PROFILE
+	char profile_text[1024];
+#endif
+	char metrics_text[1024];
+
+	// sum up the zones of the frame that just ended before starting this one
+	PROFILE_FRAME();
+	PROFILE_BEGIN("common_flip");
 
 	if(trace_all) trace("dll_gfx: flip (%i)\n", frame_counter);
 
@@ -357,12 +544,17 @@ void common_flip(struct game_obj *game_object)
 		GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&pmc, sizeof(pmc));
 		ram_size = pmc.WorkingSetSize;
 
+#ifdef PROFILE
+		profile_print_totals(profile_text, sizeof(profile_text));
+#endif
+		metrics_print(mode->name, metrics_text, sizeof(metrics_text));
+
 		gl_draw_text(8, 8, text_colors[TEXTCOLOR_PINK], 255, 
 #ifdef HEAP_DEBUG
 		                   "Allocations: %u\n"
 #endif
 #ifdef PROFILE
-						   "Profiling: %I64u us\n"
+						   "%s"
 #endif
 		                   "RAM usage: %uMB\n"
 		                   "textures: %u\n"
@@ -372,13 +564,17 @@ void common_flip(struct game_obj *game_object)
 		                   "palette writes: %u\n"
 		                   "palette changes: %u\n"
 		                   "zsort layers: %u\n"
+		                   "zsort peak: %u (merged %u)\n"
+		                   "culled: %u groups, %u vertices\n"
+		                   "last field load: %uKB, %u us\n"
 		                   "vertices: %u\n"
-		                   "timer: %I64u\n", 
+		                   "timer: %I64u\n"
+		                   "%s", 
 #ifdef HEAP_DEBUG
 						   allocs,
 #endif
 #ifdef PROFILE
-						   (time_t)((profile_total * 1000000.0) / VREF(game_object, countspersecond)),
+						   profile_text,
 #endif
 	                       ram_size / (1024 * 1024), 
 		                   stats.texture_count, 
@@ -388,8 +584,15 @@ void common_flip(struct game_obj *game_object)
 		                   stats.palette_writes, 
 		                   stats.palette_changes, 
 		                   stats.deferred, 
+		                   stats.deferred_peak, 
+		                   stats.deferred_merged, 
+		                   stats.culled_groups, 
+		                   stats.culled_vertices, 
+		                   stats.field_io_bytes / 1024, 
+		                   stats.field_io_time, 
 		                   stats.vertex_count, 
-		                   stats.timer
+		                   stats.timer, 
+		                   metrics_text
 		                   );
 	}
 
@@ -425,34 +628,55 @@ void common_flip(struct game_obj *game_object)
 	gl_draw_text(8, height - 32, text_colors[TEXTCOLOR_RED], 255, PRERELEASE_WARNING);
 #endif
 
-	// reset per-frame stats
+	if(gl_is_recording()) gl_submit_frame();
+	else
+	{
+		if(indirect_rendering) gl_prepare_flip();
+
+		gl_swap_buffers();
+	}
+
+	// frame to frame time measured at the same point every frame, together
+	// with this frame's counters
+	qpc_get_time(&flip_time);
+
+	if(last_flip) metrics_frame(mode->name, (uint)((flip_time - last_flip) * 1000000.0 / VREF(game_object, countspersecond)));
+
+	last_flip = flip_time;
+
+	// reset per-frame stats, captures store them with the frame
 	stats.texture_reloads = 0;
 	stats.palette_writes = 0;
 	stats.palette_changes = 0;
 	stats.vertex_count = 0;
 	stats.deferred = 0;
+	stats.culled_groups = 0;
+	stats.culled_vertices = 0;
 
-	if(indirect_rendering) gl_prepare_flip();
-
-#ifndef SINGLE_STEP
-	if(!SwapBuffers(hDC))
-	{
-		error("SwapBuffers failed: ");
-		windows_error(0);
-	}
-#endif
+	frame_reset();
 
 	// new framelimiter, not based on vsync
 	if(!ff8 && use_new_timer)
 	{
-		time_t gametime;
 		double framerate = mode->framerate;
 
 		if(framerate == 0.0) framerate = 60.0;
 
-		do qpc_get_time(&gametime); while(gametime > last_gametime && gametime - last_gametime < VREF(game_object, countspersecond * (1.0 / framerate)));
+		if(!limiter.clock)
+		{
+			limiter_create_timer();
+
+			limiter_clock.now = limiter_now;
+			limiter_clock.sleep = limiter_sleep;
+			limiter_clock.frequency = VREF(game_object, countspersecond);
+			limiter_clock.context = 0;
 
-		last_gametime = gametime;
+			limiter_init(&limiter, &limiter_clock);
+		}
+
+		PROFILE_BEGIN("frame limiter");
+		limiter_wait(&limiter, framerate);
+		PROFILE_END();
 	}
 
 	if(!fullscreen) ShowCursor(true);
@@ -469,15 +693,23 @@ void common_flip(struct game_obj *game_object)
 		}
 	}
 
-	if(indirect_rendering) gl_prepare_render();
+	if(indirect_rendering && !gl_is_recording()) gl_prepare_render();
 
 	frame_counter++;
 
+	gl_capture_poll();
+
+	PROFILE_POLL();
+
+	if(!ff8) ff7_io_trace_poll();
+
 	// check for gl errors once per frame
 	gl_error();
 
 	// FF8 does not clear the screen properly in the card game module
 	if(ff8 && mode->driver_mode == MODE_CARDGAME) common_clear_all(0);
+
+	PROFILE_END();
 }
 
 // called by the game to clear an aspect of the back buffer, mostly called from
@@ -489,16 +721,22 @@ void common_clear(bool clear_color, bool clear_depth, bool unknown, struct game_
 
 	if(trace_all) trace("dll_gfx: clear %i %i %i\n", clear_color, clear_depth, unknown);
 
-	glPushAttrib(GL_DEPTH_BUFFER_BIT | GL_SCISSOR_BIT);
-	glEnable(GL_DEPTH_TEST);
-	glDepthMask(GL_TRUE);
-	glDisable(GL_SCISSOR_TEST);
-
 	if(mode == MODE_MENU) mask |= GL_COLOR_BUFFER_BIT;
 
 	if(clear_color || mode == MODE_MENU) mask |= GL_COLOR_BUFFER_BIT;
 	if(clear_depth) mask |= GL_DEPTH_BUFFER_BIT;
 
+	if(gl_is_recording())
+	{
+		gl_record_clear(mask, bg_color);
+		return;
+	}
+
+	glPushAttrib(GL_DEPTH_BUFFER_BIT | GL_SCISSOR_BIT);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_SCISSOR_TEST);
+
 	glClear(mask);
 
 #ifdef SINGLE_STEP
@@ -521,6 +759,7 @@ void common_clear_all(struct game_obj *game_object)
 void common_setviewport(uint _x, uint _y, uint _w, uint _h, struct game_obj *game_object)
 {
 	uint mode = getmode()->driver_mode;
+	int box[4];
 
 	if(trace_all) trace("dll_gfx: setviewport %i %i %i %i\n", _x, _y, _w, _h);
 
@@ -529,8 +768,9 @@ void common_setviewport(uint _x, uint _y, uint _w, uint _h, struct game_obj *gam
 	current_state.viewport[2] = _w;
 	current_state.viewport[3] = _h;
 
-	if(indirect_rendering) glScissor(INT_COORD_X(_x), internal_size_y - INT_COORD_Y(_y + _h), INT_COORD_X(_w), INT_COORD_Y(_h));
-	else glScissor(INT_COORD_X(_x) + x_offset, window_size_y - INT_COORD_Y(_y + _h), INT_COORD_X(_w), INT_COORD_Y(_h));
+	viewport_to_scissor(current_state.viewport, box);
+
+	glScissor(box[0], box[1], box[2], box[3]);
 
 	// emulate the transformation applied by an equivalent Direct3D viewport
 	d3dviewport_matrix._11 = (float)_w / (float)width;
@@ -541,13 +781,37 @@ void common_setviewport(uint _x, uint _y, uint _w, uint _h, struct game_obj *gam
 	d3dviewport_matrix._42 = -(((float)_y + (float)_h / 2.0f) - (float)height / 2.0f) / ((float)height / 2.0f);
 }
 
+// translate a viewport in game coordinates to a scissor box in window or
+// framebuffer coordinates
+void viewport_to_scissor(uint *viewport, int *box)
+{
+	if(indirect_rendering)
+	{
+		box[0] = INT_COORD_X(viewport[0]);
+		box[1] = internal_size_y - INT_COORD_Y(viewport[1] + viewport[3]);
+	}
+	else
+	{
+		box[0] = INT_COORD_X(viewport[0]) + x_offset;
+		box[1] = window_size_y - INT_COORD_Y(viewport[1] + viewport[3]);
+	}
+
+	box[2] = INT_COORD_X(viewport[2]);
+	box[3] = INT_COORD_Y(viewport[3]);
+}
+
 // called by the game to set the background color which the back buffer will be
 // cleared to
 void common_setbg(struct bgra_color *color, struct game_obj *game_object)
 {
 	if(trace_all) trace("dll_gfx: setbg\n");
 
-	glClearColor(color->r, color->g, color->b, 0.0f);
+	bg_color[0] = color->r;
+	bg_color[1] = color->g;
+	bg_color[2] = color->b;
+	bg_color[3] = 0.0f;
+
+	glClearColor(bg_color[0], bg_color[1], bg_color[2], bg_color[3]);
 }
 
 // called by the game to initialize a polygon_set structure
@@ -605,7 +869,7 @@ void common_unload_texture(struct texture_set *texture_set)
 	if(!VREF(texture_set, ogl.gl_set)) return;
 
 	// do not delete modpath textures directly
-	if(!VREF(texture_set, ogl.external)) glDeleteTextures(VREF(texture_set, ogl.gl_set->textures), VREF(texture_set, texturehandle));
+	if(!VREF(texture_set, ogl.external)) gl_delete_textures(VREF(texture_set, ogl.gl_set->textures), VREF(texture_set, texturehandle));
 
 	driver_free(VREF(texture_set, texturehandle));
 	driver_free(VREF(texture_set, ogl.gl_set));
@@ -653,7 +917,13 @@ bool load_framebuffer_texture(struct texture_set *texture_set, struct tex_header
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 
-	if(!indirect_rendering) glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, VREF(tex_header, fb_tex.x) + x_offset, VREF(tex_header, fb_tex.y) + y_offset, VREF(tex_header, fb_tex.w), VREF(tex_header, fb_tex.h), 0);
+	// the framebuffer contents only exist on the render thread
+	if(gl_is_recording())
+	{
+		if(!indirect_rendering) gl_record_copy_framebuffer(texture, VREF(tex_header, fb_tex.x) + x_offset, VREF(tex_header, fb_tex.y) + y_offset, VREF(tex_header, fb_tex.w), VREF(tex_header, fb_tex.h));
+		else gl_record_copy_framebuffer(texture, VREF(tex_header, fb_tex.x), VREF(tex_header, fb_tex.y), VREF(tex_header, fb_tex.w), VREF(tex_header, fb_tex.h));
+	}
+	else if(!indirect_rendering) glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, VREF(tex_header, fb_tex.x) + x_offset, VREF(tex_header, fb_tex.y) + y_offset, VREF(tex_header, fb_tex.w), VREF(tex_header, fb_tex.h), 0);
 	else glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, VREF(tex_header, fb_tex.x), VREF(tex_header, fb_tex.y), VREF(tex_header, fb_tex.w), VREF(tex_header, fb_tex.h), 0);
 
 	VRASS(texture_set, texturehandle[0], texture);
@@ -827,6 +1097,8 @@ struct texture_set *common_load_texture(struct texture_set *_texture_set, struct
 
 	if(trace_all) trace("dll_gfx: load_texture 0x%x\n", _texture_set);
 
+	PROFILE_BEGIN("common_load_texture");
+
 	// no existing texture set, create one
 	if(!VPTR(texture_set)) VASS(texture_set, common_externals.create_texture_set());
 
@@ -855,6 +1127,8 @@ struct texture_set *common_load_texture(struct texture_set *_texture_set, struct
 	{
 		common_unload_texture(VPTR(texture_set));
 
+		PROFILE_END();
+
 		return common_load_texture(VPTR(texture_set), VPTR(tex_header), texture_format);
 	}
 
@@ -863,7 +1137,11 @@ struct texture_set *common_load_texture(struct texture_set *_texture_set, struct
 	VRASS(texture_set, texture_format, texture_format);
 
 	// check if this is suppposed to be a framebuffer texture, we may not have to do anything
-	if(load_framebuffer_texture(VPTR(texture_set), VPTR(tex_header))) return VPTR(texture_set);
+	if(load_framebuffer_texture(VPTR(texture_set), VPTR(tex_header)))
+	{
+		PROFILE_END();
+		return VPTR(texture_set);
+	}
 
 	// initialize palette index to a sane value if it hasn't been set
 	if(VREF(tex_header, palettes) > 0)
@@ -883,6 +1161,7 @@ struct texture_set *common_load_texture(struct texture_set *_texture_set, struct
 	{
 		unexpected("tried to use non-existent palette (%i, %i)\n", VREF(tex_header, palette_index), VREF(texture_set, ogl.gl_set->textures));
 		VRASS(tex_header, palette_index, 0);
+		PROFILE_END();
 		return VPTR(texture_set);
 	}
 
@@ -904,7 +1183,7 @@ struct texture_set *common_load_texture(struct texture_set *_texture_set, struct
 
 			if(memcmp(VREF(tex_header, old_palette_data), tex_format->palette_data, 4 * tex_format->palette_size))
 			{
-				glDeleteTextures(VREF(texture_set, ogl.gl_set->textures), VREF(texture_set, texturehandle));
+				gl_delete_textures(VREF(texture_set, ogl.gl_set->textures), VREF(texture_set, texturehandle));
 				memset(VREF(texture_set, texturehandle), 0, VREF(texture_set, ogl.gl_set->textures) * sizeof(GLuint));
 
 				memcpy(VREF(tex_header, old_palette_data), tex_format->palette_data, 4 * tex_format->palette_size);
@@ -944,7 +1223,11 @@ struct texture_set *common_load_texture(struct texture_set *_texture_set, struct
 			}
 
 			// check if this texture can be loaded from the modpath, we may not have to do any conversion
-			if(load_external_texture(VPTR(texture_set), VPTR(tex_header))) return VPTR(texture_set);
+			if(load_external_texture(VPTR(texture_set), VPTR(tex_header)))
+			{
+				PROFILE_END();
+				return VPTR(texture_set);
+			}
 
 			// allocate PBO
 			image_data = gl_get_pixel_buffer(w * h * 4);
@@ -959,7 +1242,9 @@ struct texture_set *common_load_texture(struct texture_set *_texture_set, struct
 			}
 
 			// convert source data
+			PROFILE_BEGIN("convert_image_data");
 			convert_image_data(VREF(tex_header, image_data), image_data, w, h, tex_format, invert_alpha, color_key, palette_offset, reference_alpha);
+			PROFILE_END();
 
 			// save texture to modpath if save_textures is enabled
 			if(save_textures && (uint)VREF(tex_header, file.pc_name) > 32)
@@ -970,10 +1255,11 @@ struct texture_set *common_load_texture(struct texture_set *_texture_set, struct
 			// commit PBO and populate texture set
 			gl_upload_texture(VPTR(texture_set), VREF(tex_header, palette_index), image_data, GL_BGRA);
 		}
-		else return VPTR(texture_set);
 	}
 	else unexpected("no texture format specified or no source data\n");
 
+	PROFILE_END();
+
 	return VPTR(texture_set);
 }
 
@@ -1036,7 +1322,7 @@ bool common_write_palette(uint source_offset, uint size, void *source, uint dest
 
 			if(!VREF(texture_set, ogl.external))
 			{
-				glDeleteTextures(1, VREFP(texture_set, texturehandle[palette_index]));
+				gl_delete_textures(1, VREFP(texture_set, texturehandle[palette_index]));
 				VRASS(texture_set, texturehandle[palette_index], 0);
 			}
 
@@ -1068,7 +1354,7 @@ bool common_write_palette(uint source_offset, uint size, void *source, uint dest
 			// if there's anything left at this point, reload the affected textures
 			if(palettes && !VREF(texture_set, ogl.external))
 			{
-				glDeleteTextures(palettes, VREFP(texture_set, texturehandle[palette_index]));
+				gl_delete_textures(palettes, VREFP(texture_set, texturehandle[palette_index]));
 				memset(VREFP(texture_set, texturehandle[palette_index]), 0, palettes * sizeof(GLuint));
 			}
 
@@ -1670,7 +1956,6 @@ PIXELFORMATDESCRIPTOR pfd =
 bool init_opengl()
 {
 	GLuint PixelFormat;
-	HGLRC hRC;
 
 	hDC = GetDC(hwnd);
 	PixelFormat = ChoosePixelFormat(hDC, &pfd);
@@ -1855,6 +2140,8 @@ __declspec(dllexport) void *new_dll_graphics_driver(void *game_object)
 	// install crash handler
 	SetUnhandledExceptionFilter(ExceptionHandler);
 
+	info("Using %s matrix routines\n", matrix_init() ? "SSE" : "scalar");
+
 	// try to prevent screensavers from going off
 	SetThreadExecutionState(ES_CONTINUOUS | ES_DISPLAY_REQUIRED | ES_SYSTEM_REQUIRED);
 
@@ -1971,6 +2258,9 @@ __declspec(dllexport) void *new_dll_graphics_driver(void *game_object)
 	 * OpenGL 2.0 is required since version 0.8
 	 */
 
+	// before the render thread or any other thread is started
+	PROFILE_INIT();
+
 	init_opengl();
 
 	if(glewIsSupported("GL_VERSION_2_0")) info("OpenGL 2.0 support detected\n");
@@ -2070,7 +2360,7 @@ __declspec(dllexport) void *new_dll_graphics_driver(void *game_object)
 
 	info("Original resolution %ix%i, window size %ix%i, output resolution %ix%i, internal resolution %ix%i\n", width, height, window_size_x, window_size_y, output_size_x, output_size_y, internal_size_x, internal_size_y);
 
-	if(internal_size_x != output_size_x || internal_size_y != output_size_y || enable_postprocessing) indirect_rendering = true;
+	if(internal_size_x != output_size_x || internal_size_y != output_size_y || enable_postprocessing || *oit_modes) indirect_rendering = true;
 
 	if(indirect_rendering)
 	{
@@ -2107,6 +2397,11 @@ __declspec(dllexport) void *new_dll_graphics_driver(void *game_object)
 		}
 	}
 
+	if(*oit_modes && indirect_rendering)
+	{
+		if(!gl_init_oit()) error("init_oit failed, transparency will be sorted in all modes\n");
+	}
+
 	if(use_mipmaps && !GLEW_EXT_framebuffer_object)
 	{
 		error("no FBO support, will not be able to generate mipmaps\n");
@@ -2117,6 +2412,8 @@ __declspec(dllexport) void *new_dll_graphics_driver(void *game_object)
 	if(!ff8) ff7_post_init();
 	else ff8_post_init();
 
+	if(render_thread) gl_start_render_thread();
+
 	if(strlen(load_library) > 0)
 	{
 		info("Loading external library %s\n", load_library);
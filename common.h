@@ -237,15 +237,33 @@ void driver_free(void *ptr);
 void *driver_realloc(void *ptr, uint size);
 #endif
 
-// profiling routines, see compile_cfg.h
+void *frame_alloc(uint size);
+void frame_reset();
+
+// profiling routines, see compile_cfg.h and profile.c
 #ifdef PROFILE
-#define PROFILE_START() qpc_get_time(&profile_start)
-#define PROFILE_END() { qpc_get_time(&profile_end); profile_total += profile_end - profile_start; }
+#define PROFILE_INIT() profile_init()
+#define PROFILE_THREAD(name) profile_thread(name)
+#define PROFILE_BEGIN(name) profile_begin(name)
+#define PROFILE_END() profile_end()
+#define PROFILE_FRAME() profile_frame()
+#define PROFILE_POLL() profile_poll()
 
-extern time_t profile_start;
-extern time_t profile_end;
-extern time_t profile_total;
-#endif PROFILE
+void profile_init();
+void profile_thread(char *name);
+void profile_begin(const char *name);
+void profile_end();
+void profile_frame();
+void profile_print_totals(char *buffer, uint size);
+void profile_poll();
+#else
+#define PROFILE_INIT()
+#define PROFILE_THREAD(name)
+#define PROFILE_BEGIN(name)
+#define PROFILE_END()
+#define PROFILE_FRAME()
+#define PROFILE_POLL()
+#endif
 
 struct driver_stats
 {
@@ -257,15 +275,27 @@ struct driver_stats
 	uint palette_changes;
 	uint vertex_count;
 	uint deferred;
+	uint deferred_peak;
+	uint deferred_merged;
+	uint culled_groups;
+	uint culled_vertices;
+	uint field_io_bytes;
+	uint field_io_time;
 	time_t timer;
 };
 
 void qpc_get_time(time_t *dest);
 bool init_opengl();
 uint get_version();
+// size of the hash tables used to look up modes, power of two and at least
+// twice the number of modes
+#define MODE_INDEX_SIZE 128
+
 struct game_mode *getmode();
 struct game_mode *getmode_cached();
+void invalidate_mode_index();
 struct tex_header *make_framebuffer_tex(uint tex_w, uint tex_h, uint x, uint y, uint w, uint h, bool color_key);
 void internal_set_renderstate(uint state, uint option, struct game_obj *game_object);
+void viewport_to_scissor(uint *viewport, int *box);
 
 #endif
@@ -77,9 +77,11 @@
 /* 
  * PROFILE
  * 
- * Enables profiling functions and profiling display through the show_stats
- * option. A running total of the time spent between PROFILE_START() and 
- * PROFILE_END() pairs will be displayed ingame.
+ * Enables the zone profiler in profile.c. Time spent between nested
+ * PROFILE_BEGIN() and PROFILE_END() pairs is recorded per thread, the last
+ * frame's totals are displayed ingame through the show_stats option and
+ * Ctrl+F10 writes a Chrome trace of recent zones to the game directory.
+ * Without this option the macros compile to nothing.
  */
 //#define PROFILE
 
@@ -311,7 +311,7 @@ uint __stdcall fake_ddsurface_unlock(struct ddsurface **this, LPRECT dest)
 
 	glEnable(GL_TEXTURE_2D);
 
-	if(movie_texture) glDeleteTextures(1, &movie_texture);
+	if(movie_texture) gl_delete_textures(1, &movie_texture);
 
 	movie_texture = gl_create_empty_texture();
 
@@ -29,6 +29,7 @@
 #include "types.h"
 #include "common.h"
 #include "matrix.h"
+#include "lgp.h"
 
 /*
  * Primitive types supported by the engine, mostly a 1:1 mapping to PSX GPU
@@ -652,32 +653,6 @@ struct rsd_data
 	struct pd_data *pd_data;
 };
 
-struct lgp_toc_entry
-{
-	char name[16];
-	uint offset;
-	word unknown1;
-	word conflict;
-};
-
-struct lookup_table_entry
-{
-	unsigned short toc_offset;
-	unsigned short num_files;
-};
-
-struct conflict_entry
-{
-	char name[128];
-	unsigned short toc_index;
-};
-
-struct conflict_list
-{
-	uint num_conflicts;
-	struct conflict_entry *conflict_entries;
-};
-
 struct lgp_folders
 {
 	struct conflict_list conflicts[1000];
@@ -1578,5 +1553,7 @@ bool ff7gl_load_group(uint group_num, struct matrix_set *matrix_set, struct p_hu
 void ff7gl_field_78(struct ff7_polygon_set *polygon_set, struct ff7_game_obj *game_object);
 struct ff7_gfx_driver *ff7_load_driver(struct ff7_game_obj *game_object);
 void ff7_post_init();
+void ff7_io_trace_poll();
+void ff7_io_trace_dump();
 
 #endif
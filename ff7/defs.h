@@ -39,15 +39,20 @@ void char_addhp(uint party_index, word amount);
 void char_addmp(uint party_index, word amount);
 
 // file
+#define NUM_LGP_ARCHIVES 18
+
 FILE *open_lgp_file(char *filename, uint mode);
 void close_lgp_file(FILE *fd);
-extern char lgp_names[18][256];
+extern char lgp_names[NUM_LGP_ARCHIVES][256];
 bool lgp_chdir(char *path);
 struct lgp_file *lgp_open_file(char *filename, uint lgp_num);
 bool lgp_seek_file(uint offset, uint lgp_num);
 uint lgp_read(uint lgp_num, char *dest, uint size);
 uint lgp_read_file(struct lgp_file *file, uint lgp_num, char *dest, uint size);
 uint lgp_get_filesize(struct lgp_file *file, uint lgp_num);
+bool lgp_resolve_file(struct file_context *file_context, char *filename, uint *offset, bool *resolved_conflict);
+void lgp_io_field_loaded(char *name);
+bool file_resolved_conflict(struct ff7_file *file);
 void close_file(struct ff7_file *file);
 struct ff7_file *open_file(struct file_context *file_context, char *filename);
 uint __read_file(uint count, void *buffer, struct ff7_file *file);
@@ -58,6 +63,17 @@ uint get_filesize(struct ff7_file *file);
 uint tell_file(struct ff7_file *file);
 void seek_file(struct ff7_file *file, uint offset);
 char *make_pc_name(struct file_context *file_context, struct ff7_file *file, char *filename);
+char *make_asset_pc_name(struct file_context *file_context, bool resolved_conflict, char *filename);
+
+// iotrace
+#define IO_OPEN 0
+#define IO_READ 1
+#define IO_SEEK 2
+#define IO_CLOSE 3
+
+struct io_file *io_get_file(int archive, char *filename);
+void io_set_field(char *name);
+void io_record(uint op, struct io_file *file, uint offset, uint size, time_t start);
 
 // graphics
 void destroy_d3d2_indexed_primitive(struct indexed_primitive *ip);
@@ -73,5 +89,6 @@ struct battle_hrc_header *read_battle_hrc(bool use_file_context, struct file_con
 struct polygon_data *load_p_file(struct file_context *file_context, bool create_lists, char *filename);
 void destroy_tex_header(struct ff7_tex_header *tex_header);
 struct ff7_tex_header *load_tex_file(struct file_context *file_context, char *filename);
+void flush_assets();
 
 #endif
@@ -26,6 +26,8 @@
 #include "../log.h"
 #include "../globals.h"
 
+#include "defs.h"
+
 /*
  * This file contains the changes necessary to support subtractive and 25%
  * blending modes in field backgrounds. Texture pages where these blending
@@ -69,6 +71,8 @@ void field_load_textures(struct ff7_game_obj *game_object, struct struc_3 *struc
 {
 	uint i;
 
+	lgp_io_field_loaded(ff7_externals.field_file_name);
+
 	ff7_externals.field_convert_type2_layers();
 
 	for(i = 0; i < 29; i++)
@@ -21,6 +21,8 @@
  */
 
 #include <sys/stat.h>
+#include <io.h>
+#include <process.h>
 
 #include "../types.h"
 #include "../common.h"
@@ -28,24 +30,10 @@
 #include "../log.h"
 #include "../globals.h"
 
-FILE *open_lgp_file(char *filename, uint mode)
-{
-	if(trace_files) trace("opening lgp file %s\n", filename);
-
-	return fopen(filename, "rb");
-}
-
-void close_lgp_file(FILE *fd)
-{
-	if(!fd) return;
-
-	if(trace_files) trace("closing lgp file\n");
-
-	fclose(fd);
-}
+#include "defs.h"
 
 // LGP names used for modpath lookup
-char lgp_names[18][256] = {
+char lgp_names[NUM_LGP_ARCHIVES][256] = {
 	"char",
 	"flevel",
 	"battle",
@@ -66,6 +54,407 @@ char lgp_names[18][256] = {
 	"sub",
 };
 
+// LGP archive mapped into memory, reads are served straight from the mapping
+// with our own read position instead of the file descriptor's
+struct lgp_mapping
+{
+	FILE *fd;
+	HANDLE mapping;
+	unsigned char *data;
+	uint size;
+	uint pos;
+	// held by the prefetch thread while it touches pages outside the lock
+	volatile LONG pins;
+};
+
+struct lgp_mapping lgp_mappings[NUM_LGP_ARCHIVES];
+
+// I/O done on behalf of the current field load
+struct
+{
+	bool field_load;
+	uint bytes;
+	uint reads;
+	time_t time;
+} lgp_io;
+
+/*
+ * Field loads are made up of many small reads from flevel.lgp and char.lgp.
+ * The byte ranges read while loading a field are recorded and the next time
+ * the field is entered a background thread touches the pages of those ranges
+ * in the mapped archives, pulling them into the system file cache ahead of
+ * the game's own reads.
+ */
+
+#define PREFETCH_MAX_RANGES 256
+// reads closer than this to the previous one are merged into the same range
+#define PREFETCH_MERGE_GAP (64 * 1024)
+// upper bound on how much is read ahead for a single field
+#define PREFETCH_MAX_BYTES (32 * 1024 * 1024)
+// pages touched between checks for a newer field change
+#define PREFETCH_CHUNK (256 * 1024)
+#define PREFETCH_PAGE 4096
+
+struct prefetch_range
+{
+	uint lgp_num;
+	uint offset;
+	uint size;
+};
+
+struct field_reads
+{
+	char name[32];
+	uint num_ranges;
+	struct prefetch_range *ranges;
+};
+
+struct field_reads **field_reads;
+uint num_field_reads;
+
+// ranges read during the current field load
+struct field_reads recording;
+struct prefetch_range recording_ranges[PREFETCH_MAX_RANGES];
+
+// protects the mappings and the prefetch job against the prefetch thread
+CRITICAL_SECTION lgp_lock;
+bool lgp_lock_initialized = false;
+
+HANDLE prefetch_thread;
+HANDLE prefetch_event;
+struct field_reads *prefetch_job;
+uint prefetch_generation;
+
+// must not be called with lgp_lock held, it waits for the prefetch thread to
+// let go of the mapping
+void lgp_unmap(struct lgp_mapping *map)
+{
+	EnterCriticalSection(&lgp_lock);
+
+	while(map->pins)
+	{
+		LeaveCriticalSection(&lgp_lock);
+		Sleep(0);
+		EnterCriticalSection(&lgp_lock);
+	}
+
+	if(map->data) UnmapViewOfFile(map->data);
+	if(map->mapping) CloseHandle(map->mapping);
+
+	memset(map, 0, sizeof(*map));
+
+	LeaveCriticalSection(&lgp_lock);
+}
+
+// map an LGP archive the first time it is accessed, returns 0 if the archive
+// has to be read through its file descriptor instead
+struct lgp_mapping *lgp_get_mapping(uint lgp_num)
+{
+	struct lgp_mapping *map;
+	FILE *fd;
+	HANDLE file;
+
+	if(!mmap_lgp || lgp_num >= NUM_LGP_ARCHIVES) return 0;
+
+	map = &lgp_mappings[lgp_num];
+	fd = ff7_externals.lgp_fds[lgp_num];
+
+	if(!fd) return 0;
+
+	// already mapped, or mapping failed for this descriptor before
+	if(map->fd == fd) return map->data ? map : 0;
+
+	lgp_unmap(map);
+
+	EnterCriticalSection(&lgp_lock);
+
+	map->fd = fd;
+
+	file = (HANDLE)_get_osfhandle(_fileno(fd));
+	map->size = GetFileSize(file, 0);
+	map->mapping = CreateFileMapping(file, 0, PAGE_READONLY, 0, 0, 0);
+
+	if(map->mapping) map->data = MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if(!map->data)
+	{
+		error("could not map %s.lgp (error %i), using regular file access\n", lgp_names[lgp_num], GetLastError());
+		if(map->mapping) CloseHandle(map->mapping);
+		map->mapping = 0;
+		LeaveCriticalSection(&lgp_lock);
+		return 0;
+	}
+
+	LeaveCriticalSection(&lgp_lock);
+
+	// pick up where the file descriptor left off
+	map->pos = ftell(fd);
+
+	if(trace_files) trace("mapped %s.lgp (%i bytes)\n", lgp_names[lgp_num], map->size);
+
+	return map;
+}
+
+// add a read to the ranges recorded for the current field load
+void lgp_record_read(uint lgp_num, uint offset, uint size)
+{
+	struct prefetch_range *range;
+
+	if(!lgp_io.field_load || !lgp_prefetch || !size) return;
+
+	if(recording.num_ranges)
+	{
+		range = &recording_ranges[recording.num_ranges - 1];
+
+		if(range->lgp_num == lgp_num && offset >= range->offset && offset <= range->offset + range->size + PREFETCH_MERGE_GAP)
+		{
+			if(offset + size > range->offset + range->size) range->size = offset + size - range->offset;
+			return;
+		}
+	}
+
+	if(recording.num_ranges == PREFETCH_MAX_RANGES) return;
+
+	range = &recording_ranges[recording.num_ranges++];
+	range->lgp_num = lgp_num;
+	range->offset = offset;
+	range->size = size;
+}
+
+struct field_reads *lgp_find_field_reads(char *name)
+{
+	uint i;
+
+	for(i = 0; i < num_field_reads; i++)
+	{
+		if(!_stricmp(field_reads[i]->name, name)) return field_reads[i];
+	}
+
+	return 0;
+}
+
+// keep what was read during the field load for the next time it is entered
+void lgp_save_field_reads()
+{
+	struct field_reads *reads;
+
+	if(!recording.num_ranges) return;
+
+	EnterCriticalSection(&lgp_lock);
+
+	reads = lgp_find_field_reads(recording.name);
+
+	if(!reads)
+	{
+		reads = driver_calloc(sizeof(*reads), 1);
+		strcpy(reads->name, recording.name);
+
+		field_reads = driver_realloc(field_reads, sizeof(*field_reads) * (num_field_reads + 1));
+		field_reads[num_field_reads++] = reads;
+	}
+
+	driver_free(reads->ranges);
+	reads->ranges = driver_malloc(sizeof(*reads->ranges) * recording.num_ranges);
+	memcpy(reads->ranges, recording_ranges, sizeof(*reads->ranges) * recording.num_ranges);
+	reads->num_ranges = recording.num_ranges;
+
+	LeaveCriticalSection(&lgp_lock);
+}
+
+unsigned __stdcall lgp_prefetch_main(void *parameter)
+{
+	volatile unsigned char sink = 0;
+
+	PROFILE_THREAD("lgp prefetch");
+
+	while(true)
+	{
+		uint generation;
+		uint range = 0;
+		uint pos = 0;
+		uint total = 0;
+
+		WaitForSingleObject(prefetch_event, INFINITE);
+
+		PROFILE_BEGIN("lgp_prefetch_field");
+
+		EnterCriticalSection(&lgp_lock);
+		generation = prefetch_generation;
+		LeaveCriticalSection(&lgp_lock);
+
+		while(total < PREFETCH_MAX_BYTES)
+		{
+			struct prefetch_range *r;
+			struct lgp_mapping *map;
+			unsigned char *data = 0;
+			uint start, end;
+
+			EnterCriticalSection(&lgp_lock);
+
+			// stop if the game has moved on to another field
+			if(generation != prefetch_generation || !prefetch_job || range >= prefetch_job->num_ranges)
+			{
+				LeaveCriticalSection(&lgp_lock);
+				break;
+			}
+
+			r = &prefetch_job->ranges[range];
+			map = &lgp_mappings[r->lgp_num];
+
+			start = r->offset + pos;
+			end = r->offset + r->size;
+			if(end > start + PREFETCH_CHUNK) end = start + PREFETCH_CHUNK;
+			if(end > map->size) end = map->size;
+
+			// pin the mapping so it stays put while the pages are touched
+			// without holding the lock
+			if(map->data && start < end)
+			{
+				data = map->data;
+				InterlockedIncrement(&map->pins);
+			}
+
+			if(!map->data || end >= r->offset + r->size || end >= map->size)
+			{
+				range++;
+				pos = 0;
+			}
+			else pos = end - r->offset;
+
+			LeaveCriticalSection(&lgp_lock);
+
+			if(data)
+			{
+				uint i;
+
+				for(i = start & ~(PREFETCH_PAGE - 1); i < end; i += PREFETCH_PAGE) sink += data[i];
+
+				total += end - start;
+
+				InterlockedDecrement(&map->pins);
+			}
+		}
+
+		PROFILE_END();
+	}
+
+	return 0;
+}
+
+// start reading ahead what the field needed the last time it was loaded
+void lgp_prefetch_field(char *name)
+{
+	struct field_reads *reads;
+
+	if(!mmap_lgp || !lgp_prefetch) return;
+
+	EnterCriticalSection(&lgp_lock);
+
+	reads = lgp_find_field_reads(name);
+
+	prefetch_job = reads;
+	prefetch_generation++;
+
+	LeaveCriticalSection(&lgp_lock);
+
+	if(!reads) return;
+
+	if(!prefetch_thread)
+	{
+		prefetch_event = CreateEvent(0, false, false, 0);
+		prefetch_thread = (HANDLE)_beginthreadex(0, 0, lgp_prefetch_main, 0, 0, 0);
+
+		if(!prefetch_thread)
+		{
+			error("could not start LGP prefetch thread\n");
+			lgp_prefetch = false;
+			return;
+		}
+
+		SetThreadPriority(prefetch_thread, THREAD_PRIORITY_BELOW_NORMAL);
+	}
+
+	if(trace_files) trace("prefetching %i ranges for field %s\n", reads->num_ranges, name);
+
+	SetEvent(prefetch_event);
+}
+
+// copy from the mapping at the current read position
+uint lgp_map_copy(struct lgp_mapping *map, char *dest, uint size)
+{
+	if(map->pos >= map->size) return 0;
+
+	if(size > map->size - map->pos) size = map->size - map->pos;
+
+	lgp_record_read(map - lgp_mappings, map->pos, size);
+
+	memcpy(dest, &map->data[map->pos], size);
+	map->pos += size;
+
+	return size;
+}
+
+void lgp_io_account(time_t start, uint bytes)
+{
+	time_t end;
+
+	QueryPerformanceCounter((LARGE_INTEGER *)&end);
+
+	lgp_io.bytes += bytes;
+	lgp_io.reads++;
+	lgp_io.time += end - start;
+}
+
+// report the I/O done since the field file was opened, called once the field
+// load is complete
+void lgp_io_field_loaded(char *name)
+{
+	time_t frequency;
+
+	if(!lgp_io.field_load) return;
+
+	QueryPerformanceFrequency((LARGE_INTEGER *)&frequency);
+
+	stats.field_io_bytes = lgp_io.bytes;
+	stats.field_io_time = (uint)((lgp_io.time * 1000000) / frequency);
+
+	if(trace_files) trace("field load %s: %i bytes in %i reads, %i us\n", name, stats.field_io_bytes, lgp_io.reads, stats.field_io_time);
+
+	lgp_save_field_reads();
+
+	lgp_io.field_load = false;
+}
+
+FILE *open_lgp_file(char *filename, uint mode)
+{
+	if(!lgp_lock_initialized)
+	{
+		InitializeCriticalSection(&lgp_lock);
+		lgp_lock_initialized = true;
+	}
+
+	if(trace_files) trace("opening lgp file %s\n", filename);
+
+	return fopen(filename, "rb");
+}
+
+void close_lgp_file(FILE *fd)
+{
+	uint i;
+
+	if(!fd) return;
+
+	if(trace_files) trace("closing lgp file\n");
+
+	for(i = 0; i < NUM_LGP_ARCHIVES; i++) if(lgp_mappings[i].fd == fd) lgp_unmap(&lgp_mappings[i]);
+
+	// cached assets are keyed by archive offsets which mean nothing once the
+	// archive is reopened
+	flush_assets();
+
+	fclose(fd);
+}
+
 struct lgp_file
 {
 	bool is_lgp_offset;
@@ -75,6 +464,7 @@ struct lgp_file
 		FILE *fd;
 	};
 	bool resolved_conflict;
+	struct io_file *io_file;
 };
 
 #define NUM_LGP_FILES 64
@@ -84,6 +474,8 @@ uint lgp_files_index = 0;
 
 struct lgp_file *last;
 
+struct lgp_index lgp_indices[NUM_LGP_ARCHIVES];
+
 char lgp_current_dir[256];
 
 bool use_files_array = true;
@@ -116,82 +508,61 @@ bool lgp_chdir(char *path)
 	return true;
 }
 
-// original LGP open file logic, unchanged except for the LGP Tools safety net
-bool original_lgp_open_file(char *filename, uint lgp_num, struct lgp_file *ret)
+// build the hashed TOC index for an archive the first time a file is looked up
+// in it, the TOCs are loaded by the game so this can't happen any earlier
+struct lgp_index *lgp_get_index(uint lgp_num)
 {
-	uint lookup_value1 = lgp_lookup_value(filename[0]);
-	uint lookup_value2 = lgp_lookup_value(filename[1]) + 1;
+	struct lgp_index *index = &lgp_indices[lgp_num];
+	struct lgp_toc_entry *toc = ff7_externals.lgp_tocs[lgp_num * 2];
+	uint num_files = ((uint *)ff7_externals.lgp_tocs)[lgp_num * 2 + 1];
+	struct conflict_list *conflicts = ff7_externals.lgp_folders[lgp_num].conflicts;
 	struct lookup_table_entry *lookup_table = ff7_externals.lgp_lookup_tables[lgp_num];
-	uint toc_offset = lookup_table[lookup_value1 * 30 + lookup_value2].toc_offset;
+	uint size;
 	uint i;
 
-	// did we find anything in the lookup table?
-	if(toc_offset)
-	{
-		uint num_files = lookup_table[lookup_value1 * 30 + lookup_value2].num_files;
+	if(index->entries && index->toc == toc && index->num_files == num_files) return index;
 
-		// look for our file
-		for(i = 0; i < num_files; i++)
-		{
-			struct lgp_toc_entry *toc_entry = &ff7_externals.lgp_tocs[lgp_num * 2][toc_offset + i - 1];
+	if(index->entries) driver_free(index->entries);
 
-			if(!_stricmp(toc_entry->name, filename))
-			{
-				if(!toc_entry->conflict)
-				{
-					// this is the only file with this name, we're done here
-					ret->is_lgp_offset = true;
-					ret->offset = toc_entry->offset;
-					return true;
-				}
-				else
-				{
-					struct conflict_list *conflict = &ff7_externals.lgp_folders[lgp_num].conflicts[toc_entry->conflict - 1];
-					struct conflict_entry *conflict_entries = conflict->conflict_entries;
-					uint num_conflicts = conflict->num_conflicts;
-					
-					// there are multiple files with this name, look for our
-					// current directory in the conflict table
-					for(i = 0; i < num_conflicts; i++)
-					{
-						if(!_stricmp(conflict_entries[i].name, lgp_current_dir))
-						{
-							struct lgp_toc_entry *toc_entry = &ff7_externals.lgp_tocs[lgp_num * 2][conflict_entries[i].toc_index];
-
-							// file name and directory matches, this is our file
-							ret->is_lgp_offset = true;
-							ret->offset = toc_entry->offset;
-							ret->resolved_conflict = true;
-							return true;
-						}
-					}
-
-					break;
-				}
-			}
-		}
-	}
+	size = lgp_index_size(toc, num_files, conflicts);
+	lgp_build_index(index, driver_malloc(sizeof(*index->entries) * size), size, toc, num_files, conflicts);
+
+	if(trace_files) trace("indexed %i files in %s.lgp\n", num_files, lgp_names[lgp_num]);
 
-	// one last chance, the lookup table might have been broken by LGP Tools,
-	// search through the entire archive
-	for(i = 0; i < ((uint *)ff7_externals.lgp_tocs)[lgp_num * 2 + 1]; i++)
+	// the lookup table is no longer used, but if it has been broken by LGP
+	// Tools the rest of the archive probably has too
+	for(i = 0; i < num_files; i++)
 	{
-		struct lgp_toc_entry *toc_entry = &ff7_externals.lgp_tocs[lgp_num * 2][i];
+		uint lookup_value1 = lgp_lookup_value(toc[i].name[0]);
+		uint lookup_value2 = lgp_lookup_value(toc[i].name[1]) + 1;
+		struct lookup_table_entry *bucket;
 
-		if(!_stricmp(toc_entry->name, filename))
+		if(lookup_value1 >= 30 || lookup_value2 >= 30) continue;
+
+		bucket = &lookup_table[lookup_value1 * 30 + lookup_value2];
+
+		if(i + 1 < bucket->toc_offset || i + 1 >= bucket->toc_offset + bucket->num_files)
 		{
 			glitch("broken LGP file (%s), don't use LGP Tools!\n", lgp_names[lgp_num]);
-
-			if(!toc_entry->conflict)
-			{
-				ret->is_lgp_offset = true;
-				ret->offset = toc_entry->offset;
-				return true;
-			}
+			break;
 		}
 	}
 
-	return false;
+	return index;
+}
+
+// find a file in an LGP archive, conflicting names are resolved using the
+// current directory
+bool lgp_lookup_file(char *filename, uint lgp_num, struct lgp_file *ret)
+{
+	int toc_index = lgp_index_lookup(lgp_get_index(lgp_num), filename, lgp_current_dir, &ret->resolved_conflict);
+
+	if(toc_index < 0) return false;
+
+	ret->is_lgp_offset = true;
+	ret->offset = ff7_externals.lgp_tocs[lgp_num * 2][toc_index].offset;
+
+	return true;
 }
 
 // new LGP open file logic with modpath and direct mode support
@@ -203,9 +574,27 @@ struct lgp_file *lgp_open_file(char *filename, uint lgp_num)
 	char *fname = _fname;
 	char ext[_MAX_EXT];
 	char name[_MAX_FNAME + _MAX_EXT];
+	time_t start;
+
+	QueryPerformanceCounter((LARGE_INTEGER *)&start);
 
 	_splitpath(filename, 0, 0, fname, ext);
 
+	// field loads start by opening the field file
+	if(lgp_num == 1 && !lgp_io.field_load)
+	{
+		lgp_io.field_load = true;
+		lgp_io.bytes = 0;
+		lgp_io.reads = 0;
+		lgp_io.time = 0;
+
+		_snprintf(recording.name, sizeof(recording.name), "%s%s", fname, ext);
+		recording.num_ranges = 0;
+
+		io_set_field(recording.name);
+		lgp_prefetch_field(recording.name);
+	}
+
 	if(direct_mode)
 	{
 		_snprintf(tmp, sizeof(tmp), "%s/direct/%s/%s%s", basedir, lgp_names[lgp_num], fname, ext);
@@ -225,7 +614,7 @@ struct lgp_file *lgp_open_file(char *filename, uint lgp_num)
 	{
 		sprintf(name, "%s%s", fname, ext);
 
-		if(!original_lgp_open_file(name, lgp_num, ret))
+		if(!lgp_lookup_file(name, lgp_num, ret))
 		{
 			if(direct_mode) error("failed to find file %s; tried direct/%s/%s, direct/%s/%s/%s, %s/%s (LGP) (path: %s)\n", filename, lgp_names[lgp_num], name, lgp_names[lgp_num], lgp_current_dir, name, lgp_names[lgp_num], name, lgp_current_dir);
 			else error("failed to find file %s/%s (LGP) (path: %s)\n", lgp_names[lgp_num], name, lgp_current_dir);
@@ -236,6 +625,10 @@ struct lgp_file *lgp_open_file(char *filename, uint lgp_num)
 
 	last = ret;
 
+	sprintf(name, "%s%s", fname, ext);
+	ret->io_file = io_get_file(ret->is_lgp_offset ? lgp_num : -1, ret->is_lgp_offset ? name : tmp);
+	io_record(IO_OPEN, ret->io_file, ret->is_lgp_offset ? ret->offset : 0, 0, start);
+
 	if(use_files_array && !ret->is_lgp_offset)
 	{
 		if(lgp_files[lgp_files_index])
@@ -260,35 +653,92 @@ struct lgp_file *lgp_open_file(char *filename, uint lgp_num)
 // seek to given offset in LGP file
 bool lgp_seek_file(uint offset, uint lgp_num)
 {
+	struct lgp_mapping *map;
+	time_t start;
+
 	if(!ff7_externals.lgp_fds[lgp_num]) return false;
 
-	fseek(ff7_externals.lgp_fds[lgp_num], offset, SEEK_SET);
+	QueryPerformanceCounter((LARGE_INTEGER *)&start);
+
+	map = lgp_get_mapping(lgp_num);
+
+	if(map) map->pos = offset;
+	else fseek(ff7_externals.lgp_fds[lgp_num], offset, SEEK_SET);
+
+	io_record(IO_SEEK, last ? last->io_file : 0, offset, 0, start);
 
 	return true;
 }
 
+// current read position within an LGP archive
+uint lgp_tell(uint lgp_num)
+{
+	struct lgp_mapping *map = lgp_get_mapping(lgp_num);
+
+	if(map) return map->pos;
+
+	return ftell(ff7_externals.lgp_fds[lgp_num]);
+}
+
 // read straight from LGP file
 uint lgp_read(uint lgp_num, char *dest, uint size)
 {
+	struct lgp_mapping *map;
+	time_t start;
+	uint offset;
+	uint ret;
+
 	if(!ff7_externals.lgp_fds[lgp_num]) return 0;
 
-	if(last->is_lgp_offset) return fread(dest, 1, size, ff7_externals.lgp_fds[lgp_num]);
+	PROFILE_BEGIN("lgp_read");
+
+	QueryPerformanceCounter((LARGE_INTEGER *)&start);
+
+	offset = last->is_lgp_offset ? lgp_tell(lgp_num) : ftell(last->fd);
+
+	if(!last->is_lgp_offset) ret = fread(dest, 1, size, last->fd);
+	else if(map = lgp_get_mapping(lgp_num)) ret = lgp_map_copy(map, dest, size);
+	else ret = fread(dest, 1, size, ff7_externals.lgp_fds[lgp_num]);
+
+	lgp_io_account(start, ret);
+	io_record(IO_READ, last->io_file, offset, ret, start);
 
-	return fread(dest, 1, size, last->fd);
+	PROFILE_END();
+
+	return ret;
 }
 
 // read from LGP file by LGP file descriptor
 uint lgp_read_file(struct lgp_file *file, uint lgp_num, char *dest, uint size)
 {
+	struct lgp_mapping *map;
+	time_t start;
+	uint offset;
+	uint ret;
+
 	if(!ff7_externals.lgp_fds[lgp_num]) return 0;
 
-	if(file->is_lgp_offset)
+	PROFILE_BEGIN("lgp_read_file");
+
+	QueryPerformanceCounter((LARGE_INTEGER *)&start);
+
+	offset = file->is_lgp_offset ? file->offset + 24 : ftell(file->fd);
+
+	if(!file->is_lgp_offset) ret = fread(dest, 1, size, file->fd);
+	else
 	{
 		lgp_seek_file(file->offset + 24, lgp_num);
-		return fread(dest, 1, size, ff7_externals.lgp_fds[lgp_num]);
+
+		if(map = lgp_get_mapping(lgp_num)) ret = lgp_map_copy(map, dest, size);
+		else ret = fread(dest, 1, size, ff7_externals.lgp_fds[lgp_num]);
 	}
 
-	return fread(dest, 1, size, file->fd);
+	lgp_io_account(start, ret);
+	io_record(IO_READ, file->io_file, offset, ret, start);
+
+	PROFILE_END();
+
+	return ret;
 }
 
 // retrieve the size of a file within the LGP archive
@@ -296,10 +746,21 @@ uint lgp_get_filesize(struct lgp_file *file, uint lgp_num)
 {
 	if(file->is_lgp_offset)
 	{
-		uint size;
+		struct lgp_mapping *map = lgp_get_mapping(lgp_num);
+		uint size = 0;
+
+		// either way the read position ends up at the start of the file data
+		if(map && file->offset + 24 <= map->size)
+		{
+			map->pos = file->offset + 24;
+			return *(uint *)&map->data[file->offset + 20];
+		}
 
 		lgp_seek_file(file->offset + 20, lgp_num);
-		fread(&size, 4, 1, ff7_externals.lgp_fds[lgp_num]);
+
+		if(map) lgp_map_copy(map, (char *)&size, 4);
+		else fread(&size, 4, 1, ff7_externals.lgp_fds[lgp_num]);
+
 		return size;
 	}
 	else
@@ -312,13 +773,56 @@ uint lgp_get_filesize(struct lgp_file *file, uint lgp_num)
 	}
 }
 
+// resolve a file within an LGP archive the way open_file would without
+// opening it, fails for anything that could come from the direct directory
+bool lgp_resolve_file(struct file_context *file_context, char *filename, uint *offset, bool *resolved_conflict)
+{
+	char mangled_name[200];
+	char fname[_MAX_FNAME];
+	char ext[_MAX_EXT];
+	char name[_MAX_FNAME + _MAX_EXT];
+	struct lgp_file file;
+
+	if(!file_context->use_lgp || direct_mode) return false;
+
+	if(file_context->name_mangler)
+	{
+		file_context->name_mangler(filename, mangled_name);
+		filename = mangled_name;
+	}
+
+	_splitpath(filename, 0, 0, fname, ext);
+	sprintf(name, "%s%s", fname, ext);
+
+	memset(&file, 0, sizeof(file));
+
+	if(!lgp_lookup_file(name, file_context->lgp_num, &file)) return false;
+
+	*offset = file.offset;
+	*resolved_conflict = file.resolved_conflict;
+
+	return true;
+}
+
+// true if an LGP file was found through the current directory
+bool file_resolved_conflict(struct ff7_file *file)
+{
+	return file->context.use_lgp && file->fd->resolved_conflict;
+}
+
 // close a file handle
 void close_file(struct ff7_file *file)
 {
+	time_t start;
+
 	if(!file) return;
 
+	QueryPerformanceCounter((LARGE_INTEGER *)&start);
+
 	if(file->fd)
 	{
+		io_record(IO_CLOSE, file->fd->io_file, 0, 0, start);
+
 		if(!file->fd->is_lgp_offset && file->fd->fd) fclose(file->fd->fd);
 		driver_free(file->fd);
 	}
@@ -334,6 +838,9 @@ struct ff7_file *open_file(struct file_context *file_context, char *filename)
 	char mangled_name[200];
 	struct ff7_file *ret = driver_calloc(sizeof(*ret), 1);
 	char *_filename = filename;
+	time_t start;
+
+	QueryPerformanceCounter((LARGE_INTEGER *)&start);
 
 	if(trace_files)
 	{
@@ -386,6 +893,9 @@ struct ff7_file *open_file(struct file_context *file_context, char *filename)
 		else ret->fd->fd = fopen(_filename, "r+b");
 
 		if(!ret->fd->fd) goto error;
+
+		ret->fd->io_file = io_get_file(-1, _filename);
+		io_record(IO_OPEN, ret->fd->io_file, 0, 0, start);
 	}
 
 	return ret;
@@ -402,6 +912,8 @@ error:
 uint __read_file(uint count, void *buffer, struct ff7_file *file)
 {
 	uint ret = 0;
+	uint offset;
+	time_t start;
 
 	if(!file || !count) return false;
 
@@ -409,7 +921,14 @@ uint __read_file(uint count, void *buffer, struct ff7_file *file)
 
 	if(file->context.use_lgp) return lgp_read(file->context.lgp_num, buffer, count);
 
+	QueryPerformanceCounter((LARGE_INTEGER *)&start);
+	offset = ftell(file->fd->fd);
+
+	PROFILE_BEGIN("read_file");
 	ret = fread(buffer, 1, count, file->fd->fd);
+	PROFILE_END();
+
+	io_record(IO_READ, file->fd->io_file, offset, ret, start);
 
 	if(ferror(file->fd->fd))
 	{
@@ -424,6 +943,8 @@ uint __read_file(uint count, void *buffer, struct ff7_file *file)
 bool read_file(uint count, void *buffer, struct ff7_file *file)
 {
 	uint ret = 0;
+	uint offset;
+	time_t start;
 
 	if(!file || !count) return false;
 
@@ -431,7 +952,14 @@ bool read_file(uint count, void *buffer, struct ff7_file *file)
 
 	if(file->context.use_lgp) return lgp_read(file->context.lgp_num, buffer, count);
 
+	QueryPerformanceCounter((LARGE_INTEGER *)&start);
+	offset = ftell(file->fd->fd);
+
+	PROFILE_BEGIN("read_file");
 	ret = fread(buffer, 1, count, file->fd->fd);
+	PROFILE_END();
+
+	io_record(IO_READ, file->fd->io_file, offset, ret, start);
 
 	if(ret != count)
 	{
@@ -513,6 +1041,8 @@ uint tell_file(struct ff7_file *file)
 // seek to position in file
 void seek_file(struct ff7_file *file, uint offset)
 {
+	time_t start;
+
 	if(!file) return;
 
 	if(trace_files) trace("seek %s to %i\n", file->name, offset);
@@ -520,11 +1050,15 @@ void seek_file(struct ff7_file *file, uint offset)
 	// it's not possible to seek within LGP archives
 	if(file->context.use_lgp) return;
 
+	QueryPerformanceCounter((LARGE_INTEGER *)&start);
+
 	if(fseek(file->fd->fd, offset, SEEK_SET)) error("could not seek file %s\n", file->name);
+
+	io_record(IO_SEEK, file->fd->io_file, offset, 0, start);
 }
 
-// construct modpath name from file context, file handle and filename
-char *make_pc_name(struct file_context *file_context, struct ff7_file *file, char *filename)
+// construct modpath name for a file that may not be open anymore
+char *make_asset_pc_name(struct file_context *file_context, bool resolved_conflict, char *filename)
 {
 	uint i, len;
 	char *backslash;
@@ -532,7 +1066,7 @@ char *make_pc_name(struct file_context *file_context, struct ff7_file *file, cha
 
 	if(file_context->use_lgp)
 	{
-		if(file->fd->resolved_conflict) len = _snprintf(ret, 1024, "%s/%s/%s", lgp_names[file_context->lgp_num], lgp_current_dir, filename);
+		if(resolved_conflict) len = _snprintf(ret, 1024, "%s/%s/%s", lgp_names[file_context->lgp_num], lgp_current_dir, filename);
 		else len = _snprintf(ret, 1024, "%s/%s", lgp_names[file_context->lgp_num], filename);
 	}
 	else len = _snprintf(ret, 1024, "%s", filename);
@@ -551,3 +1085,9 @@ char *make_pc_name(struct file_context *file_context, struct ff7_file *file, cha
 
 	return ret;
 }
+
+// construct modpath name from file context, file handle and filename
+char *make_pc_name(struct file_context *file_context, struct ff7_file *file, char *filename)
+{
+	return make_asset_pc_name(file_context, file_resolved_conflict(file), filename);
+}
@@ -22,6 +22,7 @@
 
 #include <gl/glew.h>
 #include <math.h>
+#include <float.h>
 
 #include "../types.h"
 #include "../common.h"
@@ -111,6 +112,74 @@ bool ff7gl_load_group(uint group_num, struct matrix_set *matrix_set, struct p_hu
 	return true;
 }
 
+// empty, inverted or garbage boxes can't be trusted to contain anything
+bool valid_boundingbox(struct boundingbox *box)
+{
+	if(!_finite(box->min_x) || !_finite(box->min_y) || !_finite(box->min_z)) return false;
+	if(!_finite(box->max_x) || !_finite(box->max_y) || !_finite(box->max_z)) return false;
+
+	return box->min_x <= box->max_x && box->min_y <= box->max_y && box->min_z <= box->max_z;
+}
+
+// conservative visibility test for a group about to be drawn with the current
+// world and projection matrices, true if the bounding box from its .p file is
+// entirely outside the visible area
+bool cull_group(struct ff7_polygon_set *polygon_set, uint group, struct indexed_primitive *ip)
+{
+	struct polygon_data *polygon_data = polygon_set->polygon_data;
+	struct boundingbox *box;
+	MATRIX_ALIGN struct matrix transform;
+	uint outcode = 0x1F;
+	uint i;
+
+	if(!cull_groups || !polygon_data || !polygon_data->boundingboxdata || !polygon_data->numboundingboxes) return false;
+
+	// bounds are in model space
+	if(ip->vertextype == TLVERTEX) return false;
+
+	// only trust boxes that clearly belong to one group each, it is not known
+	// whether a lone box covers the whole model or just the first group
+	if(polygon_data->numboundingboxes != polygon_data->numgroups) return false;
+
+	box = &polygon_data->boundingboxdata[group];
+
+	if(!valid_boundingbox(box)) return false;
+
+	multiply_matrix(&current_state.world_matrix, &current_state.d3dprojection_matrix, &transform);
+
+	// clipped groups are limited to the D3D viewport, which is the [-1, 1]
+	// range before the viewport transform, others can cover the whole screen
+	if(!polygon_set->field_4) multiply_matrix_unary(&transform, &d3dviewport_matrix);
+
+	for(i = 0; i < 8; i++)
+	{
+		struct point3d corner;
+		struct point4d p;
+		uint code = 0;
+
+		corner.x = i & 1 ? box->max_x : box->min_x;
+		corner.y = i & 2 ? box->max_y : box->min_y;
+		corner.z = i & 4 ? box->max_z : box->min_z;
+
+		transform_point_w(&transform, &corner, &p);
+
+		if(p.x > p.w) code |= 0x1;
+		if(p.x < -p.w) code |= 0x2;
+		if(p.y > p.w) code |= 0x4;
+		if(p.y < -p.w) code |= 0x8;
+		if(p.w < 0.0f) code |= 0x10;
+
+		// visible as soon as the corners do not share an outside plane
+		outcode &= code;
+		if(!outcode) return false;
+	}
+
+	stats.culled_groups++;
+	stats.culled_vertices += ip->vertexcount;
+
+	return true;
+}
+
 void ff7gl_field_78(struct ff7_polygon_set *polygon_set, struct ff7_game_obj *game_object)
 {
 	struct matrix_set *matrix_set;
@@ -261,7 +330,7 @@ void ff7gl_field_78(struct ff7_polygon_set *polygon_set, struct ff7_game_obj *ga
 							else
 							{
 								if(matrix && matrix_set) gl_set_world_matrix(matrix);
-								gl_draw_with_lighting(ip, polygon_set->field_4, model_matrix);
+								if(!cull_group(polygon_set, group_counter, ip)) gl_draw_with_lighting(ip, polygon_set->field_4, model_matrix);
 							}
 						}
 					}
@@ -289,7 +358,7 @@ void ff7gl_field_78(struct ff7_polygon_set *polygon_set, struct ff7_game_obj *ga
 									ff7_externals.sub_68D2B8(group_counter, polygon_set, &struc_84->struc_173);
 
 									if(matrix && matrix_set) gl_set_world_matrix(matrix);
-									gl_draw_with_lighting(ip, polygon_set->field_4, model_matrix);
+									if(!cull_group(polygon_set, group_counter, ip)) gl_draw_with_lighting(ip, polygon_set->field_4, model_matrix);
 								}
 							}
 						}
@@ -330,7 +399,7 @@ void ff7gl_field_78(struct ff7_polygon_set *polygon_set, struct ff7_game_obj *ga
 					else
 					{
 						if(matrix_set) gl_set_world_matrix(matrix_set->matrix_world);
-						gl_draw_with_lighting(ip, polygon_set->field_4, model_matrix);
+						if(!cull_group(polygon_set, group_counter, ip)) gl_draw_with_lighting(ip, polygon_set->field_4, model_matrix);
 					}
 				}
 			}
@@ -365,6 +434,100 @@ void sub_6B2720(struct indexed_primitive *ip)
 	gl_draw_indexed_primitive(ip->primitivetype, TLVERTEX, ip->vertices, ip->vertexcount, ip->indices, ip->indexcount, 0, true, true);
 }
 
+// evaluated bone matrices of the model being drawn, kept between calls
+struct model_bone
+{
+	struct matrix world;
+	struct matrix eye;
+	struct matrix *matrix;
+	uint bone_index;
+};
+
+struct model_bone *model_bones;
+uint *bone_parents;
+uint max_model_bones;
+
+void reserve_model_bones(uint count)
+{
+	if(count <= max_model_bones) return;
+
+	if(!max_model_bones) max_model_bones = 64;
+
+	while(count > max_model_bones) max_model_bones *= 2;
+
+	model_bones = driver_realloc(model_bones, sizeof(*model_bones) * max_model_bones);
+	bone_parents = driver_realloc(bone_parents, sizeof(*bone_parents) * max_model_bones);
+}
+
+// view matrices handed out to polygon sets, the game expects a fresh zeroed
+// one every time but one per matrix set is enough as long as nobody else has
+// replaced it in the meantime
+#define VIEW_MATRIX_BUCKETS 1024
+// entries not used for this many frames are dropped, their matrix set has
+// most likely been freed by the game
+#define VIEW_MATRIX_MAX_AGE 600
+
+struct view_matrix
+{
+	struct view_matrix *next;
+	struct matrix_set *matrix_set;
+	struct matrix *matrix;
+	uint last_used;
+};
+
+struct view_matrix *view_matrices[VIEW_MATRIX_BUCKETS];
+uint view_matrices_swept;
+
+void sweep_view_matrices()
+{
+	uint i;
+
+	for(i = 0; i < VIEW_MATRIX_BUCKETS; i++)
+	{
+		struct view_matrix **entry = &view_matrices[i];
+
+		while(*entry)
+		{
+			if(frame_counter - (*entry)->last_used > VIEW_MATRIX_MAX_AGE)
+			{
+				struct view_matrix *old = *entry;
+
+				*entry = old->next;
+				driver_free(old);
+			}
+			else entry = &(*entry)->next;
+		}
+	}
+
+	view_matrices_swept = frame_counter;
+}
+
+struct matrix *get_view_matrix(struct matrix_set *matrix_set)
+{
+	struct view_matrix **bucket = &view_matrices[(((uint)matrix_set >> 4) * 2654435761U) >> 22];
+	struct view_matrix *entry;
+
+	if(frame_counter - view_matrices_swept > VIEW_MATRIX_MAX_AGE) sweep_view_matrices();
+
+	for(entry = *bucket; entry && entry->matrix_set != matrix_set; entry = entry->next);
+
+	if(!entry)
+	{
+		entry = driver_calloc(sizeof(*entry), 1);
+		entry->matrix_set = matrix_set;
+		entry->next = *bucket;
+		*bucket = entry;
+	}
+
+	entry->last_used = frame_counter;
+
+	if(entry->matrix && matrix_set->matrix_view == entry->matrix) memset(entry->matrix, 0, sizeof(*entry->matrix));
+	// allocated by the game's allocator like before since the game may free it
+	else entry->matrix = external_calloc(sizeof(struct matrix), 1);
+
+	return entry->matrix;
+}
+
 void draw_3d_model(uint current_frame, struct anim_header *anim_header, struct struc_110 *struc_110, struct hrc_data *hrc_data, struct ff7_game_obj *game_object)
 {
 	struct anim_frame *anim_frame;
@@ -454,7 +617,15 @@ void draw_3d_model(uint current_frame, struct anim_header *anim_header, struct s
 	if(hrc_data->bone_list)
 	{
 		struct list_node *bone_list_node;
+		uint num_bones = 0;
+		uint depth = 0;
+		uint b;
+
+		// bones point into this array so it must not move while walking the list
+		reserve_model_bones(hrc_data->num_bones + 1);
 
+		// evaluate the whole hierarchy first, parents are tracked on a local
+		// stack of indices rather than the game's matrix stack
 		LIST_FOR_EACH(bone_list_node, hrc_data->bone_list)
 		{
 			struct bone_list_member *bone_list_member = (struct bone_list_member *)&bone_list_node->object;
@@ -463,31 +634,39 @@ void draw_3d_model(uint current_frame, struct anim_header *anim_header, struct s
 			{
 				uint bone_index = bone_list_member->bone_index;
 				struct hrc_bone *bone = &hrc_data->bones[bone_index];
+				struct model_bone *model_bone;
 				struct matrix *parent_matrix;
-				struct matrix *bone_matrix;
 				struct point3d *frame_rotation;
 				struct matrix local_matrix;
-				struct matrix eye_matrix;
-				struct matrix *matrix;
 				struct point3d dummy_point = {0.0f, 0.0f, 0.0f};
 
-				parent_matrix = ff7_externals.stack_top(matrix_stack);
-				ff7_externals.stack_push(matrix_stack);
-				bone_matrix = ff7_externals.stack_top(matrix_stack);
+				if(num_bones >= max_model_bones)
+				{
+					unexpected_once("bone list has more bones than the %i in the model header, the rest of the model is not drawn\n", hrc_data->num_bones);
+					break;
+				}
+
+				model_bone = &model_bones[num_bones];
+				parent_matrix = depth ? &model_bones[bone_parents[depth - 1]].world : root_matrix;
+				bone_parents[depth++] = num_bones++;
 
 				if(anim_header->num_bones <= bone_index) frame_rotation = &dummy_point;
 				else frame_rotation = &anim_frame->data[bone_index];
 
 				frame_animation_sub(bone_index, &local_matrix, frame_rotation, anim_frame, anim_header, bone, hrc_data);
 
-				multiply_matrix(&local_matrix, parent_matrix, bone_matrix);
+				multiply_matrix(&local_matrix, parent_matrix, &model_bone->world);
+
+				model_bone->bone_index = bone_index;
 
 				if(*ff7_externals.model_mode & MDL_USE_CAMERA_MATRIX)
 				{
+					struct matrix *matrix;
+
 					if(hrc_data->flags & 0x4000 && struc_110->bone_matrices) matrix = &struc_110->bone_matrices[bone_index + 1];
-					else matrix = &eye_matrix;
+					else matrix = &model_bone->eye;
 
-					multiply_matrix(bone_matrix, game_object->camera_matrix, matrix);
+					multiply_matrix(&model_bone->world, game_object->camera_matrix, matrix);
 
 					matrix->_14 = 0.0f;
 					matrix->_24 = 0.0f;
@@ -496,60 +675,70 @@ void draw_3d_model(uint current_frame, struct anim_header *anim_header, struct s
 
 					if(hrc_data->flags & 0x2000 && struc_110->bone_positions)
 					{
-						struc_110->bone_positions[bone_index + 1].x = bone_matrix->_41;
-						struc_110->bone_positions[bone_index + 1].y = bone_matrix->_42;
-						struc_110->bone_positions[bone_index + 1].z = bone_matrix->_43;
+						struc_110->bone_positions[bone_index + 1].x = model_bone->world._41;
+						struc_110->bone_positions[bone_index + 1].y = model_bone->world._42;
+						struc_110->bone_positions[bone_index + 1].z = model_bone->world._43;
 					}
+
+					model_bone->matrix = matrix;
 				}
-				else matrix = bone_matrix;
+				else model_bone->matrix = &model_bone->world;
+			}
+			if(bone_list_member->bone_type == 2 && depth) depth--;
+		}
 
-				if(bone->rsd_array)
+		// then draw from the evaluated matrices
+		for(b = 0; b < num_bones; b++)
+		{
+			struct model_bone *model_bone = &model_bones[b];
+			struct hrc_bone *bone = &hrc_data->bones[model_bone->bone_index];
+			struct matrix *bone_matrix = &model_bone->world;
+
+			if(bone->rsd_array)
+			{
+				uint i;
+				struct rsd_array_member *rsd_array_member;
+
+				for(i = 0, rsd_array_member = bone->rsd_array; i < bone->num_rsd; i++, rsd_array_member++)
 				{
-					uint i;
-					struct rsd_array_member *rsd_array_member;
+					struct ff7_polygon_set *polygon_set;
 
-					for(i = 0, rsd_array_member = bone->rsd_array; i < bone->num_rsd; i++, rsd_array_member++)
-					{
-						struct ff7_polygon_set *polygon_set;
+					if(!rsd_array_member->rsd_data) continue;
 
-						if(!rsd_array_member->rsd_data) continue;
+					polygon_set = rsd_array_member->rsd_data->polygon_set;
 
-						polygon_set = rsd_array_member->rsd_data->polygon_set;
+					if(!polygon_set) continue;
 
-						if(!polygon_set) continue;
+					common_setmatrix(0, model_bone->matrix, polygon_set->matrix_set, (struct game_obj *)game_object);
+					if(polygon_set->matrix_set) polygon_set->matrix_set->matrix_view = get_view_matrix(polygon_set->matrix_set);
+					common_setmatrix(1, bone_matrix, polygon_set->matrix_set, (struct game_obj *)game_object);
 
-						common_setmatrix(0, matrix, polygon_set->matrix_set, (struct game_obj *)game_object);
-						if(polygon_set->matrix_set) polygon_set->matrix_set->matrix_view = external_calloc(sizeof(struct matrix), 1);
-						common_setmatrix(1, bone_matrix, polygon_set->matrix_set, (struct game_obj *)game_object);
+					if(hrc_data->flags & 0x2000000)
+					{
+						struct ff7_light *light = polygon_set->light;
 
-						if(hrc_data->flags & 0x2000000)
+						if(light)
 						{
-							struct ff7_light *light = polygon_set->light;
+							if(polygon_set->matrix_set) light->matrix_pointer = polygon_set->matrix_set->matrix_world;
+							else light->matrix_pointer = 0;
 
-							if(light)
+							if(light->field_138)
 							{
-								if(polygon_set->matrix_set) light->matrix_pointer = polygon_set->matrix_set->matrix_world;
-								else light->matrix_pointer = 0;
-
-								if(light->field_138)
-								{
-									struct matrix tmp;
+								struct matrix tmp;
 
-									multiply_matrix(bone_matrix, &light->field_13C, &tmp);
+								multiply_matrix(bone_matrix, &light->field_13C, &tmp);
 
-									ff7_externals.sub_69C69F(&tmp, light);
-								}
-								else ff7_externals.sub_69C69F(bone_matrix, light);
-
-								common_externals.generic_light_polygon_set((struct polygon_set *)polygon_set, light);
+								ff7_externals.sub_69C69F(&tmp, light);
 							}
-						}
+							else ff7_externals.sub_69C69F(bone_matrix, light);
 
-						if(hrc_data->field_4 && hrc_data->flags & 0x100000) ff7gl_field_78(polygon_set, game_object);
+							common_externals.generic_light_polygon_set((struct polygon_set *)polygon_set, light);
+						}
 					}
+
+					if(hrc_data->field_4 && hrc_data->flags & 0x100000) ff7gl_field_78(polygon_set, game_object);
 				}
 			}
-			if(bone_list_member->bone_type == 2) ff7_externals.stack_pop(matrix_stack);
 		}
 	}
 
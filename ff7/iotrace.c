@@ -0,0 +1,344 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * ff7/iotrace.c - file I/O counters and access trace export
+ *
+ * With io_trace_file set every open, read, seek and close done through the
+ * file routines in ff7/file.c is counted per file, per LGP archive, per game
+ * mode and per field, and the individual accesses are recorded. Both are
+ * written out on Ctrl+F11 or when the game exits, nothing is tracked
+ * otherwise:
+ *
+ *   <io_trace_file>.csv         one line per access, replay/lgp_io_replay.c
+ *                               plays it back against local LGP archives
+ *   <io_trace_file>.json        the same accesses as a Chrome trace timeline
+ *                               (chrome://tracing or ui.perfetto.dev)
+ *   <io_trace_file>_summary.csv the counters
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+
+#include "../types.h"
+#include "../common.h"
+#include "../ff7.h"
+#include "../log.h"
+#include "../globals.h"
+
+#include "defs.h"
+
+// stop recording after this many accesses, about 32MB worth of events
+#define IO_TRACE_MAX_EVENTS (1024 * 1024)
+
+#define IO_FILE_BUCKETS 1024
+#define IO_MAX_SCOPES 1024
+
+struct io_counters
+{
+	uint opens;
+	uint reads;
+	uint seeks;
+	uint bytes;
+	time_t time;
+};
+
+struct io_file
+{
+	struct io_file *next;
+	char *name;
+	int archive;
+	struct io_counters counters;
+};
+
+// a game mode or a field
+struct io_scope
+{
+	char name[32];
+	struct io_counters counters;
+};
+
+struct io_event
+{
+	time_t start;
+	uint duration;
+	word op;
+	short archive;
+	uint offset;
+	uint size;
+	word mode;
+	word field;
+	struct io_file *file;
+};
+
+char *io_op_names[] = {"open", "read", "seek", "close"};
+
+struct io_file *io_files[IO_FILE_BUCKETS];
+uint num_io_files;
+
+// archives plus one entry for files on disk
+struct io_counters io_archives[NUM_LGP_ARCHIVES + 1];
+
+struct io_scope io_modes[IO_MAX_SCOPES];
+uint num_io_modes;
+struct io_scope io_fields[IO_MAX_SCOPES];
+uint num_io_fields;
+uint io_current_field = 0;
+
+struct io_event *io_events;
+uint num_io_events;
+uint max_io_events;
+
+time_t io_trace_start;
+bool io_trace_key;
+
+uint io_hash(char *name)
+{
+	uint hash = 2166136261u;
+
+	while(*name)
+	{
+		hash ^= tolower((unsigned char)*name++);
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+// look up the counters for a file, archive is the LGP number or -1 for files
+// on disk, 0 if tracing is off
+struct io_file *io_get_file(int archive, char *filename)
+{
+	struct io_file **file;
+	char name[1024];
+	char *backslash;
+
+	if(!*io_trace_file) return 0;
+
+	_snprintf(name, sizeof(name), "%s", filename);
+
+	// keeps the names usable in the JSON trace as they are
+	while(backslash = strchr(name, '\\')) *backslash = '/';
+
+	file = &io_files[(io_hash(name) + archive) % IO_FILE_BUCKETS];
+
+	while(*file)
+	{
+		if((*file)->archive == archive && !_stricmp((*file)->name, name)) return *file;
+
+		file = &(*file)->next;
+	}
+
+	*file = driver_calloc(sizeof(**file), 1);
+	(*file)->name = driver_malloc(strlen(name) + 1);
+	strcpy((*file)->name, name);
+	(*file)->archive = archive;
+	num_io_files++;
+
+	return *file;
+}
+
+uint io_get_scope(struct io_scope *scopes, uint *num_scopes, char *name)
+{
+	uint i;
+
+	for(i = 0; i < *num_scopes; i++) if(!strcmp(scopes[i].name, name)) return i;
+
+	// everything past the limit ends up in the last scope
+	if(*num_scopes == IO_MAX_SCOPES) return IO_MAX_SCOPES - 1;
+
+	_snprintf(scopes[i].name, sizeof(scopes[i].name), "%s", name);
+
+	return (*num_scopes)++;
+}
+
+// subsequent accesses are attributed to this field
+void io_set_field(char *name)
+{
+	if(!*io_trace_file) return;
+
+	io_current_field = io_get_scope(io_fields, &num_io_fields, name);
+}
+
+void io_count(struct io_counters *counters, uint op, uint size, time_t time)
+{
+	if(op == IO_OPEN) counters->opens++;
+	else if(op == IO_READ)
+	{
+		counters->reads++;
+		counters->bytes += size;
+	}
+	else if(op == IO_SEEK) counters->seeks++;
+
+	counters->time += time;
+}
+
+// account for a single access that started at QPC time start, offset and size
+// are only meaningful for reads and seeks
+void io_record(uint op, struct io_file *file, uint offset, uint size, time_t start)
+{
+	struct game_mode *mode;
+	uint mode_index;
+	int archive = file ? file->archive : -1;
+	time_t end;
+
+	if(!*io_trace_file) return;
+
+	mode = getmode_cached();
+	mode_index = io_get_scope(io_modes, &num_io_modes, mode->name);
+
+	QueryPerformanceCounter((LARGE_INTEGER *)&end);
+
+	if(file) io_count(&file->counters, op, size, end - start);
+	io_count(&io_archives[archive < 0 ? NUM_LGP_ARCHIVES : archive], op, size, end - start);
+	io_count(&io_modes[mode_index].counters, op, size, end - start);
+	if(num_io_fields) io_count(&io_fields[io_current_field].counters, op, size, end - start);
+
+	if(num_io_events == IO_TRACE_MAX_EVENTS) return;
+
+	if(!num_io_events) io_trace_start = start;
+
+	if(num_io_events == max_io_events)
+	{
+		max_io_events = max_io_events ? max_io_events * 2 : 4096;
+		io_events = driver_realloc(io_events, sizeof(*io_events) * max_io_events);
+	}
+
+	io_events[num_io_events].start = start;
+	io_events[num_io_events].duration = (uint)(end - start);
+	io_events[num_io_events].op = op;
+	io_events[num_io_events].archive = archive;
+	io_events[num_io_events].offset = offset;
+	io_events[num_io_events].size = size;
+	io_events[num_io_events].mode = mode_index;
+	io_events[num_io_events].field = num_io_fields ? io_current_field : 0xFFFF;
+	io_events[num_io_events].file = file;
+
+	if(++num_io_events == IO_TRACE_MAX_EVENTS) glitch("I/O trace is full, no further accesses will be recorded\n");
+}
+
+FILE *io_trace_open(char *suffix)
+{
+	char filename[BASEDIR_LENGTH + 1024];
+	FILE *f;
+
+	_snprintf(filename, sizeof(filename), "%s/%s%s", basedir, io_trace_file, suffix);
+
+	f = fopen(filename, "w");
+
+	if(!f) error("couldn't open %s for writing\n", filename);
+
+	return f;
+}
+
+char *io_archive_name(int archive)
+{
+	return archive < 0 ? "-" : lgp_names[archive];
+}
+
+void io_write_counters(FILE *f, char *scope, char *name, struct io_counters *counters, double us_per_tick)
+{
+	if(!counters->opens && !counters->reads && !counters->seeks) return;
+
+	fprintf(f, "%s,%s,%u,%u,%u,%u,%.0f\n", scope, name, counters->opens, counters->reads, counters->seeks, counters->bytes, counters->time * us_per_tick);
+}
+
+// write out everything recorded so far
+void ff7_io_trace_dump()
+{
+	time_t frequency;
+	double us_per_tick;
+	FILE *f;
+	uint i;
+
+	if(!*io_trace_file) return;
+
+	QueryPerformanceFrequency((LARGE_INTEGER *)&frequency);
+	us_per_tick = 1000000.0 / frequency;
+
+	if(f = io_trace_open(".csv"))
+	{
+		fprintf(f, "time_us,duration_us,op,archive,offset,size,mode,field,file\n");
+
+		for(i = 0; i < num_io_events; i++)
+		{
+			struct io_event *e = &io_events[i];
+
+			fprintf(f, "%.1f,%.1f,%s,%s,%u,%u,%s,%s,%s\n", (e->start - io_trace_start) * us_per_tick, e->duration * us_per_tick, io_op_names[e->op], io_archive_name(e->archive), e->offset, e->size, io_modes[e->mode].name, e->field == 0xFFFF ? "-" : io_fields[e->field].name, e->file ? e->file->name : "-");
+		}
+
+		fclose(f);
+	}
+
+	if(f = io_trace_open(".json"))
+	{
+		fprintf(f, "{\"traceEvents\":[\n");
+
+		// one track for files on disk and one for each archive
+		for(i = 0; i <= NUM_LGP_ARCHIVES; i++) fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", i, i ? lgp_names[i - 1] : "disk");
+
+		for(i = 0; i < num_io_events; i++)
+		{
+			struct io_event *e = &io_events[i];
+
+			fprintf(f, "{\"name\":\"%s %s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.1f,\"dur\":%.1f,\"args\":{\"offset\":%u,\"size\":%u,\"mode\":\"%s\",\"field\":\"%s\"}},\n", io_op_names[e->op], e->file ? e->file->name : "-", io_modes[e->mode].name, e->archive + 1, (e->start - io_trace_start) * us_per_tick, e->duration * us_per_tick, e->offset, e->size, io_modes[e->mode].name, e->field == 0xFFFF ? "-" : io_fields[e->field].name);
+		}
+
+		fprintf(f, "{}]}\n");
+		fclose(f);
+	}
+
+	if(f = io_trace_open("_summary.csv"))
+	{
+		fprintf(f, "scope,name,opens,reads,seeks,bytes,time_us\n");
+
+		for(i = 0; i <= NUM_LGP_ARCHIVES; i++) io_write_counters(f, "archive", i < NUM_LGP_ARCHIVES ? lgp_names[i] : "disk", &io_archives[i], us_per_tick);
+		for(i = 0; i < num_io_modes; i++) io_write_counters(f, "mode", io_modes[i].name, &io_modes[i].counters, us_per_tick);
+		for(i = 0; i < num_io_fields; i++) io_write_counters(f, "field", io_fields[i].name, &io_fields[i].counters, us_per_tick);
+
+		for(i = 0; i < IO_FILE_BUCKETS; i++)
+		{
+			struct io_file *file;
+			char name[1024];
+
+			for(file = io_files[i]; file; file = file->next)
+			{
+				_snprintf(name, sizeof(name), "%s/%s", io_archive_name(file->archive), file->name);
+				io_write_counters(f, "file", name, &file->counters, us_per_tick);
+			}
+		}
+
+		fclose(f);
+	}
+
+	info("wrote I/O trace, %i accesses to %i files\n", num_io_events, num_io_files);
+}
+
+// dump the trace on Ctrl+F11
+void ff7_io_trace_poll()
+{
+	bool key;
+
+	if(!*io_trace_file) return;
+
+	key = (GetAsyncKeyState(VK_CONTROL) & 0x8000) && (GetAsyncKeyState(VK_F11) & 0x8000);
+
+	if(key && !io_trace_key) ff7_io_trace_dump();
+
+	io_trace_key = key;
+}
@@ -28,6 +28,225 @@
 
 #include "defs.h"
 
+/*
+ * Models, animations and textures are loaded again every time a battle or
+ * field needs them. The file contents are kept in a memory budgeted cache
+ * keyed by archive and resolved TOC entry, the loaders parse from there and
+ * hand the game its own copy of every array since it modifies and frees them
+ * with its own allocator.
+ */
+
+#define ASSET_BUCKETS 256
+
+struct asset
+{
+	struct asset *next;
+	uint lgp_num;
+	uint offset;
+	uint size;
+	uint last_used;
+	// held while a loader is reading from it
+	uint refcount;
+	// flushed while held, freed when released
+	bool detached;
+	unsigned char *data;
+};
+
+struct asset *assets[ASSET_BUCKETS];
+uint asset_cache_used = 0;
+
+struct asset_reader
+{
+	struct asset *asset;
+	unsigned char *data;
+	uint size;
+	uint pos;
+	bool resolved_conflict;
+	bool error;
+};
+
+struct asset **find_asset(uint lgp_num, uint offset)
+{
+	struct asset **asset = &assets[(offset / 4 + lgp_num * 31) % ASSET_BUCKETS];
+
+	while(*asset && ((*asset)->lgp_num != lgp_num || (*asset)->offset != offset)) asset = &(*asset)->next;
+
+	return asset;
+}
+
+void free_asset(struct asset *asset)
+{
+	driver_free(asset->data);
+	driver_free(asset);
+}
+
+// drop the least recently used assets until there is room for size bytes
+void evict_assets(uint size)
+{
+	while(asset_cache_used && asset_cache_used + size > asset_cache_size * 1024 * 1024)
+	{
+		struct asset **lru = 0;
+		struct asset *asset;
+		uint i;
+
+		for(i = 0; i < ASSET_BUCKETS; i++)
+		{
+			struct asset **entry;
+
+			for(entry = &assets[i]; *entry; entry = &(*entry)->next)
+			{
+				if(!(*entry)->refcount && (!lru || (*entry)->last_used < (*lru)->last_used)) lru = entry;
+			}
+		}
+
+		if(!lru) return;
+
+		asset = *lru;
+		*lru = asset->next;
+
+		if(trace_loaders) trace("asset cache: evicting %s/0x%x (%i bytes)\n", lgp_names[asset->lgp_num], asset->offset, asset->size);
+
+		asset_cache_used -= asset->size;
+		free_asset(asset);
+	}
+}
+
+// fetch the contents of an asset file, from the cache if it has been loaded
+// before, release with close_asset
+bool open_asset(struct file_context *file_context, char *filename, struct asset_reader *reader)
+{
+	struct ff7_file *file;
+	struct asset **entry = 0;
+	uint offset;
+
+	memset(reader, 0, sizeof(*reader));
+
+	if(asset_cache_size && lgp_resolve_file(file_context, filename, &offset, &reader->resolved_conflict))
+	{
+		entry = find_asset(file_context->lgp_num, offset);
+
+		if(*entry)
+		{
+			if(trace_loaders) trace("asset cache hit: %s/%s\n", lgp_names[file_context->lgp_num], filename);
+
+			reader->asset = *entry;
+			reader->asset->refcount++;
+			reader->asset->last_used = frame_counter;
+			reader->data = reader->asset->data;
+			reader->size = reader->asset->size;
+
+			return true;
+		}
+	}
+
+	file = open_file(file_context, filename);
+
+	if(!file) return false;
+
+	reader->size = get_filesize(file);
+	reader->data = driver_malloc(reader->size);
+
+	if(!read_file(reader->size, reader->data, file))
+	{
+		driver_free(reader->data);
+		close_file(file);
+		return false;
+	}
+
+	reader->resolved_conflict = file_resolved_conflict(file);
+
+	close_file(file);
+
+	if(entry && reader->size <= asset_cache_size * 1024 * 1024)
+	{
+		evict_assets(reader->size);
+
+		// evicting may have changed the chain we were going to add to
+		entry = find_asset(file_context->lgp_num, offset);
+
+		*entry = driver_calloc(sizeof(**entry), 1);
+		(*entry)->lgp_num = file_context->lgp_num;
+		(*entry)->offset = offset;
+		(*entry)->size = reader->size;
+		(*entry)->last_used = frame_counter;
+		(*entry)->refcount = 1;
+		(*entry)->data = reader->data;
+
+		reader->asset = *entry;
+		asset_cache_used += reader->size;
+	}
+
+	return true;
+}
+
+// drop every cached asset, assets still being read are freed when released
+void flush_assets()
+{
+	uint i;
+
+	for(i = 0; i < ASSET_BUCKETS; i++)
+	{
+		while(assets[i])
+		{
+			struct asset *asset = assets[i];
+
+			assets[i] = asset->next;
+
+			if(asset->refcount) asset->detached = true;
+			else free_asset(asset);
+		}
+	}
+
+	asset_cache_used = 0;
+}
+
+void close_asset(struct asset_reader *reader)
+{
+	if(!reader->asset) driver_free(reader->data);
+	else if(!--reader->asset->refcount && reader->asset->detached) free_asset(reader->asset);
+}
+
+// copy the next size bytes of the asset into dest
+bool asset_read(struct asset_reader *reader, uint size, void *dest)
+{
+	if(size > reader->size - reader->pos)
+	{
+		reader->error = true;
+		return false;
+	}
+
+	memcpy(dest, &reader->data[reader->pos], size);
+	reader->pos += size;
+
+	return true;
+}
+
+// copy the next count elements into memory owned by the game, like
+// alloc_read_file
+void *asset_alloc_read(struct asset_reader *reader, uint size, uint count)
+{
+	void *ret;
+
+	if(!size || !count) return 0;
+
+	if(size * count > reader->size - reader->pos)
+	{
+		reader->error = true;
+		return 0;
+	}
+
+	ret = external_malloc(size * count);
+	asset_read(reader, size * count, ret);
+
+	return ret;
+}
+
+void asset_skip(struct asset_reader *reader, uint size)
+{
+	if(size > reader->size - reader->pos) reader->error = true;
+	else reader->pos += size;
+}
+
 uint get_frame_data_size(struct anim_header *anim_header)
 {
 	if(!anim_header) return 0;
@@ -38,8 +257,8 @@ uint get_frame_data_size(struct anim_header *anim_header)
 // load .a file, save modpath name somewhere we can retrieve it later (unused)
 struct anim_header *load_animation(struct file_context *file_context, char *filename)
 {
-	struct ff7_file *file = open_file(file_context, filename);
-	struct anim_header *ret;
+	struct asset_reader reader;
+	struct anim_header *ret = 0;
 	uint size;
 	uint i;
 	uint data_pointer;
@@ -50,9 +269,9 @@ struct anim_header *load_animation(struct file_context *file_context, char *file
 		else trace("reading animation file: %s\n", filename);
 	}
 
-	if(!file) goto error;
+	if(!open_asset(file_context, filename, &reader)) return 0;
 
-	ret = common_externals.alloc_read_file(sizeof(*ret), 1, (struct file *)file);
+	ret = asset_alloc_read(&reader, sizeof(*ret), 1);
 
 	if(!ret) goto error;
 	if(ret->version.version != 1) goto error;
@@ -60,11 +279,13 @@ struct anim_header *load_animation(struct file_context *file_context, char *file
 	ret->use_matrix_array = false;
 	ret->matrix_array = 0;
 	ret->current_matrix_array = 0;
+	ret->frame_data = 0;
+	ret->anim_frames = 0;
 
 	size = get_frame_data_size(ret);
 	if(!size) goto error;
 
-	ret->frame_data = common_externals.alloc_read_file(size, 1, (struct file *)file);
+	ret->frame_data = asset_alloc_read(&reader, size, 1);
 	if(!ret->frame_data) goto error;
 
 	ret->anim_frames = external_calloc(sizeof(struct anim_frame), ret->num_frames);
@@ -79,14 +300,14 @@ struct anim_header *load_animation(struct file_context *file_context, char *file
 		data_pointer += sizeof(struct point3d) * ret->num_bones;
 	}
 
-	ret->file.pc_name = make_pc_name(file_context, file, filename);
+	ret->file.pc_name = make_asset_pc_name(file_context, reader.resolved_conflict, filename);
 
-	close_file(file);
+	close_asset(&reader);
 	return ret;
 
 error:
 	ff7_externals.destroy_animation(ret);
-	close_file(file);
+	close_asset(&reader);
 	return 0;
 };
 
@@ -131,7 +352,7 @@ struct battle_hrc_header *read_battle_hrc(bool use_file_context, struct file_con
 struct polygon_data *load_p_file(struct file_context *file_context, bool create_lists, char *filename)
 {
 	struct polygon_data *ret = ff7_externals.create_polygon_data(false, 0);
-	struct ff7_file *file = open_file(file_context, filename);
+	struct asset_reader reader;
 
 	if(trace_loaders)
 	{
@@ -139,8 +360,13 @@ struct polygon_data *load_p_file(struct file_context *file_context, bool create_
 		else trace("reading p file: %s\n", filename);
 	}
 
-	if(!file) goto error;
-	if(!read_file(sizeof(*ret), ret, file)) goto error;
+	if(!open_asset(file_context, filename, &reader))
+	{
+		ff7_externals.free_polygon_data(ret);
+		return 0;
+	}
+
+	if(!asset_read(&reader, sizeof(*ret), ret)) goto error;
 
 	ret->vertdata = 0;
 	ret->normaldata = 0;
@@ -150,7 +376,7 @@ struct polygon_data *load_p_file(struct file_context *file_context, bool create_
 	ret->polycolordata = 0;
 	ret->edgedata = 0;
 	ret->polydata = 0;
-	ret->pc_name = make_pc_name(file_context, file, filename);
+	ret->pc_name = make_asset_pc_name(file_context, reader.resolved_conflict, filename);
 	ret->field_64 = 0;
 	ret->hundredsdata = 0;
 	ret->groupdata = 0;
@@ -166,29 +392,36 @@ struct polygon_data *load_p_file(struct file_context *file_context, bool create_
 
 	if(ret->field_2C) unexpected("oops, missed some .p data\n");
 
-	ret->vertdata = common_externals.alloc_read_file(sizeof(*ret->vertdata), ret->numverts, (struct file *)file);
-	ret->normaldata = common_externals.alloc_read_file(sizeof(*ret->normaldata), ret->numnormals, (struct file *)file);
-	ret->field_48 = common_externals.alloc_read_file(sizeof(*ret->field_48), ret->field_14, (struct file *)file);
-	ret->texcoorddata = common_externals.alloc_read_file(sizeof(*ret->texcoorddata), ret->numtexcoords, (struct file *)file);
-	ret->vertexcolordata = common_externals.alloc_read_file(sizeof(*ret->vertexcolordata), ret->numvertcolors, (struct file *)file);
-	ret->polycolordata = common_externals.alloc_read_file(sizeof(*ret->polycolordata), ret->numpolys, (struct file *)file);
-	ret->edgedata = common_externals.alloc_read_file(sizeof(*ret->edgedata), ret->numedges, (struct file *)file);
-	ret->polydata = common_externals.alloc_read_file(sizeof(*ret->polydata), ret->numpolys, (struct file *)file);
-	external_free(common_externals.alloc_read_file(sizeof(struct p_polygon), ret->field_28, (struct file *)file));
-	ret->field_64 = common_externals.alloc_read_file(3, ret->field_2C, (struct file *)file);
-	ret->hundredsdata = common_externals.alloc_read_file(sizeof(*ret->hundredsdata), ret->numhundreds, (struct file *)file);
-	ret->groupdata = common_externals.alloc_read_file(sizeof(*ret->groupdata), ret->numgroups, (struct file *)file);
-	ret->boundingboxdata = common_externals.alloc_read_file(sizeof(*ret->boundingboxdata), ret->numboundingboxes, (struct file *)file);
-	if(ret->has_normindextable) ret->normindextabledata = common_externals.alloc_read_file(sizeof(*ret->normindextabledata), ret->numverts, (struct file *)file);
+	ret->vertdata = asset_alloc_read(&reader, sizeof(*ret->vertdata), ret->numverts);
+	ret->normaldata = asset_alloc_read(&reader, sizeof(*ret->normaldata), ret->numnormals);
+	ret->field_48 = asset_alloc_read(&reader, sizeof(*ret->field_48), ret->field_14);
+	ret->texcoorddata = asset_alloc_read(&reader, sizeof(*ret->texcoorddata), ret->numtexcoords);
+	ret->vertexcolordata = asset_alloc_read(&reader, sizeof(*ret->vertexcolordata), ret->numvertcolors);
+	ret->polycolordata = asset_alloc_read(&reader, sizeof(*ret->polycolordata), ret->numpolys);
+	ret->edgedata = asset_alloc_read(&reader, sizeof(*ret->edgedata), ret->numedges);
+	ret->polydata = asset_alloc_read(&reader, sizeof(*ret->polydata), ret->numpolys);
+	// unused
+	asset_skip(&reader, sizeof(struct p_polygon) * ret->field_28);
+	ret->field_64 = asset_alloc_read(&reader, 3, ret->field_2C);
+	ret->hundredsdata = asset_alloc_read(&reader, sizeof(*ret->hundredsdata), ret->numhundreds);
+	ret->groupdata = asset_alloc_read(&reader, sizeof(*ret->groupdata), ret->numgroups);
+	ret->boundingboxdata = asset_alloc_read(&reader, sizeof(*ret->boundingboxdata), ret->numboundingboxes);
+	if(ret->has_normindextable) ret->normindextabledata = asset_alloc_read(&reader, sizeof(*ret->normindextabledata), ret->numverts);
+
+	if(reader.error)
+	{
+		error("truncated polygon file %s\n", filename);
+		goto error;
+	}
 
 	if(create_lists) ff7_externals.create_polygon_lists(ret);
 
-	close_file(file);
+	close_asset(&reader);
 	return ret;
 
 error:
 	ff7_externals.free_polygon_data(ret);
-	close_file(file);
+	close_asset(&reader);
 	return 0;
 }
 
@@ -210,42 +443,48 @@ void destroy_tex_header(struct ff7_tex_header *tex_header)
 struct ff7_tex_header *load_tex_file(struct file_context *file_context, char *filename)
 {
 	struct ff7_tex_header *ret = (struct ff7_tex_header *)common_externals.create_tex_header();
-	struct ff7_file *file = open_file(file_context, filename);
+	struct asset_reader reader;
 
-	if(!file) goto error;
-	if(!read_file(sizeof(*ret), ret, file)) goto error;
+	if(!open_asset(file_context, filename, &reader))
+	{
+		destroy_tex_header(ret);
+		return 0;
+	}
+
+	if(!asset_read(&reader, sizeof(*ret), ret)) goto error;
 
 	ret->image_data = 0;
 	ret->old_palette_data = 0;
 	ret->palette_colorkey = 0;
 	ret->tex_format.palette_data = 0;
+	ret->file.pc_name = 0;
 
 	if(ret->version != 1) goto error;
 	else
 	{
 		if(ret->tex_format.use_palette)
 		{
-			ret->tex_format.palette_data = common_externals.alloc_read_file(4, ret->tex_format.palette_size, (struct file *)file);
+			ret->tex_format.palette_data = asset_alloc_read(&reader, 4, ret->tex_format.palette_size);
 			if(!ret->tex_format.palette_data) goto error;
 		}
 
-		ret->image_data = common_externals.alloc_read_file(ret->tex_format.bytesperpixel, ret->tex_format.width * ret->tex_format.height, (struct file *)file);
+		ret->image_data = asset_alloc_read(&reader, ret->tex_format.bytesperpixel, ret->tex_format.width * ret->tex_format.height);
 		if(!ret->image_data) goto error;
 
 		if(ret->use_palette_colorkey)
 		{
-			ret->palette_colorkey = common_externals.alloc_read_file(1, ret->palettes, (struct file *)file);
+			ret->palette_colorkey = asset_alloc_read(&reader, 1, ret->palettes);
 			if(!ret->palette_colorkey) goto error;
 		}
 	}
 
-	ret->file.pc_name = make_pc_name(file_context, file, filename);
+	ret->file.pc_name = make_asset_pc_name(file_context, reader.resolved_conflict, filename);
 
-	close_file(file);
+	close_asset(&reader);
 	return ret;
 
 error:
 	destroy_tex_header(ret);
-	close_file(file);
+	close_asset(&reader);
 	return 0;
 }
@@ -90,13 +90,15 @@ void ff7_set_main_loop(uint driver_mode, uint main_loop)
 	uint i;
 
 	for(i = 0; i < num_modes; i++) if(ff7_modes[i].driver_mode == driver_mode) ff7_modes[i].main_loop = main_loop;
+
+	invalidate_mode_index();
 }
 
 void ff7_set_mode_framerate(uint driver_mode, uint framerate)
 {
 	uint i;
 
-	for(i = 0; i < num_modes; i++) if(ff7_modes[i].driver_mode == driver_mode) ff7_modes[i].main_loop = framerate;
+	for(i = 0; i < num_modes; i++) if(ff7_modes[i].driver_mode == driver_mode) ff7_modes[i].framerate = framerate;
 }
 
 void ff7_find_externals()
@@ -360,6 +362,7 @@ void ff7_data()
 	ff7_find_externals();
 
 	memcpy(modes, ff7_modes, sizeof(ff7_modes));
+	invalidate_mode_index();
 	memcpy(font_map, ff7_font_map, sizeof(ff7_font_map));
 
 	font_map[''] = 114;
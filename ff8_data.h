@@ -77,6 +77,8 @@ void ff8_set_main_loop(uint driver_mode, uint main_loop)
 	uint i;
 
 	for(i = 0; i < num_modes; i++) if(ff8_modes[i].driver_mode == driver_mode) ff8_modes[i].main_loop = main_loop;
+
+	invalidate_mode_index();
 }
 
 void ff8_find_externals()
@@ -296,10 +298,13 @@ void ff8_find_externals()
 
 void ff8_data()
 {
+	// ff8_set_main_loop needs to know the number of modes
+	num_modes = sizeof(ff8_modes) / sizeof(ff8_modes[0]);
+
 	ff8_find_externals();
 
 	memcpy(modes, ff8_modes, sizeof(ff8_modes));
-	num_modes = sizeof(ff8_modes) / sizeof(ff8_modes[0]);
+	invalidate_mode_index();
 	memcpy(font_map, ff8_font_map, sizeof(ff8_font_map));
 
 	text_colors[TEXTCOLOR_GRAY] = 1;
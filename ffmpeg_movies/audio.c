@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio.h"
+
+// differences between the video and audio clock smaller than this are
+// smoothed out over several frames, anything bigger is corrected at once
+#define AUDIO_RESYNC 0.02
+#define AUDIO_SMOOTHING 4.0
+
+// keep the compiler from moving ring accesses across updates of the counters
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BARRIER() _ReadWriteBarrier()
+#else
+#define BARRIER() __asm__ __volatile__("" ::: "memory")
+#endif
+
+bool audio_ring_init(struct audio_ring *ring, uint min_size)
+{
+	uint size = 4096;
+
+	while(size < min_size) size *= 2;
+
+	ring->data = malloc(size);
+	ring->size = size;
+	ring->read = 0;
+	ring->write = 0;
+
+	return ring->data != 0;
+}
+
+void audio_ring_free(struct audio_ring *ring)
+{
+	free(ring->data);
+	ring->data = 0;
+}
+
+uint audio_ring_used(struct audio_ring *ring)
+{
+	return ring->write - ring->read;
+}
+
+uint audio_ring_write(struct audio_ring *ring, char *data, uint size)
+{
+	uint write = ring->write;
+	uint read = ring->read;
+	uint offset = write & (ring->size - 1);
+	uint first;
+
+	BARRIER();
+
+	if(size > ring->size - (write - read)) size = ring->size - (write - read);
+
+	first = ring->size - offset < size ? ring->size - offset : size;
+
+	memcpy(&ring->data[offset], data, first);
+	memcpy(ring->data, &data[first], size - first);
+
+	BARRIER();
+
+	ring->write = write + size;
+
+	return size;
+}
+
+uint audio_ring_read(struct audio_ring *ring, char *dest, uint size)
+{
+	uint read = ring->read;
+	uint write = ring->write;
+	uint offset = read & (ring->size - 1);
+	uint first;
+
+	BARRIER();
+
+	if(size > write - read) size = write - read;
+
+	first = ring->size - offset < size ? ring->size - offset : size;
+
+	memcpy(dest, &ring->data[offset], first);
+	memcpy(&dest[first], ring->data, size - first);
+
+	BARRIER();
+
+	ring->read = read + size;
+
+	return size;
+}
+
+struct null_sink
+{
+	double (*now)(void *);
+	void *context;
+	// time at which playback would have started had it never run dry
+	double start_time;
+	double played;
+	bool playing;
+	FILE *file;
+	uint channels;
+	uint bits;
+	char buffer[4096];
+};
+
+static void put_le(char *dest, uint value, uint bytes)
+{
+	uint i;
+
+	for(i = 0; i < bytes; i++) dest[i] = (value >> (i * 8)) & 0xFF;
+}
+
+static void write_wav_header(struct audio_sink *sink, uint channels, uint bits, FILE *f, uint data_size)
+{
+	char header[44];
+
+	memcpy(header, "RIFF", 4);
+	put_le(&header[4], 36 + data_size, 4);
+	memcpy(&header[8], "WAVEfmt ", 8);
+	put_le(&header[16], 16, 4);
+	put_le(&header[20], 1, 2);
+	put_le(&header[22], channels, 2);
+	put_le(&header[24], sink->bytes_per_second / sink->block_align, 4);
+	put_le(&header[28], sink->bytes_per_second, 4);
+	put_le(&header[32], sink->block_align, 2);
+	put_le(&header[34], bits, 2);
+	memcpy(&header[36], "data", 4);
+	put_le(&header[40], data_size, 4);
+
+	fwrite(header, 1, sizeof(header), f);
+}
+
+static void null_start(struct audio_sink *sink)
+{
+	struct null_sink *n = sink->data;
+
+	n->start_time = n->now(n->context) - n->played / sink->bytes_per_second;
+	n->playing = true;
+}
+
+static void null_stop(struct audio_sink *sink)
+{
+	struct null_sink *n = sink->data;
+
+	n->playing = false;
+}
+
+static bool null_update(struct audio_sink *sink)
+{
+	struct null_sink *n = sink->data;
+	double now;
+	double target;
+
+	if(!n->playing) return true;
+
+	now = n->now(n->context);
+	target = floor((now - n->start_time) * sink->bytes_per_second / sink->block_align) * sink->block_align;
+
+	while(n->played < target)
+	{
+		uint size = target - n->played < sizeof(n->buffer) ? (uint)(target - n->played) : sizeof(n->buffer);
+
+		size = audio_ring_read(sink->ring, n->buffer, size);
+
+		// ran dry, pretend the device was paused until now
+		if(size == 0)
+		{
+			n->start_time = now - n->played / sink->bytes_per_second;
+			return false;
+		}
+
+		if(n->file) fwrite(n->buffer, 1, size, n->file);
+
+		n->played += size;
+	}
+
+	return true;
+}
+
+static double null_clock(struct audio_sink *sink)
+{
+	struct null_sink *n = sink->data;
+
+	return n->played / sink->bytes_per_second;
+}
+
+static void null_release(struct audio_sink *sink)
+{
+	struct null_sink *n = sink->data;
+
+	if(n->file)
+	{
+		fseek(n->file, 0, SEEK_SET);
+		write_wav_header(sink, n->channels, n->bits, n->file, (uint)n->played);
+		fclose(n->file);
+	}
+
+	free(n);
+	free(sink);
+}
+
+struct audio_sink *audio_null_sink(struct audio_ring *ring, uint channels, uint sample_rate, uint bits, char *filename, double (*now)(void *), void *context)
+{
+	struct audio_sink *sink = calloc(1, sizeof(*sink));
+	struct null_sink *n = calloc(1, sizeof(*n));
+
+	sink->start = null_start;
+	sink->stop = null_stop;
+	sink->update = null_update;
+	sink->clock = null_clock;
+	sink->release = null_release;
+	sink->ring = ring;
+	sink->block_align = channels * bits / 8;
+	sink->bytes_per_second = sink->block_align * sample_rate;
+	sink->data = n;
+
+	n->now = now;
+	n->context = context;
+	n->channels = channels;
+	n->bits = bits;
+
+	if(filename)
+	{
+		n->file = fopen(filename, "wb");
+
+		// placeholder until we know how much was written
+		if(n->file) write_wav_header(sink, n->channels, n->bits, n->file, 0);
+	}
+
+	return sink;
+}
+
+double audio_sync_correction(double video_time, double audio_time)
+{
+	double error = video_time - audio_time;
+
+	if(fabs(error) > AUDIO_RESYNC) return error;
+
+	return error / AUDIO_SMOOTHING;
+}
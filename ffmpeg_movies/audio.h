@@ -0,0 +1,51 @@
+#ifndef _AUDIO_H_
+#define _AUDIO_H_
+
+#include "types.h"
+
+// decoded PCM waiting to be played, written by the decoder thread and read by
+// the thread feeding the audio sink, read and write are running byte counts
+struct audio_ring
+{
+	char *data;
+	uint size;
+	volatile uint read;
+	volatile uint write;
+};
+
+// audio output, fed from a ring and providing the clock movie playback is
+// scheduled by
+struct audio_sink
+{
+	void (*start)(struct audio_sink *sink);
+	void (*stop)(struct audio_sink *sink);
+	// move decoded audio from the ring to the output, returns false if the
+	// output ran dry and the clock can't be trusted right now
+	bool (*update)(struct audio_sink *sink);
+	// seconds of movie audio played so far
+	double (*clock)(struct audio_sink *sink);
+	void (*release)(struct audio_sink *sink);
+
+	struct audio_ring *ring;
+	uint bytes_per_second;
+	uint block_align;
+	void *data;
+};
+
+// the ring is rounded up to a power of two
+bool audio_ring_init(struct audio_ring *ring, uint min_size);
+void audio_ring_free(struct audio_ring *ring);
+uint audio_ring_used(struct audio_ring *ring);
+// both return how much was actually copied, which may be less than asked for
+uint audio_ring_write(struct audio_ring *ring, char *data, uint size);
+uint audio_ring_read(struct audio_ring *ring, char *dest, uint size);
+
+// plays audio into the void in real time as measured by <now>, optionally
+// writing it to a WAV file, for testing without a sound device
+struct audio_sink *audio_null_sink(struct audio_ring *ring, uint channels, uint sample_rate, uint bits, char *filename, double (*now)(void *), void *context);
+
+// how many seconds to move the video clock back to bring it in line with the
+// audio clock
+double audio_sync_correction(double video_time, double audio_time);
+
+#endif
@@ -7,18 +7,55 @@
 #include <math.h>
 #include <sys/timeb.h>
 #include <dsound.h>
+#include <process.h>
 
 #include "types.h"
+#include "yuv2bgra.h"
+#include "audio.h"
+#include "stream_cache.h"
 
-// 10 frames
-#define VIDEO_BUFFER_SIZE 10
+// textures and upload buffers cycled through, frames are uploaded right before
+// they are drawn so only a few are ever in flight
+#define VIDEO_BUFFER_SIZE 3
 
-// 20 seconds
-#define AUDIO_BUFFER_SIZE 20
+// give up waiting for an upload buffer to be released after this many
+// nanoseconds and overwrite it anyway
+#define UPLOAD_FENCE_TIMEOUT 100000000
+
+// decoded frames waiting to be uploaded
+#define DECODE_QUEUE_SIZE 8
+
+// extra threads converting YUV frames alongside the render thread
+#define MAX_CONVERT_THREADS 3
+
+// seconds of audio in the DirectSound buffer
+#define AUDIO_BUFFER_SIZE 2
+
+// seconds of decoded audio the decoder thread can get ahead of playback
+#define AUDIO_RING_SIZE 2
+
+// keep the sound buffer at least this full, in seconds, or fill it with silence
+#define AUDIO_MIN_BUFFERED 0.1
+
+// how often to check for room in the audio ring or feed the sound buffer while
+// waiting for something else, in milliseconds
+#define AUDIO_WAIT_MS 10
 
 inline double round(double x) { return floor(x + 0.5); }
 
-#define LAG (((now - start_time) - (timer_freq / movie_fps) * movie_frame_counter) / (timer_freq / 1000))
+// how late the given frame is, in milliseconds
+#define LAG(frame, start) (((now - (start)) - (timer_freq / movie_fps) * (frame)) / (timer_freq / 1000))
+
+// the wait for the next frame sleeps on a high resolution timer and spins for
+// the last part, without one sleeping can overshoot by a full scheduler tick
+#define SPIN_MS 2.0
+#define SPIN_MS_LOW_RES 16.0
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x2
+#endif
+
+typedef HANDLE (WINAPI *create_waitable_timer_ex_proc)(LPSECURITY_ATTRIBUTES, LPCSTR, DWORD, DWORD);
 
 uint texture_units = 1;
 
@@ -38,15 +75,79 @@ int audiostream;
 
 bool use_bgra_texture;
 
+// YUV420P frames without the multitexture path are converted to BGRA by us
+// instead of swscale, straight into the upload buffer
+bool cpu_convert;
+
 struct video_frame
 {
 	GLuint bgra_texture;
 	GLuint yuv_textures[3];
+	// pixel buffer the textures were last uploaded from and a fence that is
+	// signaled once that upload is done
+	GLuint pbo;
+	GLsync fence;
 };
 
+// upload through pixel buffer objects, fences tell us when one can be reused
+bool use_pbo;
+bool use_fences;
+
+// movie being opened and probed in the background by prepare_movie_async,
+// prepare_name stays set while that movie is loaded
+HANDLE prepare_thread = 0;
+char prepare_name[512];
+
 struct video_frame video_buffer[VIDEO_BUFFER_SIZE];
-uint vbuffer_read = 0;
 uint vbuffer_write = 0;
+uint vbuffer_current = 0;
+// vbuffer_current holds a frame of this movie, the decoder may have dropped
+// the first few
+bool frame_uploaded = false;
+
+// a frame copied out of the decoder, planes point into decode_storage
+struct decoded_frame
+{
+	uint index;
+	char *planes[3];
+	uint strides[3];
+};
+
+// single producer, single consumer queue filled by the decoder thread, each
+// side only ever advances its own counter
+struct decoded_frame decode_queue[DECODE_QUEUE_SIZE];
+volatile uint queue_read = 0;
+volatile uint queue_write = 0;
+char *decode_storage = 0;
+uint decode_frame_size;
+
+// size of an uploaded frame, converted frames are bigger than queued ones
+uint upload_size;
+// converted frame if it can't go into an upload buffer
+char *convert_buffer = 0;
+
+struct yuv2bgra_job convert_job;
+// slice i covers rows convert_rows[i] to convert_rows[i + 1]
+uint convert_rows[MAX_CONVERT_THREADS + 2];
+HANDLE convert_threads[MAX_CONVERT_THREADS];
+HANDLE convert_start[MAX_CONVERT_THREADS];
+HANDLE convert_done[MAX_CONVERT_THREADS];
+uint num_convert_threads = 0;
+bool convert_threads_started = false;
+
+HANDLE decoder_thread = 0;
+// set by the decoder when a frame is queued or the movie ends
+HANDLE frame_event;
+// set by the game when a frame is taken, or to make the decoder seek or quit
+HANDLE wake_event;
+volatile bool decoder_quit;
+volatile bool decoder_seek;
+volatile bool decoder_eof;
+// number of frames decoded so far, only used by the decoder thread
+uint decoded_frames;
+
+// start_time is valid, the decoder can drop late frames
+volatile bool movie_started = false;
 
 uint max_texture_size;
 
@@ -63,14 +164,17 @@ uint skipped_frames;
 
 bool movie_sync_debug;
 
-IDirectSoundBuffer *sound_buffer = 0;
-uint sound_buffer_size;
-uint write_pointer = 0;
-
-bool first_audio_packet;
+struct audio_ring audio_ring;
+struct audio_sink *audio_sink = 0;
+// the audio clock was running on the last update
+bool audio_clock_valid;
 
 time_t timer_freq;
-time_t start_time;
+HANDLE frame_timer;
+double spin_ms = SPIN_MS_LOW_RES;
+// only written by the game thread, the decoder thread reads it through
+// get_start_time
+volatile time_t start_time;
 
 void (*trace)(char *, ...);
 void (*info)(char *, ...);
@@ -87,6 +191,34 @@ BOOL APIENTRY DllMain(HANDLE hInst, ULONG ul_reason_for_call, LPVOID lpReserved)
 	return TRUE;
 }
 
+// use a high resolution waitable timer where available (Windows 10 1803 and
+// later), Sleep otherwise
+void create_frame_timer()
+{
+	create_waitable_timer_ex_proc create_timer_ex = (create_waitable_timer_ex_proc)GetProcAddress(GetModuleHandleA("kernel32.dll"), "CreateWaitableTimerExA");
+
+	if(create_timer_ex) frame_timer = create_timer_ex(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+	if(frame_timer) spin_ms = SPIN_MS;
+}
+
+void sleep_ms(double ms)
+{
+	LARGE_INTEGER due;
+
+	if(!frame_timer)
+	{
+		Sleep((DWORD)ms);
+		return;
+	}
+
+	// relative due time in 100ns units
+	due.QuadPart = -(LONGLONG)(ms * 10000.0);
+
+	if(!SetWaitableTimer(frame_timer, &due, 0, 0, 0, false)) Sleep((DWORD)ms);
+	else WaitForSingleObject(frame_timer, INFINITE);
+}
+
 __declspec(dllexport) void movie_init(void *plugin_trace, void *plugin_info, void *plugin_glitch, void *plugin_error, void *plugin_draw_movie_quad_bgra, void *plugin_draw_movie_quad_yuv, IDirectSound **plugin_directsound, bool plugin_skip_frames, bool plugin_movie_sync_debug)
 {
 	av_register_all();
@@ -108,61 +240,741 @@ __declspec(dllexport) void movie_init(void *plugin_trace, void *plugin_info, voi
 
 	glGetIntegerv(GL_MAX_TEXTURE_UNITS, &texture_units);
 
-	if(texture_units < 3) info("No multitexturing, codecs with YUV output will be slow. (texture units: %i)\n", texture_units);
+	if(texture_units < 3) info("No multitexturing, YUV output will be converted on the CPU. (texture units: %i)\n", texture_units);
 	else yuv_fast_path = true;
 
+	yuv2bgra_sse2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+
 	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
 
+	create_frame_timer();
+
+	use_pbo = GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object;
+	use_fences = use_pbo && GLEW_ARB_sync;
+
 	QueryPerformanceFrequency((LARGE_INTEGER *)&timer_freq);
+
+	frame_event = CreateEvent(0, false, false, 0);
+	wake_event = CreateEvent(0, false, false, 0);
 }
 
-// clean up anything we have allocated
-__declspec(dllexport) void release_movie_objects()
+// 64-bit loads and stores aren't atomic on x86, the decoder thread must not
+// see half of an update
+time_t get_start_time()
+{
+	return InterlockedCompareExchange64((volatile LONGLONG *)&start_time, 0, 0);
+}
+
+void set_start_time(time_t time)
+{
+	time_t old;
+
+	do old = start_time; while(InterlockedCompareExchange64((volatile LONGLONG *)&start_time, time, old) != old);
+}
+
+void create_texture(GLuint *texture, GLint internalformat, uint width, uint height, GLenum format)
+{
+	glGenTextures(1, texture);
+	glBindTexture(GL_TEXTURE_2D, *texture);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+
+	if(format == GL_LUMINANCE)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	}
+
+	glTexImage2D(GL_TEXTURE_2D, 0, internalformat, width, height, 0, format, GL_UNSIGNED_BYTE, 0);
+}
+
+// allocate textures and upload buffers once per movie, every frame after this
+// only replaces their contents
+void create_movie_textures()
 {
 	uint i;
 
+	for(i = 0; i < VIDEO_BUFFER_SIZE; i++)
+	{
+		if(use_bgra_texture) create_texture(&video_buffer[i].bgra_texture, GL_RGB8, movie_width, movie_height, GL_BGR);
+		else
+		{
+			create_texture(&video_buffer[i].yuv_textures[0], GL_LUMINANCE8, movie_width, movie_height, GL_LUMINANCE);
+			create_texture(&video_buffer[i].yuv_textures[1], GL_LUMINANCE8, movie_width / 2, movie_height / 2, GL_LUMINANCE);
+			create_texture(&video_buffer[i].yuv_textures[2], GL_LUMINANCE8, movie_width / 2, movie_height / 2, GL_LUMINANCE);
+		}
+
+		if(use_pbo)
+		{
+			glGenBuffers(1, &video_buffer[i].pbo);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, video_buffer[i].pbo);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, upload_size, 0, GL_STREAM_DRAW);
+		}
+	}
+
+	if(use_pbo) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void stop_decoder()
+{
+	if(!decoder_thread) return;
+
+	decoder_quit = true;
+	SetEvent(wake_event);
+
+	WaitForSingleObject(decoder_thread, INFINITE);
+	CloseHandle(decoder_thread);
+
+	decoder_thread = 0;
+}
+
+// clean up everything but GL objects, safe to call from the prepare thread
+void release_decoder_objects()
+{
+	// the decoder thread uses everything below
+	stop_decoder();
+
 	if(codec_ctx) avcodec_close(codec_ctx);
 	if(acodec_ctx) avcodec_close(acodec_ctx);
 	if(format_ctx) av_close_input_file(format_ctx);
-	if(sound_buffer && *directsound) IDirectSoundBuffer_Release(sound_buffer);
+	if(audio_sink) audio_sink->release(audio_sink);
+	audio_ring_free(&audio_ring);
 
 	codec_ctx = 0;
 	acodec_ctx = 0;
 	format_ctx = 0;
-	sound_buffer = 0;
+	audio_sink = 0;
 
 	if(skipped_frames > 0) info("skipped %i frames\n", skipped_frames);
 	skipped_frames = 0;
 
+	free(decode_storage);
+	decode_storage = 0;
+
+	free(convert_buffer);
+	convert_buffer = 0;
+
+	movie_started = false;
+}
+
+// wait for a movie being prepared in the background and finish setting it up
+// on this thread, every export that touches the movie calls this first
+void finish_prepare()
+{
+	if(!prepare_thread) return;
+
+	WaitForSingleObject(prepare_thread, INFINITE);
+	CloseHandle(prepare_thread);
+
+	prepare_thread = 0;
+
+	if(decoder_thread) create_movie_textures();
+}
+
+// clean up anything we have allocated
+__declspec(dllexport) void release_movie_objects()
+{
+	uint i;
+
+	finish_prepare();
+
+	release_decoder_objects();
+
+	prepare_name[0] = 0;
+
 	for(i = 0; i < VIDEO_BUFFER_SIZE; i++)
 	{
 		glDeleteTextures(1, &video_buffer[i].bgra_texture);
 		video_buffer[i].bgra_texture = 0;
 		glDeleteTextures(3, video_buffer[i].yuv_textures);
 		memset(video_buffer[i].yuv_textures, 0, sizeof(video_buffer[i].yuv_textures));
+
+		if(video_buffer[i].pbo) glDeleteBuffers(1, &video_buffer[i].pbo);
+		video_buffer[i].pbo = 0;
+
+		if(video_buffer[i].fence) glDeleteSync(video_buffer[i].fence);
+		video_buffer[i].fence = 0;
 	}
 }
 
-// prepare a movie for playback
-__declspec(dllexport) uint prepare_movie(char *name)
+void copy_plane(char *dest, uint dest_stride, char *source, uint source_stride, uint width, uint height)
+{
+	uint y;
+
+	for(y = 0; y < height; y++) memcpy(&dest[y * dest_stride], &source[y * source_stride], width);
+}
+
+// copy or convert a decoded frame into the queue, called on the decoder thread
+void queue_video_frame(AVPacket *packet)
+{
+	struct decoded_frame *frame = &decode_queue[queue_write % DECODE_QUEUE_SIZE];
+	uint index = decoded_frames++;
+	time_t now;
+	time_t start;
+
+	QueryPerformanceCounter((LARGE_INTEGER *)&now);
+	start = get_start_time();
+
+	// check if we are falling behind, frames that are already late are
+	// dropped before any copying or conversion is done
+	if(movie_started)
+	{
+		if(skip_frames && movie_fps < 100.0 && LAG(index, start) > 100.0) skipping_frames = true;
+
+		if(skipping_frames && LAG(index, start) > 0.0)
+		{
+			skipped_frames++;
+			if(((skipped_frames - 1) & skipped_frames) == 0) glitch("video playback is lagging behind, skipping frames (frame #: %i, skipped: %i, lag: %f)\n", index, skipped_frames, LAG(index, start));
+			return;
+		}
+		else skipping_frames = false;
+	}
+
+	if(movie_sync_debug) info("video: DTS %f PTS %f (timebase %f) decoded frame %i at real time %f (play %f)\n", (double)packet->dts, (double)packet->pts, av_q2d(codec_ctx->time_base), index, movie_started ? (double)(now - start) / (double)timer_freq : 0.0, (double)index / (double)movie_fps);
+
+	frame->index = index;
+
+	if(sws_ctx) sws_scale(sws_ctx, movie_frame->data, movie_frame->linesize, 0, movie_height, frame->planes, frame->strides);
+	else if(use_bgra_texture && !cpu_convert) copy_plane(frame->planes[0], frame->strides[0], movie_frame->data[0], movie_frame->linesize[0], frame->strides[0], movie_height);
+	else
+	{
+		copy_plane(frame->planes[0], frame->strides[0], movie_frame->data[0], movie_frame->linesize[0], movie_width, movie_height);
+		copy_plane(frame->planes[1], frame->strides[1], movie_frame->data[1], movie_frame->linesize[1], movie_width / 2, movie_height / 2);
+		copy_plane(frame->planes[2], frame->strides[2], movie_frame->data[2], movie_frame->linesize[2], movie_width / 2, movie_height / 2);
+	}
+
+	queue_write++;
+	SetEvent(frame_event);
+}
+
+struct dsound_sink
+{
+	IDirectSoundBuffer *buffer;
+	uint size;
+	uint write_pointer;
+	uint last_play_cursor;
+	// running byte counts, silence is what we wrote when the ring ran dry
+	double played;
+	double written;
+	double silence;
+	// the clock is off until the last silence written has been played
+	double silence_end;
+	char silence_value;
+	bool playing;
+};
+
+void dsound_start(struct audio_sink *sink)
+{
+	struct dsound_sink *d = sink->data;
+	uint write_cursor;
+
+	if(!*directsound) return;
+
+	IDirectSoundBuffer_GetCurrentPosition(d->buffer, &d->last_play_cursor, &write_cursor);
+
+	if(IDirectSoundBuffer_Play(d->buffer, 0, 0, DSBPLAY_LOOPING)) error("couldn't play sound buffer\n");
+
+	d->playing = true;
+}
+
+void dsound_stop(struct audio_sink *sink)
+{
+	struct dsound_sink *d = sink->data;
+
+	if(*directsound) IDirectSoundBuffer_Stop(d->buffer);
+
+	d->playing = false;
+}
+
+// fill part of the sound buffer from the ring or with silence
+void dsound_write(struct audio_sink *sink, uint size, bool silence)
+{
+	struct dsound_sink *d = sink->data;
+	char *ptr1;
+	char *ptr2;
+	uint bytes1;
+	uint bytes2;
+
+	if(IDirectSoundBuffer_Lock(d->buffer, d->write_pointer, size, &ptr1, &bytes1, &ptr2, &bytes2, 0))
+	{
+		error("couldn't lock sound buffer\n");
+		return;
+	}
+
+	if(silence)
+	{
+		memset(ptr1, d->silence_value, bytes1);
+		memset(ptr2, d->silence_value, bytes2);
+	}
+	else
+	{
+		audio_ring_read(sink->ring, ptr1, bytes1);
+		audio_ring_read(sink->ring, ptr2, bytes2);
+	}
+
+	if(IDirectSoundBuffer_Unlock(d->buffer, ptr1, bytes1, ptr2, bytes2)) error("couldn't unlock sound buffer\n");
+
+	d->write_pointer = (d->write_pointer + bytes1 + bytes2) % d->size;
+	d->written += bytes1 + bytes2;
+
+	if(silence)
+	{
+		d->silence += bytes1 + bytes2;
+		d->silence_end = d->written;
+	}
+}
+
+bool dsound_update(struct audio_sink *sink)
+{
+	struct dsound_sink *d = sink->data;
+	uint play_cursor;
+	uint write_cursor;
+	uint size;
+
+	if(!*directsound) return false;
+
+	if(d->playing)
+	{
+		IDirectSoundBuffer_GetCurrentPosition(d->buffer, &play_cursor, &write_cursor);
+
+		d->played += (play_cursor + d->size - d->last_play_cursor) % d->size;
+		d->last_play_cursor = play_cursor;
+
+		// played past the end of what we wrote, that wasn't movie audio
+		if(d->played > d->written)
+		{
+			d->silence += d->played - d->written;
+			d->written = d->played;
+			d->write_pointer = play_cursor;
+		}
+	}
+
+	// everything we can fit without overwriting what hasn't been played yet
+	size = d->size - sink->block_align - (uint)(d->written - d->played);
+	if(size > audio_ring_used(sink->ring)) size = audio_ring_used(sink->ring);
+	size -= size % sink->block_align;
+
+	if(size) dsound_write(sink, size, false);
+
+	// ran dry, keep going with silence until there's more
+	if(d->playing && d->written - d->played < AUDIO_MIN_BUFFERED * sink->bytes_per_second)
+	{
+		size = (uint)(AUDIO_MIN_BUFFERED * sink->bytes_per_second);
+		dsound_write(sink, size - size % sink->block_align, true);
+	}
+
+	return d->played >= d->silence_end;
+}
+
+double dsound_clock(struct audio_sink *sink)
+{
+	struct dsound_sink *d = sink->data;
+
+	return (d->played - d->silence) / sink->bytes_per_second;
+}
+
+void dsound_release(struct audio_sink *sink)
+{
+	struct dsound_sink *d = sink->data;
+
+	if(*directsound) IDirectSoundBuffer_Release(d->buffer);
+
+	free(d);
+	free(sink);
+}
+
+// movie audio through a streaming DirectSound buffer
+struct audio_sink *dsound_sink(struct audio_ring *ring, WAVEFORMATEX *format)
+{
+	struct audio_sink *sink;
+	struct dsound_sink *d;
+	DSBUFFERDESC1 sbdesc;
+	IDirectSoundBuffer *buffer;
+	uint ret;
+
+	sbdesc.dwSize = sizeof(sbdesc);
+	sbdesc.lpwfxFormat = format;
+	sbdesc.dwFlags = DSBCAPS_GETCURRENTPOSITION2;
+	sbdesc.dwReserved = 0;
+	sbdesc.dwBufferBytes = format->nAvgBytesPerSec * AUDIO_BUFFER_SIZE;
+
+	if(ret = IDirectSound_CreateSoundBuffer(*directsound, (LPCDSBUFFERDESC)&sbdesc, &buffer, 0))
+	{
+		error("couldn't create sound buffer (%i, %i, %i, %i)\n", acodec_ctx->sample_fmt, acodec_ctx->bit_rate, acodec_ctx->sample_rate, acodec_ctx->channels);
+		return 0;
+	}
+
+	sink = calloc(1, sizeof(*sink));
+	d = calloc(1, sizeof(*d));
+
+	sink->start = dsound_start;
+	sink->stop = dsound_stop;
+	sink->update = dsound_update;
+	sink->clock = dsound_clock;
+	sink->release = dsound_release;
+	sink->ring = ring;
+	sink->bytes_per_second = format->nAvgBytesPerSec;
+	sink->block_align = format->nBlockAlign;
+	sink->data = d;
+
+	d->buffer = buffer;
+	d->size = sbdesc.dwBufferBytes;
+	d->silence_value = format->wBitsPerSample == 8 ? 0x80 : 0;
+
+	return sink;
+}
+
+// move decoded audio towards the sound device and wake up the decoder in case
+// it was waiting for room in the ring
+void feed_audio()
+{
+	if(!audio_sink) return;
+
+	audio_clock_valid = audio_sink->update(audio_sink);
+
+	SetEvent(wake_event);
+}
+
+// copy decoded audio into the ring, waits for the sink to make room if the
+// decoder is too far ahead
+void queue_audio(char *data, uint size)
+{
+	while(size && !decoder_quit && !decoder_seek)
+	{
+		uint written = audio_ring_write(&audio_ring, data, size);
+
+		data += written;
+		size -= written;
+
+		if(size) WaitForSingleObject(wake_event, AUDIO_WAIT_MS);
+	}
+}
+
+// decode audio into the audio ring, called on the decoder thread
+void buffer_audio_packet(AVPacket *packet)
+{
+	char buffer_storage[(AVCODEC_MAX_AUDIO_FRAME_SIZE * 3) / 2];
+	char *buffer = (char *)(((((uint)buffer_storage) + 15) / 16) * 16);
+	int size;
+	int used_bytes;
+	char *packet_data = packet->data;
+	int packet_size = packet->size;
+	time_t now;
+
+	QueryPerformanceCounter((LARGE_INTEGER *)&now);
+
+	if(movie_sync_debug) info("audio: DTS %f PTS %f (timebase %f) placed in audio ring at real time %f (buffered %f)\n", (double)packet->dts, (double)packet->pts, av_q2d(acodec_ctx->time_base), movie_started ? (double)(now - get_start_time()) / (double)timer_freq : 0.0, (double)audio_ring_used(&audio_ring) / (double)audio_sink->bytes_per_second);
+
+	while(packet_size > 0)
+	{
+		size = AVCODEC_MAX_AUDIO_FRAME_SIZE;
+
+		used_bytes = avcodec_decode_audio2(acodec_ctx, (int16_t *)buffer, &size, packet_data, packet_size);
+
+		if(used_bytes <= 0) break;
+
+		packet_data += used_bytes;
+		packet_size -= used_bytes;
+
+		if(size > 0) queue_audio(buffer, size);
+	}
+}
+
+// demux and decode ahead of playback until the queue is full
+unsigned __stdcall decoder_main(void *parameter)
+{
+	AVPacket packet;
+
+	while(!decoder_quit)
+	{
+		if(decoder_seek)
+		{
+			avformat_seek_file(format_ctx, -1, 0, 0, 0, 0);
+			decoder_seek = false;
+			decoder_eof = false;
+		}
+
+		if(decoder_eof || queue_write - queue_read == DECODE_QUEUE_SIZE)
+		{
+			WaitForSingleObject(wake_event, INFINITE);
+			continue;
+		}
+
+		if(av_read_frame(format_ctx, &packet) < 0)
+		{
+			decoder_eof = true;
+			SetEvent(frame_event);
+			continue;
+		}
+
+		if(packet.stream_index == videostream)
+		{
+			bool frame_finished;
+
+			avcodec_decode_video2(codec_ctx, movie_frame, &frame_finished, &packet);
+
+			if(frame_finished) queue_video_frame(&packet);
+		}
+
+		if(packet.stream_index == audiostream && audio_sink) buffer_audio_packet(&packet);
+
+		av_free_packet(&packet);
+	}
+
+	return 0;
+}
+
+// allocate queue storage in the format frames will be uploaded in and start
+// decoding
+void start_decoder()
+{
+	uint sizes[3] = {0, 0, 0};
+	uint strides[3] = {0, 0, 0};
+	uint frame_size;
+	uint i, j;
+
+	if(sws_ctx) strides[0] = movie_width * 3;
+	else if(use_bgra_texture && !cpu_convert) strides[0] = movie_width * (codec_ctx->pix_fmt == PIX_FMT_BGRA ? 4 : 3);
+	else
+	{
+		strides[0] = movie_width;
+		strides[1] = movie_width / 2;
+		strides[2] = movie_width / 2;
+		sizes[1] = strides[1] * (movie_height / 2);
+		sizes[2] = strides[2] * (movie_height / 2);
+	}
+
+	sizes[0] = strides[0] * movie_height;
+	frame_size = sizes[0] + sizes[1] + sizes[2];
+
+	decode_storage = malloc(frame_size * DECODE_QUEUE_SIZE);
+	decode_frame_size = frame_size;
+
+	if(cpu_convert)
+	{
+		upload_size = movie_width * movie_height * 4;
+		convert_buffer = malloc(upload_size);
+	}
+	else upload_size = frame_size;
+
+	for(i = 0; i < DECODE_QUEUE_SIZE; i++)
+	{
+		char *data = &decode_storage[i * frame_size];
+
+		for(j = 0; j < 3; j++)
+		{
+			decode_queue[i].planes[j] = sizes[j] ? data : 0;
+			decode_queue[i].strides[j] = strides[j];
+			data += sizes[j];
+		}
+	}
+
+	queue_read = 0;
+	queue_write = 0;
+	decoded_frames = 0;
+	skipping_frames = false;
+	movie_started = false;
+
+	decoder_quit = false;
+	decoder_seek = false;
+	decoder_eof = false;
+
+	ResetEvent(frame_event);
+	ResetEvent(wake_event);
+
+	decoder_thread = (HANDLE)_beginthreadex(0, 0, decoder_main, 0, 0, 0);
+
+	if(!decoder_thread) error("couldn't start movie decoder thread\n");
+}
+
+// convert one slice of the current frame each time we're woken up
+unsigned __stdcall convert_main(void *parameter)
+{
+	uint slice = (uint)parameter;
+
+	while(true)
+	{
+		WaitForSingleObject(convert_start[slice], INFINITE);
+
+		yuv2bgra_rows(&convert_job, convert_rows[slice], convert_rows[slice + 1]);
+
+		SetEvent(convert_done[slice]);
+	}
+
+	return 0;
+}
+
+// started the first time they're needed and kept around after that, leave one
+// core for the decoder thread
+void start_convert_threads()
+{
+	SYSTEM_INFO sysinfo;
+	uint i;
+
+	if(convert_threads_started) return;
+
+	convert_threads_started = true;
+
+	GetSystemInfo(&sysinfo);
+
+	num_convert_threads = sysinfo.dwNumberOfProcessors > 2 ? sysinfo.dwNumberOfProcessors - 2 : 0;
+	if(num_convert_threads > MAX_CONVERT_THREADS) num_convert_threads = MAX_CONVERT_THREADS;
+
+	for(i = 0; i < num_convert_threads; i++)
+	{
+		convert_start[i] = CreateEvent(0, false, false, 0);
+		convert_done[i] = CreateEvent(0, false, false, 0);
+		convert_threads[i] = (HANDLE)_beginthreadex(0, 0, convert_main, (void *)i, 0, 0);
+
+		if(!convert_threads[i])
+		{
+			error("couldn't start video conversion thread\n");
+			break;
+		}
+	}
+
+	num_convert_threads = i;
+
+	info("converting YUV video on %i threads%s\n", num_convert_threads + 1, yuv2bgra_sse2 ? " using SSE2" : "");
+}
+
+// convert a queued frame to BGRA, the convert threads each take a slice and
+// the last one is done here
+void convert_frame(struct decoded_frame *frame, char *dest)
+{
+	uint slices = num_convert_threads + 1;
+	uint rows = (movie_height / slices) & ~1;
+	uint i;
+
+	for(i = 0; i < 3; i++)
+	{
+		convert_job.planes[i] = frame->planes[i];
+		convert_job.strides[i] = frame->strides[i];
+	}
+
+	convert_job.dest = dest;
+	convert_job.dest_stride = movie_width * 4;
+	convert_job.width = movie_width;
+	convert_job.height = movie_height;
+	convert_job.full_range = codec_ctx->color_range == AVCOL_RANGE_JPEG;
+
+	for(i = 0; i < slices; i++) convert_rows[i] = i * rows;
+	convert_rows[slices] = movie_height;
+
+	for(i = 0; i < num_convert_threads; i++) SetEvent(convert_start[i]);
+
+	yuv2bgra_rows(&convert_job, convert_rows[num_convert_threads], movie_height);
+
+	if(num_convert_threads) WaitForMultipleObjects(num_convert_threads, convert_done, TRUE, INFINITE);
+}
+
+// fill in what av_find_stream_info would find from the stream info cache
+bool load_stream_info(char *name)
+{
+	struct stream_info cached;
+	uint i;
+
+	if(!stream_cache_lookup(name, &cached) || cached.num_streams != format_ctx->nb_streams) return false;
+
+	for(i = 0; i < cached.num_streams; i++)
+	{
+		AVCodecContext *c = format_ctx->streams[i]->codec;
+
+		if(c->codec_type != cached.streams[i].codec_type || c->codec_id != cached.streams[i].codec_id) return false;
+	}
+
+	for(i = 0; i < cached.num_streams; i++)
+	{
+		AVCodecContext *c = format_ctx->streams[i]->codec;
+		struct cached_stream *s = &cached.streams[i];
+
+		c->width = s->width;
+		c->height = s->height;
+		c->pix_fmt = s->pix_fmt;
+		c->time_base.num = s->time_base_num;
+		c->time_base.den = s->time_base_den;
+		c->ticks_per_frame = s->ticks_per_frame;
+		c->sample_rate = s->sample_rate;
+		c->channels = s->channels;
+		c->sample_fmt = s->sample_fmt;
+		c->bit_rate = s->bit_rate;
+		c->color_range = s->color_range;
+	}
+
+	format_ctx->duration = (int64_t)cached.duration;
+
+	return true;
+}
+
+void save_stream_info(char *name)
+{
+	struct stream_info info;
+	uint i;
+
+	if(format_ctx->nb_streams > STREAM_CACHE_MAX_STREAMS) return;
+
+	memset(&info, 0, sizeof(info));
+
+	for(i = 0; i < format_ctx->nb_streams; i++)
+	{
+		AVCodecContext *c = format_ctx->streams[i]->codec;
+		struct cached_stream *s = &info.streams[i];
+
+		s->codec_type = c->codec_type;
+		s->codec_id = c->codec_id;
+		s->width = c->width;
+		s->height = c->height;
+		s->pix_fmt = c->pix_fmt;
+		s->time_base_num = c->time_base.num;
+		s->time_base_den = c->time_base.den;
+		s->ticks_per_frame = c->ticks_per_frame;
+		s->sample_rate = c->sample_rate;
+		s->channels = c->channels;
+		s->sample_fmt = c->sample_fmt;
+		s->bit_rate = c->bit_rate;
+		s->color_range = c->color_range;
+	}
+
+	info.num_streams = format_ctx->nb_streams;
+	info.duration = (double)format_ctx->duration;
+
+	stream_cache_store(name, &info);
+}
+
+// open a movie and start decoding it, everything but creating textures, which
+// is left to finish_prepare so this can run on the prepare thread
+void open_movie(char *name)
 {
 	uint i;
 	WAVEFORMATEX sound_format;
-	DSBUFFERDESC1 sbdesc;
 	uint ret;
 
+	movie_frames = 0;
+	frame_uploaded = false;
+
 	if(ret = av_open_input_file(&format_ctx, name, NULL, 0, NULL))
 	{
 		error("couldn't open movie file: %s\n", name);
-		release_movie_objects();
+		release_decoder_objects();
 		goto exit;
 	}
 
-	if(av_find_stream_info(format_ctx) < 0)
+	// probing can take a while on large files, skip it if we've seen this one
+	// before
+	if(load_stream_info(name)) trace("using cached stream info for %s\n", name);
+	else
 	{
-		error("couldn't find stream info\n");
-		release_movie_objects();
-		goto exit;
+		if(av_find_stream_info(format_ctx) < 0)
+		{
+			error("couldn't find stream info\n");
+			release_decoder_objects();
+			goto exit;
+		}
+
+		save_stream_info(name);
 	}
 
 	videostream = -1;
@@ -176,7 +988,7 @@ __declspec(dllexport) uint prepare_movie(char *name)
 	if(videostream == -1)
 	{
 		error("no video stream found\n");
-		release_movie_objects();
+		release_decoder_objects();
 		goto exit;
 	}
 
@@ -189,14 +1001,14 @@ __declspec(dllexport) uint prepare_movie(char *name)
 	{
 		error("no video codec found\n");
 		codec_ctx = 0;
-		release_movie_objects();
+		release_decoder_objects();
 		goto exit;
 	}
 
 	if(avcodec_open(codec_ctx, codec) < 0)
 	{
 		error("couldn't open video codec\n");
-		release_movie_objects();
+		release_decoder_objects();
 		goto exit;
 	}
 
@@ -207,14 +1019,14 @@ __declspec(dllexport) uint prepare_movie(char *name)
 		if(!acodec)
 		{
 			error("no audio codec found\n");
-			release_movie_objects();
+			release_decoder_objects();
 			goto exit;
 		}
 
 		if(avcodec_open(acodec_ctx, acodec) < 0)
 		{
 			error("couldn't open audio codec\n");
-			release_movie_objects();
+			release_decoder_objects();
 			goto exit;
 		}
 	}
@@ -232,7 +1044,7 @@ __declspec(dllexport) uint prepare_movie(char *name)
 	if(movie_width > max_texture_size || movie_height > max_texture_size)
 	{
 		error("movie dimensions exceed max texture size, skipping\n");
-		release_movie_objects();
+		release_decoder_objects();
 		goto exit;
 	}
 
@@ -243,10 +1055,14 @@ __declspec(dllexport) uint prepare_movie(char *name)
 	if(codec_ctx->pix_fmt == PIX_FMT_YUV420P && yuv_fast_path) use_bgra_texture = false;
 	else use_bgra_texture = true;
 
-	vbuffer_read = 0;
+	cpu_convert = codec_ctx->pix_fmt == PIX_FMT_YUV420P && !yuv_fast_path;
+
+	if(cpu_convert) start_convert_threads();
+
 	vbuffer_write = 0;
+	vbuffer_current = 0;
 
-	if(codec_ctx->pix_fmt != PIX_FMT_BGRA && codec_ctx->pix_fmt != PIX_FMT_BGR24 && (codec_ctx->pix_fmt != PIX_FMT_YUV420P || !yuv_fast_path))
+	if(codec_ctx->pix_fmt != PIX_FMT_BGRA && codec_ctx->pix_fmt != PIX_FMT_BGR24 && codec_ctx->pix_fmt != PIX_FMT_YUV420P)
 	{
 		sws_ctx = sws_getContext(movie_width, movie_height, codec_ctx->pix_fmt, movie_width, movie_height, PIX_FMT_BGR24, SWS_FAST_BILINEAR | SWS_ACCURATE_RND, NULL, NULL, NULL);
 		info("slow output format from video codec %s; %i\n", codec->name, codec_ctx->pix_fmt);
@@ -265,27 +1081,77 @@ __declspec(dllexport) uint prepare_movie(char *name)
 		sound_format.nAvgBytesPerSec = sound_format.nSamplesPerSec * sound_format.nBlockAlign;
 		sound_format.wFormatTag = WAVE_FORMAT_PCM;
 
-		sound_buffer_size = sound_format.nAvgBytesPerSec * AUDIO_BUFFER_SIZE;
-
-		sbdesc.dwSize = sizeof(sbdesc);
-		sbdesc.lpwfxFormat = &sound_format;
-		sbdesc.dwFlags = 0;
-		sbdesc.dwReserved = 0;
-		sbdesc.dwBufferBytes = sound_buffer_size;
+		audio_sink = dsound_sink(&audio_ring, &sound_format);
 
-		if(ret = IDirectSound_CreateSoundBuffer(*directsound, (LPCDSBUFFERDESC)&sbdesc, &sound_buffer, 0))
+		if(audio_sink && !audio_ring_init(&audio_ring, sound_format.nAvgBytesPerSec * AUDIO_RING_SIZE))
 		{
-			error("couldn't create sound buffer (%i, %i, %i, %i)\n", acodec_ctx->sample_fmt, acodec_ctx->bit_rate, acodec_ctx->sample_rate, acodec_ctx->channels);
-			sound_buffer = 0;
+			error("couldn't allocate audio ring\n");
+			audio_sink->release(audio_sink);
+			audio_sink = 0;
 		}
 
-		first_audio_packet = true;
-		write_pointer = 0;
+		audio_clock_valid = false;
 	}
 
+	start_decoder();
+
 exit:
 	movie_frame_counter = 0;
 	skipped_frames = 0;
+}
+
+// get rid of the last movie if it was never released
+void discard_movie()
+{
+	finish_prepare();
+
+	if(format_ctx) release_movie_objects();
+}
+
+unsigned __stdcall prepare_main(void *parameter)
+{
+	open_movie(prepare_name);
+
+	return 0;
+}
+
+// start preparing a movie in the background, the next call into the plugin
+// waits for it to finish
+__declspec(dllexport) void prepare_movie_async(char *name)
+{
+	discard_movie();
+
+	strncpy(prepare_name, name, sizeof(prepare_name) - 1);
+
+	prepare_thread = (HANDLE)_beginthreadex(0, 0, prepare_main, 0, 0, 0);
+
+	if(!prepare_thread)
+	{
+		error("couldn't start movie preparation thread\n");
+
+		open_movie(name);
+
+		if(decoder_thread) create_movie_textures();
+	}
+}
+
+// prepare a movie for playback, picks up where prepare_movie_async left off if
+// it was called for the same movie, even if something else has already waited
+// for it to finish
+__declspec(dllexport) uint prepare_movie(char *name)
+{
+	finish_prepare();
+
+	// not played yet, nothing to rewind
+	if(format_ctx && !movie_started && !strcmp(name, prepare_name)) return movie_frames;
+
+	discard_movie();
+
+	strncpy(prepare_name, name, sizeof(prepare_name) - 1);
+
+	open_movie(prepare_name);
+
+	if(decoder_thread) create_movie_textures();
 
 	return movie_frames;
 }
@@ -293,33 +1159,92 @@ exit:
 // stop movie playback, no video updates will be requested after this so all we have to do is stop the audio
 __declspec(dllexport) void stop_movie()
 {
-	if(sound_buffer && *directsound) IDirectSoundBuffer_Stop(sound_buffer);
+	finish_prepare();
+
+	if(audio_sink) audio_sink->stop(audio_sink);
 }
 
-void buffer_bgra_frame(char *data, int upload_stride)
+// copy or convert a decoded frame into the next upload buffer, returns the
+// address the frame's first plane should be uploaded from, which is an offset
+// into the bound pixel buffer or a pointer to the frame if there is none
+char *begin_upload(struct decoded_frame *frame)
 {
-	uint upload_width = codec_ctx->pix_fmt == PIX_FMT_BGRA ? upload_stride / 4 : upload_stride / 3;
+	struct video_frame *v = &video_buffer[vbuffer_write];
+	void *dest = 0;
 
-	if(upload_stride < 0) return;
+	if(v->pbo)
+	{
+		// the last upload from this buffer has to be done before it's
+		// overwritten, without fences the old storage is orphaned instead
+		if(v->fence)
+		{
+			if(glClientWaitSync(v->fence, GL_SYNC_FLUSH_COMMANDS_BIT, UPLOAD_FENCE_TIMEOUT) == GL_TIMEOUT_EXPIRED) glitch("timed out waiting for movie upload buffer\n");
 
-	if(video_buffer[vbuffer_write].bgra_texture) glDeleteTextures(1, &video_buffer[vbuffer_write].bgra_texture);
+			glDeleteSync(v->fence);
+			v->fence = 0;
+		}
 
-	glGenTextures(1, &video_buffer[vbuffer_write].bgra_texture);
-	glBindTexture(GL_TEXTURE_2D, video_buffer[vbuffer_write].bgra_texture);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, v->pbo);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+		if(!use_fences) glBufferData(GL_PIXEL_UNPACK_BUFFER, upload_size, 0, GL_STREAM_DRAW);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, movie_width, movie_height, 0, GL_BGR, GL_UNSIGNED_BYTE, 0);
+		dest = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH, upload_width);
+		if(!dest) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
 
-	if(codec_ctx->pix_fmt == PIX_FMT_BGRA) glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, movie_width, movie_height, GL_BGRA, GL_UNSIGNED_BYTE, data);
-	else glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, movie_width, movie_height, GL_BGR, GL_UNSIGNED_BYTE, data);
+	if(dest)
+	{
+		if(cpu_convert) convert_frame(frame, dest);
+		// planes are stored back to back
+		else memcpy(dest, frame->planes[0], decode_frame_size);
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		return 0;
+	}
+
+	if(cpu_convert)
+	{
+		convert_frame(frame, convert_buffer);
+		return convert_buffer;
+	}
+
+	return frame->planes[0];
+}
+
+void end_upload()
+{
+	struct video_frame *v = &video_buffer[vbuffer_write];
 
+	if(v->pbo)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		if(use_fences) v->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	vbuffer_current = vbuffer_write;
 	vbuffer_write = (vbuffer_write + 1) % VIDEO_BUFFER_SIZE;
+	frame_uploaded = true;
+}
+
+void buffer_bgra_frame(struct decoded_frame *frame)
+{
+	uint bytespp = cpu_convert || codec_ctx->pix_fmt == PIX_FMT_BGRA ? 4 : 3;
+	char *data = begin_upload(frame);
+
+	glBindTexture(GL_TEXTURE_2D, video_buffer[vbuffer_write].bgra_texture);
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, cpu_convert ? movie_width : frame->strides[0] / bytespp);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, movie_width, movie_height, bytespp == 4 ? GL_BGRA : GL_BGR, GL_UNSIGNED_BYTE, data);
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	end_upload();
 }
 
 void draw_bgra_frame(uint buffer_index)
@@ -327,42 +1252,34 @@ void draw_bgra_frame(uint buffer_index)
 	draw_movie_quad_bgra(video_buffer[buffer_index].bgra_texture, movie_width, movie_height);
 }
 
-void upload_yuv_texture(char **planes, uint *strides, uint num, uint buffer_index)
+void upload_yuv_texture(struct decoded_frame *frame, char *data, uint num)
 {
-	uint upload_width = strides[num];
 	uint tex_width = num == 0 ? movie_width : movie_width / 2;
 	uint tex_height = num == 0 ? movie_height : movie_height / 2;
 
 	glActiveTexture(GL_TEXTURE0 + num);
 
-	glBindTexture(GL_TEXTURE_2D, video_buffer[buffer_index].yuv_textures[num]);
+	glBindTexture(GL_TEXTURE_2D, video_buffer[vbuffer_write].yuv_textures[num]);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, frame->strides[num]);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex_width, tex_height, GL_LUMINANCE, GL_UNSIGNED_BYTE, data + (frame->planes[num] - frame->planes[0]));
+}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, tex_width, tex_height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, 0);
+void buffer_yuv_frame(struct decoded_frame *frame)
+{
+	char *data = begin_upload(frame);
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH, upload_width);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex_width, tex_height, GL_LUMINANCE, GL_UNSIGNED_BYTE, planes[num]);
+	upload_yuv_texture(frame, data, 2);
+	upload_yuv_texture(frame, data, 1);
+	upload_yuv_texture(frame, data, 0);
 
 	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-}
-
-void buffer_yuv_frame(char **planes, uint *strides)
-{
-	if(video_buffer[vbuffer_write].yuv_textures[0]) glDeleteTextures(3, video_buffer[vbuffer_write].yuv_textures);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-	glGenTextures(3, video_buffer[vbuffer_write].yuv_textures);
-	
-	upload_yuv_texture(planes, strides, 2, vbuffer_write);
-	upload_yuv_texture(planes, strides, 1, vbuffer_write);
-	upload_yuv_texture(planes, strides, 0, vbuffer_write);
-
-	vbuffer_write = (vbuffer_write + 1) % VIDEO_BUFFER_SIZE;
+	end_upload();
 }
 
 void draw_yuv_frame(uint buffer_index, bool full_range)
@@ -377,157 +1294,116 @@ void draw_yuv_frame(uint buffer_index, bool full_range)
 	draw_movie_quad_yuv(video_buffer[buffer_index].yuv_textures, movie_width, movie_height, full_range);
 }
 
-// display the next frame
-__declspec(dllexport) bool update_movie_sample()
+void draw_frame(uint buffer_index)
 {
-	AVPacket packet;
-	bool frame_finished;
-	int ret;
-	time_t now;
-
-	// no playable movie loaded, skip it
-	if(!format_ctx) return false;
+	if(use_bgra_texture) draw_bgra_frame(buffer_index);
+	else draw_yuv_frame(buffer_index, codec_ctx->color_range == AVCOL_RANGE_JPEG);
+}
 
-	// keep track of when we started playing this movie
-	if(movie_frame_counter == 0) QueryPerformanceCounter((LARGE_INTEGER *)&start_time);
+// schedule video by the audio clock, while there is no audio or the sound
+// device ran dry the video clock keeps running on its own
+void sync_to_audio()
+{
+	time_t now;
+	double correction;
 
-	while((ret = av_read_frame(format_ctx, &packet)) >= 0)
-	{
-		if(packet.stream_index == videostream)
-		{
-			avcodec_decode_video2(codec_ctx, movie_frame, &frame_finished, &packet);
+	feed_audio();
 
-			if(frame_finished)
-			{
-				QueryPerformanceCounter((LARGE_INTEGER *)&now);
+	if(!audio_sink || !audio_clock_valid) return;
 
-				// check if we are falling behind
-				if(skip_frames && movie_fps < 100.0 && LAG > 100.0) skipping_frames = true;
+	QueryPerformanceCounter((LARGE_INTEGER *)&now);
 
-				if(skipping_frames && LAG > 0.0)
-				{
-					skipped_frames++;
-					if(((skipped_frames - 1) & skipped_frames) == 0) glitch("video playback is lagging behind, skipping frames (frame #: %i, skipped: %i, lag: %f)\n", movie_frame_counter, skipped_frames, LAG);
-					av_free_packet(&packet);
-					if(use_bgra_texture) draw_bgra_frame(vbuffer_read);
-					else draw_yuv_frame(vbuffer_read, codec_ctx->color_range == AVCOL_RANGE_JPEG);
-					break;
-				}
-				else skipping_frames = false;
+	correction = audio_sync_correction((double)(now - start_time) / (double)timer_freq, audio_sink->clock(audio_sink));
 
-				if(movie_sync_debug) info("video: DTS %f PTS %f (timebase %f) placed in video buffer at real time %f (play %f)\n", (double)packet.dts, (double)packet.pts, av_q2d(codec_ctx->time_base), (double)(now - start_time) / (double)timer_freq, (double)movie_frame_counter / (double)movie_fps);
-				
-				if(sws_ctx)
-				{
-					char *planes[3] = {0, 0, 0};
-					int strides[3] = {0, 0, 0};
-					char *data = calloc(movie_width * movie_height, 3);
+	if(movie_sync_debug) info("sync: video clock %f audio clock %f correction %f\n", (double)(now - start_time) / (double)timer_freq, audio_sink->clock(audio_sink), correction);
 
-					planes[0] = data;
-					strides[0] = movie_width * 3;
+	set_start_time(start_time + (time_t)(correction * (double)timer_freq));
+}
 
-					sws_scale(sws_ctx, movie_frame->data, movie_frame->linesize, 0, movie_height, planes, strides);
+// display the next frame, decoding is done ahead of time on the decoder thread
+// so all we do here is upload and draw
+__declspec(dllexport) bool update_movie_sample()
+{
+	time_t now;
 
-					buffer_bgra_frame(data, movie_width * 3);
+	finish_prepare();
 
-					free(data);
-				}
-				else if(use_bgra_texture) buffer_bgra_frame(movie_frame->data[0], movie_frame->linesize[0]);
-				else buffer_yuv_frame(movie_frame->data, movie_frame->linesize);
+	// no playable movie loaded, skip it
+	if(!format_ctx || !decoder_thread) return false;
 
-				av_free_packet(&packet);
+	// keep track of when we started playing this movie, from here on the
+	// decoder drops frames that are already late
+	if(!movie_started)
+	{
+		if(audio_sink)
+		{
+			if(movie_sync_debug) info("audio start\n");
 
-				if(vbuffer_write == vbuffer_read)
-				{
-					if(use_bgra_texture) draw_bgra_frame(vbuffer_read);
-					else draw_yuv_frame(vbuffer_read, codec_ctx->color_range == AVCOL_RANGE_JPEG);
+			// start with whatever has been decoded so far in the sound buffer
+			feed_audio();
+			audio_sink->start(audio_sink);
+		}
 
-					vbuffer_read = (vbuffer_read + 1) % VIDEO_BUFFER_SIZE;
+		QueryPerformanceCounter((LARGE_INTEGER *)&now);
+		set_start_time(now);
+		movie_started = true;
+	}
+	else sync_to_audio();
 
-					break;
-				}
-			}
-		}
+	while(true)
+	{
+		// check this before looking at the queue, the decoder queues its last
+		// frame before flagging the end of the movie
+		bool eof = decoder_eof;
 
-		if(packet.stream_index == audiostream)
+		if(queue_read != queue_write)
 		{
-			char buffer_storage[(AVCODEC_MAX_AUDIO_FRAME_SIZE * 3) / 2];
-			char *buffer = (char *)(((((uint)buffer_storage) + 15) / 16) * 16);
-			uint size = AVCODEC_MAX_AUDIO_FRAME_SIZE;
-			int used_bytes;
-			char *packet_data = packet.data;
-			uint packet_size = packet.size;
-			uint playcursor;
-			uint writecursor;
-			uint bytespersec = (acodec_ctx->sample_fmt == SAMPLE_FMT_U8 ? 1 : 2) * acodec_ctx->channels * acodec_ctx->sample_rate;
-
-			QueryPerformanceCounter((LARGE_INTEGER *)&now);
-
-			if(movie_sync_debug)
+			struct decoded_frame *frame = &decode_queue[queue_read % DECODE_QUEUE_SIZE];
+
+			// too late for this one
+			if(frame->index < movie_frame_counter)
 			{
-				IDirectSoundBuffer_GetCurrentPosition(sound_buffer, &playcursor, &writecursor);
-				info("audio: DTS %f PTS %f (timebase %f) placed in sound buffer at real time %f (play %f write %f)\n", (double)packet.dts, (double)packet.pts, av_q2d(acodec_ctx->time_base), (double)(now - start_time) / (double)timer_freq, (double)playcursor / (double)bytespersec, (double)write_pointer / (double)bytespersec);
+				queue_read++;
+				SetEvent(wake_event);
+				continue;
 			}
 
-			while((used_bytes = avcodec_decode_audio2(acodec_ctx, (int16_t *)buffer, &size, packet_data, packet_size)) > 0)
+			if(frame->index == movie_frame_counter)
 			{
-				char *ptr1;
-				char *ptr2;
-				uint bytes1;
-				uint bytes2;
-
-				if(sound_buffer && size)
-				{
-					if(IDirectSoundBuffer_Lock(sound_buffer, write_pointer, size, &ptr1, &bytes1, &ptr2, &bytes2, 0)) error("couldn't lock sound buffer\n");
+				if(use_bgra_texture) buffer_bgra_frame(frame);
+				else buffer_yuv_frame(frame);
 
-					memcpy(ptr1, buffer, bytes1);
-					memcpy(ptr2, &buffer[bytes1], bytes2);
-
-					if(IDirectSoundBuffer_Unlock(sound_buffer, ptr1, bytes1, ptr2, bytes2)) error("couldn't unlock sound buffer\n");
+				queue_read++;
+				SetEvent(wake_event);
+			}
 
-					write_pointer = (write_pointer + bytes1 + bytes2) % sound_buffer_size;
+			// if the decoder skipped this frame, show the last one again
+			if(frame_uploaded) draw_frame(vbuffer_current);
 
-					packet_data += used_bytes;
-					packet_size -= used_bytes;
-					size = sizeof(buffer);
-				}
-			}
+			break;
 		}
 
-		av_free_packet(&packet);
-	}
+		// could not read any more frames, end movie
+		if(eof) return false;
 
-	if(sound_buffer && first_audio_packet)
-	{
-		if(movie_sync_debug) info("audio start\n");
-
-		// reset start time so video syncs up properly
-		QueryPerformanceCounter((LARGE_INTEGER *)&start_time);
-		if(IDirectSoundBuffer_Play(sound_buffer, 0, 0, DSBPLAY_LOOPING)) error("couldn't play sound buffer\n");
-		first_audio_packet = false;
+		// the decoder may be waiting for room in the audio ring
+		WaitForSingleObject(frame_event, AUDIO_WAIT_MS);
+		feed_audio();
 	}
 
 	movie_frame_counter++;
 
-	// could not read any more frames, exhaust video buffer then end movie
-	if(ret < 0)
+	// wait for the next frame, sleep through most of it
+	QueryPerformanceCounter((LARGE_INTEGER *)&now);
+
+	while(LAG(movie_frame_counter, start_time) < 0.0)
 	{
-		if(vbuffer_write != vbuffer_read)
-		{
-			if(use_bgra_texture) draw_bgra_frame(vbuffer_read);
-			else draw_yuv_frame(vbuffer_read, codec_ctx->color_range == AVCOL_RANGE_JPEG);
+		double lag = LAG(movie_frame_counter, start_time);
 
-			vbuffer_read = (vbuffer_read + 1) % VIDEO_BUFFER_SIZE;
-		}
-		
-		if(vbuffer_write == vbuffer_read) return false;
-	}
+		if(lag < -spin_ms) sleep_ms(-lag - spin_ms);
 
-	// wait for the next frame
-	do
-	{
 		QueryPerformanceCounter((LARGE_INTEGER *)&now);
-	} while(LAG < 0.0);
+	}
 
 	// keep going
 	return true;
@@ -536,19 +1412,33 @@ __declspec(dllexport) bool update_movie_sample()
 // draw the current frame, don't update anything
 __declspec(dllexport) void draw_current_frame()
 {
-	if(use_bgra_texture) draw_bgra_frame((vbuffer_read - 1) % VIDEO_BUFFER_SIZE);
-	else draw_yuv_frame((vbuffer_read - 1) % VIDEO_BUFFER_SIZE, codec_ctx->color_range == AVCOL_RANGE_JPEG);
+	finish_prepare();
+
+	if(!format_ctx || !frame_uploaded) return;
+
+	draw_frame(vbuffer_current);
 }
 
 // loop back to the beginning of the movie
 __declspec(dllexport) void loop()
 {
-	if(format_ctx) avformat_seek_file(format_ctx, -1, 0, 0, 0, 0);
+	finish_prepare();
+
+	// the decoder thread owns the format context
+	if(!format_ctx || !decoder_thread) return;
+
+	// clear the end of movie flag right away so the next update waits for
+	// frames instead of ending the movie again
+	decoder_seek = true;
+	decoder_eof = false;
+	SetEvent(wake_event);
 }
 
 // get the current frame number
 __declspec(dllexport) uint get_movie_frame()
 {
+	finish_prepare();
+
 	if(movie_fps != 15.0 && movie_fps < 100.0) return (uint)ceil(movie_frame_counter * 15.0 / movie_fps);
 	else return movie_frame_counter;
 }
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "stream_cache.h"
+
+// one index per movie directory, rewritten whole when anything is added
+#define STREAM_CACHE_FILE "stream_info.cache"
+#define STREAM_CACHE_VERSION 1
+
+// the oldest entry is dropped to make room beyond this
+#define STREAM_CACHE_ENTRIES 256
+
+struct stream_cache_header
+{
+	char magic[4];
+	uint version;
+	// catches a different layout from another build
+	uint record_size;
+	uint entries;
+};
+
+// path of the index for this movie and the movie's name without directory,
+// false if either doesn't fit
+static bool cache_path(char *movie, char *path, uint size, char **name)
+{
+	char *slash = strrchr(movie, '/');
+	char *backslash = strrchr(movie, '\\');
+	uint dir_length;
+
+	if(backslash > slash) slash = backslash;
+
+	*name = slash ? slash + 1 : movie;
+	dir_length = *name - movie;
+
+	if(strlen(*name) >= sizeof(((struct stream_info *)0)->name)) return false;
+	if(dir_length + sizeof(STREAM_CACHE_FILE) > size) return false;
+
+	memcpy(path, movie, dir_length);
+	strcpy(&path[dir_length], STREAM_CACHE_FILE);
+
+	return true;
+}
+
+// read the whole index, returns the number of entries
+static uint read_index(char *path, struct stream_info *entries)
+{
+	struct stream_cache_header header;
+	FILE *f = fopen(path, "rb");
+	uint num = 0;
+
+	if(!f) return 0;
+
+	if(fread(&header, sizeof(header), 1, f) == 1 && !memcmp(header.magic, "MSIC", 4) && header.version == STREAM_CACHE_VERSION && header.record_size == sizeof(struct stream_info))
+	{
+		if(header.entries > STREAM_CACHE_ENTRIES) header.entries = STREAM_CACHE_ENTRIES;
+
+		num = fread(entries, sizeof(struct stream_info), header.entries, f);
+	}
+
+	fclose(f);
+
+	return num;
+}
+
+bool stream_cache_lookup(char *movie, struct stream_info *info)
+{
+	struct stream_info *entries;
+	struct stat s;
+	char path[1024];
+	char *name;
+	uint num, i;
+	bool found = false;
+
+	if(!cache_path(movie, path, sizeof(path), &name)) return false;
+	if(stat(movie, &s)) return false;
+
+	entries = malloc(STREAM_CACHE_ENTRIES * sizeof(*entries));
+	num = read_index(path, entries);
+
+	for(i = 0; i < num; i++)
+	{
+		if(!strcmp(entries[i].name, name) && entries[i].size == (uint)s.st_size && entries[i].mtime == (uint)s.st_mtime && entries[i].num_streams <= STREAM_CACHE_MAX_STREAMS)
+		{
+			memcpy(info, &entries[i], sizeof(*info));
+			found = true;
+			break;
+		}
+	}
+
+	free(entries);
+
+	return found;
+}
+
+void stream_cache_store(char *movie, struct stream_info *info)
+{
+	struct stream_cache_header header;
+	struct stream_info *entries;
+	struct stat s;
+	char path[1024];
+	char *name;
+	uint num, i;
+	FILE *f;
+
+	if(info->num_streams > STREAM_CACHE_MAX_STREAMS) return;
+	if(!cache_path(movie, path, sizeof(path), &name)) return;
+	if(stat(movie, &s)) return;
+
+	memset(info->name, 0, sizeof(info->name));
+	strcpy(info->name, name);
+	info->size = s.st_size;
+	info->mtime = s.st_mtime;
+
+	entries = malloc(STREAM_CACHE_ENTRIES * sizeof(*entries));
+	num = read_index(path, entries);
+
+	// replace an outdated entry for the same movie or add a new one
+	for(i = 0; i < num; i++)
+	{
+		if(!strcmp(entries[i].name, name)) break;
+	}
+
+	if(i == STREAM_CACHE_ENTRIES)
+	{
+		memmove(entries, &entries[1], (STREAM_CACHE_ENTRIES - 1) * sizeof(*entries));
+		i = STREAM_CACHE_ENTRIES - 1;
+	}
+
+	memcpy(&entries[i], info, sizeof(*info));
+	if(i == num) num++;
+
+	// the movie directory may well be read only
+	f = fopen(path, "wb");
+
+	if(f)
+	{
+		memcpy(header.magic, "MSIC", 4);
+		header.version = STREAM_CACHE_VERSION;
+		header.record_size = sizeof(struct stream_info);
+		header.entries = num;
+
+		fwrite(&header, sizeof(header), 1, f);
+		fwrite(entries, sizeof(*entries), num, f);
+		fclose(f);
+	}
+
+	free(entries);
+}
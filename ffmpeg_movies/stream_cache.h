@@ -0,0 +1,44 @@
+#ifndef _STREAM_CACHE_H_
+#define _STREAM_CACHE_H_
+
+#include "types.h"
+
+// movies with more streams than this are always probed
+#define STREAM_CACHE_MAX_STREAMS 4
+
+// codec parameters that are otherwise only known after probing the stream
+struct cached_stream
+{
+	int codec_type;
+	int codec_id;
+	int width;
+	int height;
+	int pix_fmt;
+	int time_base_num;
+	int time_base_den;
+	int ticks_per_frame;
+	int sample_rate;
+	int channels;
+	int sample_fmt;
+	int bit_rate;
+	int color_range;
+};
+
+struct stream_info
+{
+	// file name without directory, size and modification time of the movie
+	char name[64];
+	uint size;
+	uint mtime;
+	// in AV_TIME_BASE units
+	double duration;
+	uint num_streams;
+	struct cached_stream streams[STREAM_CACHE_MAX_STREAMS];
+};
+
+// both look for the index next to the movie, nothing is found if the movie
+// has changed since it was stored
+bool stream_cache_lookup(char *movie, struct stream_info *info);
+void stream_cache_store(char *movie, struct stream_info *info);
+
+#endif
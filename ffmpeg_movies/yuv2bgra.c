@@ -0,0 +1,149 @@
+#include "yuv2bgra.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define YUV2BGRA_SSE2
+#include <emmintrin.h>
+#endif
+
+// BT.601 coefficients in 10.6 fixed point, the SSE2 and plain C versions use
+// the exact same arithmetic so their output is identical
+struct yuv_coefficients
+{
+	short y_offset;
+	short y;
+	short v_r;
+	short u_g;
+	short v_g;
+	short u_b;
+};
+
+static struct yuv_coefficients limited_range = {16, 75, 102, -25, -52, 129};
+static struct yuv_coefficients full_range = {0, 64, 90, -22, -46, 113};
+
+bool yuv2bgra_sse2 = false;
+
+static unsigned char clamp(int x)
+{
+	if(x < 0) return 0;
+	if(x > 255) return 255;
+	return x;
+}
+
+// 16-bit saturating add, matches _mm_adds_epi16
+static int adds(int a, int b)
+{
+	int x = a + b;
+
+	if(x > 32767) return 32767;
+	if(x < -32768) return -32768;
+	return x;
+}
+
+static void convert_pixels(struct yuv_coefficients *c, unsigned char *y, unsigned char *u, unsigned char *v, unsigned char *dest, uint first, uint last)
+{
+	uint x;
+
+	for(x = first; x < last; x++)
+	{
+		int cu = u[x / 2] - 128;
+		int cv = v[x / 2] - 128;
+		int luma = adds((y[x] - c->y_offset) * c->y, 32);
+
+		dest[x * 4 + 0] = clamp(adds(luma, cu * c->u_b) >> 6);
+		dest[x * 4 + 1] = clamp(adds(luma, adds(cu * c->u_g, cv * c->v_g)) >> 6);
+		dest[x * 4 + 2] = clamp(adds(luma, cv * c->v_r) >> 6);
+		dest[x * 4 + 3] = 255;
+	}
+}
+
+#ifdef YUV2BGRA_SSE2
+
+// 8 pixels worth of one color channel, luma plus chroma, scaled back down
+#define CHANNEL(luma, chroma) _mm_srai_epi16(_mm_adds_epi16(luma, chroma), 6)
+
+// 16 pixels of one row, chroma contributions are already doubled up to one
+// value per pixel
+static void convert_row_sse2(struct yuv_coefficients *c, __m128i y, __m128i r_lo, __m128i r_hi, __m128i g_lo, __m128i g_hi, __m128i b_lo, __m128i b_hi, unsigned char *dest)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i alpha = _mm_set1_epi8((char)255);
+	__m128i y_offset = _mm_set1_epi16(c->y_offset);
+	__m128i y_coeff = _mm_set1_epi16(c->y);
+	__m128i round = _mm_set1_epi16(32);
+	__m128i y_lo = _mm_adds_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(y, zero), y_offset), y_coeff), round);
+	__m128i y_hi = _mm_adds_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(y, zero), y_offset), y_coeff), round);
+	__m128i r = _mm_packus_epi16(CHANNEL(y_lo, r_lo), CHANNEL(y_hi, r_hi));
+	__m128i g = _mm_packus_epi16(CHANNEL(y_lo, g_lo), CHANNEL(y_hi, g_hi));
+	__m128i b = _mm_packus_epi16(CHANNEL(y_lo, b_lo), CHANNEL(y_hi, b_hi));
+	__m128i bg_lo = _mm_unpacklo_epi8(b, g);
+	__m128i bg_hi = _mm_unpackhi_epi8(b, g);
+	__m128i ra_lo = _mm_unpacklo_epi8(r, alpha);
+	__m128i ra_hi = _mm_unpackhi_epi8(r, alpha);
+
+	_mm_storeu_si128((__m128i *)&dest[0], _mm_unpacklo_epi16(bg_lo, ra_lo));
+	_mm_storeu_si128((__m128i *)&dest[16], _mm_unpackhi_epi16(bg_lo, ra_lo));
+	_mm_storeu_si128((__m128i *)&dest[32], _mm_unpacklo_epi16(bg_hi, ra_hi));
+	_mm_storeu_si128((__m128i *)&dest[48], _mm_unpackhi_epi16(bg_hi, ra_hi));
+}
+
+// convert a pair of rows sharing the same chroma row, 16 pixels at a time,
+// returns the number of pixels done
+static uint convert_rows_sse2(struct yuv_coefficients *c, unsigned char *y0, unsigned char *y1, unsigned char *u, unsigned char *v, unsigned char *dest0, unsigned char *dest1, uint width)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i bias = _mm_set1_epi16(128);
+	__m128i v_r = _mm_set1_epi16(c->v_r);
+	__m128i u_g = _mm_set1_epi16(c->u_g);
+	__m128i v_g = _mm_set1_epi16(c->v_g);
+	__m128i u_b = _mm_set1_epi16(c->u_b);
+	uint x;
+
+	for(x = 0; x + 16 <= width; x += 16)
+	{
+		__m128i cu = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)&u[x / 2]), zero), bias);
+		__m128i cv = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *)&v[x / 2]), zero), bias);
+		__m128i r = _mm_mullo_epi16(cv, v_r);
+		__m128i g = _mm_adds_epi16(_mm_mullo_epi16(cu, u_g), _mm_mullo_epi16(cv, v_g));
+		__m128i b = _mm_mullo_epi16(cu, u_b);
+		__m128i r_lo = _mm_unpacklo_epi16(r, r);
+		__m128i r_hi = _mm_unpackhi_epi16(r, r);
+		__m128i g_lo = _mm_unpacklo_epi16(g, g);
+		__m128i g_hi = _mm_unpackhi_epi16(g, g);
+		__m128i b_lo = _mm_unpacklo_epi16(b, b);
+		__m128i b_hi = _mm_unpackhi_epi16(b, b);
+
+		convert_row_sse2(c, _mm_loadu_si128((__m128i *)&y0[x]), r_lo, r_hi, g_lo, g_hi, b_lo, b_hi, &dest0[x * 4]);
+		if(y1) convert_row_sse2(c, _mm_loadu_si128((__m128i *)&y1[x]), r_lo, r_hi, g_lo, g_hi, b_lo, b_hi, &dest1[x * 4]);
+	}
+
+	return x;
+}
+
+#endif
+
+void yuv2bgra_rows(struct yuv2bgra_job *job, uint first, uint last)
+{
+	struct yuv_coefficients *c = job->full_range ? &full_range : &limited_range;
+	uint row;
+
+	if(last > job->height) last = job->height;
+
+	for(row = first; row < last; row += 2)
+	{
+		unsigned char *y0 = &job->planes[0][row * job->strides[0]];
+		// odd height, the last row has no partner
+		unsigned char *y1 = row + 1 < last ? y0 + job->strides[0] : 0;
+		unsigned char *u = &job->planes[1][(row / 2) * job->strides[1]];
+		unsigned char *v = &job->planes[2][(row / 2) * job->strides[2]];
+		unsigned char *dest0 = &job->dest[row * job->dest_stride];
+		unsigned char *dest1 = dest0 + job->dest_stride;
+		uint done = 0;
+
+#ifdef YUV2BGRA_SSE2
+		if(yuv2bgra_sse2) done = convert_rows_sse2(c, y0, y1, u, v, dest0, dest1, job->width);
+#endif
+
+		convert_pixels(c, y0, u, v, dest0, done, job->width);
+		if(y1) convert_pixels(c, y1, u, v, dest1, done, job->width);
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef _YUV2BGRA_H_
+#define _YUV2BGRA_H_
+
+#include "types.h"
+
+// a YUV420P frame to be converted to BGRA, the destination is typically a
+// mapped pixel buffer so it is only ever written to, front to back
+struct yuv2bgra_job
+{
+	unsigned char *planes[3];
+	uint strides[3];
+	unsigned char *dest;
+	uint dest_stride;
+	uint width;
+	uint height;
+	// full range (JPEG) instead of limited range (MPEG) input
+	bool full_range;
+};
+
+// use SSE2, set by the caller if the CPU supports it
+extern bool yuv2bgra_sse2;
+
+// convert rows first to last - 1 of the frame, first has to be even so a
+// slice never shares a chroma row with another one
+void yuv2bgra_rows(struct yuv2bgra_job *job, uint first, uint last);
+
+#endif
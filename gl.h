@@ -62,17 +62,179 @@ struct driver_state
 
 struct deferred_draw
 {
+	uint vertextype;
+	bool clip;
+	bool mipmap;
+	struct driver_state state;
+	bool discarded;
+	// drawn to the transparency targets in submission order, the call keeps
+	// its own copy of the geometry instead of adding to the sorted triangles
+	bool oit;
+	struct nvertex *vertices;
+	uint vertexcount;
+	word *indices;
+	uint count;
+};
+
+// commands recorded by the game thread, see gl/cmdbuf.c
+#define CMD_DRAW 0
+#define CMD_CLEAR 1
+#define CMD_COPY_FRAMEBUFFER 2
+#define CMD_DELETE_TEXTURES 3
+#define CMD_FLIP 4
+
+// the parts of driver_state needed to replay a draw, kept free of pointers so
+// command streams can be written to disk as-is
+struct cmd_state
+{
+	uint texture_handle;
+	uint blend_mode;
+	bool fb_texture;
+	bool wireframe;
+	bool texture_filter;
+	bool cullface;
+	bool nocull;
+	bool depthtest;
+	bool depthmask;
+	bool shademode;
+	bool alphatest;
+	uint alphafunc;
+	uint alpharef;
+	struct matrix world_matrix;
+	struct matrix d3dprojection_matrix;
+};
+
+struct cmd_draw
+{
+	struct cmd_state state;
+	struct matrix viewport_matrix;
+	int scissor[4];
+	GLuint program;
+	GLuint yuv_textures[2];
 	GLenum primitivetype;
 	uint vertextype;
 	uint vertexcount;
 	uint count;
-	struct nvertex *vertices;
-	word *indices;
+	// offsets into the frame data buffer
+	uint vertices;
+	uint indices;
 	bool clip;
-	bool mipmap;
-	struct driver_state state;
-	double z;
-	bool drawn;
+	bool modulate_alpha;
+	bool full_range;
+};
+
+struct cmd_clear
+{
+	GLbitfield mask;
+	float color[4];
+};
+
+struct cmd_copy_framebuffer
+{
+	GLuint texture;
+	int x;
+	int y;
+	int w;
+	int h;
+};
+
+struct cmd_delete_textures
+{
+	uint count;
+	uint textures;
+};
+
+struct gl_cmd
+{
+	uint type;
+
+	union
+	{
+		struct cmd_draw draw;
+		struct cmd_clear clear;
+		struct cmd_copy_framebuffer copy;
+		struct cmd_delete_textures del;
+	} u;
+};
+
+struct cmd_frame
+{
+	struct gl_cmd *cmds;
+	uint num_cmds;
+	uint max_cmds;
+	unsigned char *data;
+	uint data_size;
+	uint data_max;
+	GLsync fence;
+};
+
+// counters kept by the executor, cleared by whoever reads them
+struct execute_stats
+{
+	uint draw_calls;
+	uint state_changes;
+};
+
+// capture file layout, a header followed by records of the types below
+#define CAPTURE_MAGIC 0x50414346
+#define CAPTURE_VERSION 2
+
+#define CAPTURE_SHADER 0
+#define CAPTURE_TEXTURE 1
+#define CAPTURE_FRAME 2
+
+#define PROGRAM_MAIN 0
+#define PROGRAM_POST 1
+#define PROGRAM_YUV 2
+
+struct capture_header
+{
+	uint magic;
+	uint version;
+	uint width;
+	uint height;
+	uint internal_size_x;
+	uint internal_size_y;
+	uint output_size_x;
+	uint output_size_y;
+	uint x_offset;
+	uint y_offset;
+	bool indirect_rendering;
+	bool fancy_transparency;
+};
+
+struct capture_record
+{
+	uint type;
+	uint size;
+};
+
+// followed by vertex_size + fragment_size bytes of nul-terminated source
+struct capture_shader
+{
+	GLuint program;
+	uint kind;
+	uint vertex_size;
+	uint fragment_size;
+};
+
+// followed by width * height BGRA pixels
+struct capture_texture
+{
+	GLuint texture;
+	uint width;
+	uint height;
+};
+
+// followed by num_cmds commands and data_size bytes of frame data, the
+// remaining fields are driver stats for the frame when it was captured
+struct capture_frame
+{
+	uint num_cmds;
+	uint data_size;
+	uint deferred;
+	uint vertex_count;
+	uint texture_reloads;
 };
 
 struct gl_texture_set
@@ -86,12 +248,17 @@ extern struct matrix d3dviewport_matrix;
 
 extern struct driver_state current_state;
 
+extern struct execute_stats execute_stats;
+
 extern GLuint current_program;
 
 extern uint max_texture_size;
 
+extern uint oit_program;
+
 void gl_draw_movie_quad_bgra(GLuint, int, int);
 void gl_draw_movie_quad_yuv(GLuint *, int, int, bool);
+char *read_source(const char *file);
 GLuint gl_create_program(char *vertex_file, char *fragment_file, char *name);
 void gl_use_post_program();
 void gl_use_main_program();
@@ -101,12 +268,15 @@ void gl_load_state(struct driver_state *src);
 bool gl_defer_draw(GLenum primitivetype, uint vertextype, struct nvertex *vertices, uint vertexcount, word *indices, uint count, bool clip, bool mipmap);
 void gl_draw_deferred();
 void gl_check_deferred(struct texture_set *texture_set);
+uint gl_depth_sort_key(float z);
+void gl_radix_sort(uint *keys, uint *order, uint *scratch, uint count);
 bool gl_special_case(GLenum primitivetype, uint vertextype, struct nvertex *vertices, uint vertexcount, word *indices, uint count, struct graphics_object *graphics_object, bool clip, bool mipmap);
 void gl_draw_with_lighting(struct indexed_primitive *ip, bool clip, struct matrix *model_matrix);
 void gl_draw_indexed_primitive(GLenum, uint, struct nvertex *, uint, word *, uint, struct graphics_object *, bool clip, bool mipmap);
 void gl_set_world_matrix(struct matrix *matrix);
 void gl_set_d3dprojection_matrix(struct matrix *matrix);
 void gl_set_blend_func(uint);
+bool gl_apply_blend_func(uint);
 void gl_check_texture_dimensions(uint width, uint height, char *source);
 GLuint gl_create_empty_texture();
 GLuint gl_create_texture(void *data, uint width, uint height, uint format, uint internalformat, uint size, bool generate_mipmaps);
@@ -115,15 +285,36 @@ void *gl_get_pixel_buffer(uint size);
 GLuint gl_commit_pixel_buffer(void *data, uint width, uint height, uint format, bool generate_mipmaps);
 GLuint gl_compress_pixel_buffer(void *data, uint width, uint height, uint format);
 GLuint gl_commit_compressed_buffer(void *data, uint width, uint height, uint format, uint size);
+void gl_delete_textures(uint count, GLuint *textures);
 void gl_replace_texture(struct texture_set *texture_set, uint palette_index, uint new_texture);
 void gl_upload_texture(struct texture_set *texture_set, uint palette_index, void *image_data, uint format);
 void gl_bind_texture_set(struct texture_set *);
 void gl_set_texture(GLuint);
 bool gl_init_indirect();
 bool gl_init_postprocessing();
+bool gl_init_oit();
+bool gl_init_oit_targets();
+void gl_begin_oit();
+void gl_end_oit();
+void gl_composite_oit();
 void gl_prepare_flip();
 void gl_prepare_render();
+void gl_init_render_state();
 bool gl_load_shaders();
 bool gl_draw_text(uint x, uint y, uint color, uint alpha, char *fmt, ...);
+bool gl_is_recording();
+void gl_record_draw(GLenum primitivetype, uint vertextype, struct nvertex *vertices, uint vertexcount, word *indices, uint count, bool clip);
+void gl_record_yuv(GLuint *yuv_textures, bool full_range);
+void gl_record_clear(GLbitfield mask, float *color);
+void gl_record_copy_framebuffer(GLuint texture, int x, int y, int w, int h);
+void gl_record_delete_textures(uint count, GLuint *textures);
+void gl_submit_frame();
+void gl_start_render_thread();
+void gl_stop_render_thread();
+void gl_start_capture();
+void gl_stop_capture();
+void gl_capture_poll();
+bool gl_execute_frame(struct cmd_frame *frame);
+void gl_swap_buffers();
 
 #endif
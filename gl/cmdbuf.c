@@ -0,0 +1,590 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * gl/cmdbuf.c - render thread and the per-frame command stream feeding it
+ *
+ * With the render_thread option enabled the window's OpenGL context is owned
+ * by a dedicated thread. The game thread keeps running the driver as usual
+ * but anything that touches the framebuffer (draws, clears, framebuffer
+ * copies, buffer swaps) is recorded into a linear per-frame buffer instead.
+ * Textures are still created on the game thread in a second context sharing
+ * objects with the window context.
+ *
+ * Two frame buffers are used, the game thread records the next frame while
+ * the render thread executes the previous one.
+ *
+ * The same stream is used to capture frames to disk (see capture_file). While
+ * capturing without a render thread, frames are recorded and then executed
+ * on the game thread at flip time. Textures are read back the first time a
+ * captured frame uses them, so the replayer needs nothing but the file.
+ */
+
+#include <windows.h>
+#include <process.h>
+#include <gl/glew.h>
+#include <gl/wglew.h>
+
+#include "../types.h"
+#include "../cfg.h"
+#include "../common.h"
+#include "../gl.h"
+#include "../globals.h"
+#include "../macro.h"
+#include "../log.h"
+
+extern HDC hDC;
+extern HGLRC hRC;
+
+extern uint main_program;
+extern uint post_program;
+extern uint yuv_program;
+
+extern uint current_program;
+
+#define INITIAL_CMDS 1024
+#define INITIAL_DATA (1024 * 1024)
+
+struct cmd_frame frames[2];
+uint record_frame;
+struct cmd_frame *pending_frame;
+
+HGLRC resource_context;
+HANDLE render_thread_handle;
+DWORD render_thread_id;
+HANDLE submit_event;
+HANDLE idle_event;
+bool render_thread_quit;
+
+// extra inputs for the next recorded draw, set by the movie player
+GLuint next_yuv_textures[2];
+bool next_full_range;
+
+FILE *capture;
+uint capture_frames_left;
+bool capture_key;
+bool capture_programs[3];
+// textures whose contents are already in the capture, indexed by name
+unsigned char *capture_textures;
+uint capture_textures_max;
+
+// true if GL work on the calling thread has to go through the command stream
+bool gl_is_recording()
+{
+	if(render_thread_id) return GetCurrentThreadId() != render_thread_id;
+
+	return capture != 0;
+}
+
+struct gl_cmd *cmdbuf_alloc_cmd(uint type)
+{
+	struct cmd_frame *frame = &frames[record_frame];
+	struct gl_cmd *cmd;
+
+	if(frame->num_cmds == frame->max_cmds)
+	{
+		frame->max_cmds = frame->max_cmds ? frame->max_cmds * 2 : INITIAL_CMDS;
+		frame->cmds = driver_realloc(frame->cmds, sizeof(*frame->cmds) * frame->max_cmds);
+	}
+
+	cmd = &frame->cmds[frame->num_cmds++];
+	cmd->type = type;
+
+	return cmd;
+}
+
+// allocate from the linear data buffer, returns an offset since the buffer may
+// move when it grows
+uint cmdbuf_alloc_data(void *src, uint size)
+{
+	struct cmd_frame *frame = &frames[record_frame];
+	uint ret = frame->data_size;
+
+	if(ret + size > frame->data_max)
+	{
+		if(!frame->data_max) frame->data_max = INITIAL_DATA;
+		while(ret + size > frame->data_max) frame->data_max *= 2;
+		frame->data = driver_realloc(frame->data, frame->data_max);
+	}
+
+	memcpy(&frame->data[ret], src, size);
+
+	// keep everything 16-byte aligned
+	frame->data_size = (ret + size + 15) & ~15;
+
+	return ret;
+}
+
+// copy the parts of the current driver state needed to replay a draw
+void cmdbuf_save_state(struct cmd_state *dest)
+{
+	dest->texture_handle = current_state.texture_handle;
+	dest->blend_mode = current_state.blend_mode;
+	dest->fb_texture = current_state.fb_texture;
+	dest->wireframe = current_state.wireframe;
+	dest->texture_filter = current_state.texture_filter;
+	dest->cullface = current_state.cullface;
+	dest->nocull = current_state.nocull;
+	dest->depthtest = current_state.depthtest;
+	dest->depthmask = current_state.depthmask;
+	dest->shademode = current_state.shademode;
+	dest->alphatest = current_state.alphatest;
+	dest->alphafunc = current_state.alphafunc;
+	dest->alpharef = current_state.alpharef;
+	memcpy(&dest->world_matrix, &current_state.world_matrix, sizeof(dest->world_matrix));
+	memcpy(&dest->d3dprojection_matrix, &current_state.d3dprojection_matrix, sizeof(dest->d3dprojection_matrix));
+}
+
+void gl_record_draw(GLenum primitivetype, uint vertextype, struct nvertex *vertices, uint vertexcount, word *indices, uint count, bool clip)
+{
+	struct gl_cmd *cmd = cmdbuf_alloc_cmd(CMD_DRAW);
+	struct cmd_draw *draw = &cmd->u.draw;
+
+	cmdbuf_save_state(&draw->state);
+	memcpy(&draw->viewport_matrix, &d3dviewport_matrix, sizeof(d3dviewport_matrix));
+	viewport_to_scissor(current_state.viewport, draw->scissor);
+
+	draw->program = current_program;
+	draw->primitivetype = primitivetype;
+	draw->vertextype = vertextype;
+	draw->vertexcount = vertexcount;
+	draw->count = count;
+	draw->vertices = cmdbuf_alloc_data(vertices, sizeof(*vertices) * vertexcount);
+	draw->indices = cmdbuf_alloc_data(indices, sizeof(*indices) * count);
+	draw->clip = clip;
+	draw->modulate_alpha = !(ff8 && current_state.fb_texture);
+
+	draw->yuv_textures[0] = next_yuv_textures[0];
+	draw->yuv_textures[1] = next_yuv_textures[1];
+	draw->full_range = next_full_range;
+
+	next_yuv_textures[0] = 0;
+	next_yuv_textures[1] = 0;
+	next_full_range = false;
+}
+
+// the next draw is a YUV movie frame, chroma planes are bound to units 1 & 2
+void gl_record_yuv(GLuint *yuv_textures, bool full_range)
+{
+	next_yuv_textures[0] = yuv_textures[1];
+	next_yuv_textures[1] = yuv_textures[2];
+	next_full_range = full_range;
+}
+
+void gl_record_clear(GLbitfield mask, float *color)
+{
+	struct gl_cmd *cmd = cmdbuf_alloc_cmd(CMD_CLEAR);
+
+	cmd->u.clear.mask = mask;
+	memcpy(cmd->u.clear.color, color, sizeof(cmd->u.clear.color));
+}
+
+void gl_record_copy_framebuffer(GLuint texture, int x, int y, int w, int h)
+{
+	struct gl_cmd *cmd = cmdbuf_alloc_cmd(CMD_COPY_FRAMEBUFFER);
+
+	cmd->u.copy.texture = texture;
+	cmd->u.copy.x = x;
+	cmd->u.copy.y = y;
+	cmd->u.copy.w = w;
+	cmd->u.copy.h = h;
+}
+
+void gl_record_delete_textures(uint count, GLuint *textures)
+{
+	struct gl_cmd *cmd = cmdbuf_alloc_cmd(CMD_DELETE_TEXTURES);
+
+	cmd->u.del.count = count;
+	cmd->u.del.textures = cmdbuf_alloc_data(textures, sizeof(*textures) * count);
+}
+
+void capture_write_record(uint type, uint size)
+{
+	struct capture_record record;
+
+	record.type = type;
+	record.size = size;
+
+	fwrite(&record, sizeof(record), 1, capture);
+}
+
+// flag for a texture name, tells if its contents are in the capture
+unsigned char *capture_known(GLuint texture)
+{
+	if(texture >= capture_textures_max)
+	{
+		uint new_max = max(texture + 1, capture_textures_max * 2);
+
+		capture_textures = driver_realloc(capture_textures, new_max);
+		memset(&capture_textures[capture_textures_max], 0, new_max - capture_textures_max);
+		capture_textures_max = new_max;
+	}
+
+	return &capture_textures[texture];
+}
+
+// store shader sources so the replayer can build the same program
+void capture_program(GLuint program)
+{
+	struct capture_shader shader;
+	char *vertex_file = 0;
+	char *fragment_file = 0;
+	char *vs = 0;
+	char *fs = 0;
+
+	if(!program) return;
+
+	if(program == main_program)
+	{
+		shader.kind = PROGRAM_MAIN;
+		vertex_file = vert_source;
+		fragment_file = frag_source;
+	}
+	else if(program == post_program)
+	{
+		shader.kind = PROGRAM_POST;
+		fragment_file = post_source;
+	}
+	else if(program == yuv_program)
+	{
+		shader.kind = PROGRAM_YUV;
+		vertex_file = vert_source;
+		fragment_file = yuv_source;
+	}
+	else return;
+
+	if(capture_programs[shader.kind]) return;
+
+	capture_programs[shader.kind] = true;
+
+	if(vertex_file) vs = read_source(vertex_file);
+	if(fragment_file) fs = read_source(fragment_file);
+
+	shader.program = program;
+	shader.vertex_size = vs ? strlen(vs) + 1 : 0;
+	shader.fragment_size = fs ? strlen(fs) + 1 : 0;
+
+	capture_write_record(CAPTURE_SHADER, sizeof(shader) + shader.vertex_size + shader.fragment_size);
+	fwrite(&shader, sizeof(shader), 1, capture);
+	if(vs) fwrite(vs, shader.vertex_size, 1, capture);
+	if(fs) fwrite(fs, shader.fragment_size, 1, capture);
+
+	driver_free(vs);
+	driver_free(fs);
+}
+
+// read back texture contents unless the capture already has them, movie
+// textures are updated in place and are always stored
+void capture_texture(GLuint texture, bool always)
+{
+	struct capture_texture header;
+	unsigned char *known;
+	GLint bound, w, h;
+	void *pixels;
+
+	if(!texture) return;
+
+	known = capture_known(texture);
+
+	if(*known && !always) return;
+
+	*known = true;
+
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+
+	header.texture = texture;
+	header.width = w;
+	header.height = h;
+
+	pixels = driver_malloc(w * h * 4);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+
+	glBindTexture(GL_TEXTURE_2D, bound);
+
+	capture_write_record(CAPTURE_TEXTURE, sizeof(header) + w * h * 4);
+	fwrite(&header, sizeof(header), 1, capture);
+	fwrite(pixels, w * h * 4, 1, capture);
+
+	driver_free(pixels);
+}
+
+// write a recorded frame preceded by any resources it needs
+void capture_frame(struct cmd_frame *frame)
+{
+	struct capture_frame header;
+	uint i, j;
+
+	for(i = 0; i < frame->num_cmds; i++)
+	{
+		struct gl_cmd *cmd = &frame->cmds[i];
+
+		switch(cmd->type)
+		{
+			case CMD_DRAW:
+				capture_program(cmd->u.draw.program);
+				capture_texture(cmd->u.draw.state.texture_handle, cmd->u.draw.yuv_textures[0] != 0);
+				capture_texture(cmd->u.draw.yuv_textures[0], true);
+				capture_texture(cmd->u.draw.yuv_textures[1], true);
+				break;
+
+			// rendered by the replayer itself
+			case CMD_COPY_FRAMEBUFFER:
+				*capture_known(cmd->u.copy.texture) = true;
+				break;
+
+			case CMD_DELETE_TEXTURES:
+				for(j = 0; j < cmd->u.del.count; j++) *capture_known(((GLuint *)&frame->data[cmd->u.del.textures])[j]) = false;
+				break;
+		}
+	}
+
+	header.num_cmds = frame->num_cmds;
+	header.data_size = frame->data_size;
+	header.deferred = stats.deferred;
+	header.vertex_count = stats.vertex_count;
+	header.texture_reloads = stats.texture_reloads;
+
+	capture_write_record(CAPTURE_FRAME, sizeof(header) + sizeof(*frame->cmds) * frame->num_cmds + frame->data_size);
+	fwrite(&header, sizeof(header), 1, capture);
+	fwrite(frame->cmds, sizeof(*frame->cmds), frame->num_cmds, capture);
+	fwrite(frame->data, 1, frame->data_size, capture);
+}
+
+void gl_start_capture()
+{
+	struct capture_header header;
+	char filename[BASEDIR_LENGTH + 1024];
+
+	_snprintf(filename, sizeof(filename), "%s/%s", basedir, capture_file);
+
+	capture = fopen(filename, "wb");
+
+	if(!capture)
+	{
+		error("couldn't open capture file %s: %s", filename, _strerror(NULL));
+		return;
+	}
+
+	header.magic = CAPTURE_MAGIC;
+	header.version = CAPTURE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.internal_size_x = internal_size_x;
+	header.internal_size_y = internal_size_y;
+	header.output_size_x = output_size_x;
+	header.output_size_y = output_size_y;
+	header.x_offset = x_offset;
+	header.y_offset = y_offset;
+	header.indirect_rendering = indirect_rendering;
+	header.fancy_transparency = fancy_transparency;
+
+	fwrite(&header, sizeof(header), 1, capture);
+
+	if(capture_textures) memset(capture_textures, 0, capture_textures_max);
+	memset(capture_programs, 0, sizeof(capture_programs));
+
+	capture_frames_left = max(capture_frames, 1);
+
+	// used by the flip, never referenced by a draw
+	capture_program(post_program);
+
+	info("Capturing %i frame(s) to %s\n", capture_frames_left, filename);
+}
+
+void gl_stop_capture()
+{
+	struct driver_state state;
+
+	if(!capture) return;
+
+	fclose(capture);
+	capture = 0;
+
+	info("Capture finished\n");
+
+	if(render_thread_id) return;
+
+	// the game thread is driving the window context directly again, bring it
+	// up to date with what the executor left behind
+	gl_use_main_program();
+	gl_save_state(&state);
+	gl_load_state(&state);
+}
+
+// start a capture when the configured frame comes up or on Ctrl+F12
+void gl_capture_poll()
+{
+	bool key;
+
+	if(!*capture_file) return;
+
+	key = (GetAsyncKeyState(VK_CONTROL) & 0x8000) && (GetAsyncKeyState(VK_F12) & 0x8000);
+
+	if(!capture && ((capture_start && frame_counter == capture_start) || (key && !capture_key))) gl_start_capture();
+
+	capture_key = key;
+}
+
+// hand the recorded frame over to the render thread, or execute it right away
+// when capturing without one, and start a new frame
+void gl_submit_frame()
+{
+	struct cmd_frame *frame = &frames[record_frame];
+
+	cmdbuf_alloc_cmd(CMD_FLIP);
+
+	if(capture) capture_frame(frame);
+
+	if(render_thread_id)
+	{
+		// textures uploaded on this thread must be complete before the render
+		// thread samples from them
+		if(GLEW_ARB_sync)
+		{
+			frame->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+		}
+		else glFinish();
+
+		WaitForSingleObject(idle_event, INFINITE);
+
+		pending_frame = frame;
+
+		SetEvent(submit_event);
+
+		record_frame ^= 1;
+	}
+	else if(!gl_execute_frame(frame)) unexpected("unknown render command\n");
+
+	frames[record_frame].num_cmds = 0;
+	frames[record_frame].data_size = 0;
+	frames[record_frame].fence = 0;
+
+	if(capture && !--capture_frames_left) gl_stop_capture();
+}
+
+// platform side of the flip command
+void gl_swap_buffers()
+{
+#ifndef SINGLE_STEP
+	if(!SwapBuffers(hDC))
+	{
+		error("SwapBuffers failed: ");
+		windows_error(0);
+	}
+#endif
+}
+
+unsigned __stdcall render_thread_main(void *parameter)
+{
+	PROFILE_THREAD("render");
+
+	if(!wglMakeCurrent(hDC, hRC))
+	{
+		error("render thread could not take over the OpenGL context: ");
+		windows_error(0);
+	}
+
+	gl_init_render_state();
+
+	SetEvent(idle_event);
+
+	while(true)
+	{
+		WaitForSingleObject(submit_event, INFINITE);
+
+		if(render_thread_quit) break;
+
+		PROFILE_BEGIN("gl_execute_frame");
+		if(!gl_execute_frame(pending_frame)) unexpected("unknown render command\n");
+		PROFILE_END();
+
+		SetEvent(idle_event);
+	}
+
+	wglMakeCurrent(0, 0);
+
+	return 0;
+}
+
+// move the window context to a new render thread, this thread continues with
+// a second context sharing textures and buffers with the first one
+void gl_start_render_thread()
+{
+	if(WGLEW_ARB_create_context) resource_context = wglCreateContextAttribsARB(hDC, hRC, 0);
+	else
+	{
+		resource_context = wglCreateContext(hDC);
+
+		if(resource_context && !wglShareLists(hRC, resource_context))
+		{
+			wglDeleteContext(resource_context);
+			resource_context = 0;
+		}
+	}
+
+	if(!resource_context)
+	{
+		error("could not create shared OpenGL context, render thread disabled\n");
+		return;
+	}
+
+	submit_event = CreateEvent(0, false, false, 0);
+	idle_event = CreateEvent(0, false, false, 0);
+
+	wglMakeCurrent(hDC, resource_context);
+
+	render_thread_handle = (HANDLE)_beginthreadex(0, 0, render_thread_main, 0, 0, (unsigned *)&render_thread_id);
+
+	if(!render_thread_handle)
+	{
+		error("could not start render thread\n");
+		wglMakeCurrent(hDC, hRC);
+		wglDeleteContext(resource_context);
+		resource_context = 0;
+		return;
+	}
+
+	info("Rendering on a separate thread\n");
+}
+
+// wait for any outstanding work and hand the window context back to the
+// calling thread
+void gl_stop_render_thread()
+{
+	if(!render_thread_handle) return;
+
+	WaitForSingleObject(idle_event, INFINITE);
+
+	render_thread_quit = true;
+	SetEvent(submit_event);
+
+	WaitForSingleObject(render_thread_handle, INFINITE);
+	CloseHandle(render_thread_handle);
+
+	render_thread_handle = 0;
+	render_thread_id = 0;
+
+	wglMakeCurrent(hDC, hRC);
+	wglDeleteContext(resource_context);
+	resource_context = 0;
+}
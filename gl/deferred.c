@@ -18,30 +18,118 @@
 
 /*
  * gl/deferred.c - implements triangle re-ordering to achieve correct blending
+ *
+ * Deferred calls store their render state once and their triangles in a
+ * frame-wide list, each triangle with a depth key. At flip time the list is
+ * radix sorted once, far to near, and consecutive triangles sharing the same
+ * state are drawn with a single call.
+ *
+ * Alpha blended calls in the modes listed in oit_modes are not sorted, they
+ * are queued in submission order and drawn to the transparency targets of
+ * gl/oit.c at flip time, after all opaque geometry, right before compositing.
  */
 
+#include <ctype.h>
+
 #include "../types.h"
+#include "../cfg.h"
 #include "../gl.h"
 #include "../macro.h"
 #include "../log.h"
 
 bool nodefer = false;
 
-#define DEFERRED_MAX 1024
+// deferred calls are stored in fixed size chunks that are kept between frames
+#define DEFERRED_CHUNK 256
+
+// indices are 16-bit, longer runs are split
+#define RUN_MAX_TRIS (65535 / 3)
 
-struct deferred_draw *deferred_draws;
+struct deferred_draw **deferred_chunks;
+uint num_chunks;
 uint num_deferred;
 
+// all deferred triangles in submission order, three vertices each
+// the sort needs these to be contiguous while they grow during the frame so
+// they are kept between frames rather than coming from the frame arena
+struct nvertex *tri_vertices;
+uint *tri_keys;
+uint *tri_draw;
+uint *tri_order;
+uint *tri_scratch;
+uint num_tris;
+uint max_tris;
+
+// game mode oit_active last looked at and whether it is listed in oit_modes
+struct game_mode *oit_last_mode;
+bool oit_mode_listed;
+
+bool oit_name_char(char c)
+{
+	return isalnum(c) || c == '_';
+}
+
+// use weighted blended transparency instead of sorting in this game mode
+bool oit_active()
+{
+	struct game_mode *mode = getmode_cached();
+
+	if(!oit_program || gl_is_recording()) return false;
+
+	if(mode != oit_last_mode)
+	{
+		uint len = strlen(mode->name);
+		char *name = strstr(oit_modes, mode->name);
+
+		// whole names only, MODE_BATTLE should not match MODE_BATTLE_MENU
+		while(name && ((name > oit_modes && oit_name_char(name[-1])) || oit_name_char(name[len]))) name = strstr(name + 1, mode->name);
+
+		oit_mode_listed = name != 0;
+		oit_last_mode = mode;
+	}
+
+	return oit_mode_listed;
+}
+
+struct deferred_draw *deferred_get(uint index)
+{
+	return &deferred_chunks[index / DEFERRED_CHUNK][index % DEFERRED_CHUNK];
+}
+
+// next free deferred call entry
+struct deferred_draw *deferred_alloc()
+{
+	if(num_deferred == num_chunks * DEFERRED_CHUNK)
+	{
+		deferred_chunks = driver_realloc(deferred_chunks, sizeof(*deferred_chunks) * (num_chunks + 1));
+		deferred_chunks[num_chunks++] = driver_malloc(sizeof(**deferred_chunks) * DEFERRED_CHUNK);
+	}
+
+	return deferred_get(num_deferred++);
+}
+
+void deferred_reserve(uint tris)
+{
+	if(num_tris + tris <= max_tris) return;
+
+	if(!max_tris) max_tris = 1024;
+	while(num_tris + tris > max_tris) max_tris *= 2;
+
+	tri_vertices = driver_realloc(tri_vertices, sizeof(*tri_vertices) * 3 * max_tris);
+	tri_keys = driver_realloc(tri_keys, sizeof(*tri_keys) * max_tris);
+	tri_draw = driver_realloc(tri_draw, sizeof(*tri_draw) * max_tris);
+	tri_order = driver_realloc(tri_order, sizeof(*tri_order) * max_tris);
+	tri_scratch = driver_realloc(tri_scratch, sizeof(*tri_scratch) * max_tris);
+}
+
 // re-order and save a draw call for later processing
 bool gl_defer_draw(GLenum primitivetype, uint vertextype, struct nvertex *vertices, uint vertexcount, word *indices, uint count, bool clip, bool mipmap)
 {
 	uint tri;
+	uint i;
 	uint mode = getmode_cached()->driver_mode;
-	bool *tri_deferred;
-	float *tri_z;
-	uint defer_index = 0;
-
-	if(!deferred_draws) deferred_draws = driver_calloc(sizeof(*deferred_draws), DEFERRED_MAX);
+	struct deferred_draw *draw;
+	float *depth;
 
 	// global disable
 	if(nodefer) return false;
@@ -86,161 +174,221 @@ bool gl_defer_draw(GLenum primitivetype, uint vertextype, struct nvertex *vertic
 	// quads are used for some GUI elements, we do not need to re-order these
 	if(primitivetype != GL_TRIANGLES) return false;
 
-	if(num_deferred + count / 3 > DEFERRED_MAX)
+	PROFILE_BEGIN("gl_defer_draw");
+
+	draw = deferred_alloc();
+	draw->vertextype = vertextype;
+	draw->clip = clip;
+	draw->mipmap = mipmap;
+	draw->discarded = false;
+	gl_save_state(&draw->state);
+
+	// alpha blended calls skip the sort in modes using weighted blended
+	// transparency, fancy_transparency calls are drawn opaque by
+	// gl_special_case and other blending modes are still sorted
+	draw->oit = current_state.blend_mode == BLEND_AVG && oit_active();
+
+	if(draw->oit)
 	{
-		glitch("deferred draw queue overflow\n");
-		return false;
+		draw->vertices = frame_alloc(sizeof(*vertices) * vertexcount);
+		memcpy(draw->vertices, vertices, sizeof(*vertices) * vertexcount);
+		draw->vertexcount = vertexcount;
+		draw->indices = frame_alloc(sizeof(*indices) * count);
+		memcpy(draw->indices, indices, sizeof(*indices) * count);
+		draw->count = count;
+
+		PROFILE_END();
+
+		return true;
 	}
 
-	tri_deferred = driver_calloc(sizeof(*tri_deferred), count / 3);
-	tri_z = driver_calloc(sizeof(*tri_z), count / 3);
+	deferred_reserve(count / 3);
 
-	// calculate screen space average Z coordinate for each triangle
-	for(tri = 0; tri < count / 3; tri++)
+	// screen space depth of every vertex, computed once even if the vertex is
+	// shared by several triangles
+	depth = frame_alloc(sizeof(*depth) * vertexcount);
+
+	if(vertextype == TLVERTEX)
 	{
-		uint i;
+		for(i = 0; i < vertexcount; i++) depth[i] = vertices[i]._.z;
+	}
+	else
+	{
+		MATRIX_ALIGN struct matrix world_proj;
+		MATRIX_ALIGN struct matrix transform;
+		float *x = frame_alloc(sizeof(*x) * vertexcount);
+		float *y = frame_alloc(sizeof(*y) * vertexcount);
+		float *z = frame_alloc(sizeof(*z) * vertexcount);
 
-		for(i = 0; i < 3; i++)
+		// world, projection and viewport concatenated into a single transform
+		multiply_matrix(&current_state.world_matrix, &current_state.d3dprojection_matrix, &world_proj);
+		multiply_matrix(&world_proj, &d3dviewport_matrix, &transform);
+
+		for(i = 0; i < vertexcount; i++)
 		{
-			if(vertextype == TLVERTEX) tri_z[tri] += vertices[indices[tri * 3 + i]]._.z;
-			else
-			{
-				struct point4d world;
-				struct point4d proj;
-				struct point4d view;
-				transform_point_w(&current_state.world_matrix, &vertices[indices[tri * 3 + i]]._, &world);
-				transform_point4d(&current_state.d3dprojection_matrix, &world, &proj);
-				transform_point4d(&d3dviewport_matrix, &proj, &view);
-				tri_z[tri] += view.z / view.w;
-			}
+			x[i] = vertices[i]._.x;
+			y[i] = vertices[i]._.y;
+			z[i] = vertices[i]._.z;
 		}
 
-		tri_z[tri] /= 3.0f;
+		transform_depths(&transform, x, y, z, depth, vertexcount);
 	}
 
-	// arrange triangles into layers based on Z coordinates calculated above
-	// each layer will be drawn separately
-	while(defer_index < count / 3)
+	// key each triangle on its screen space average Z coordinate
+	for(tri = 0; tri < count / 3; tri++)
 	{
-		float z = tri_z[defer_index];
-		uint tri_num = 0;
-		uint defer = num_deferred;
-		uint vert_index = 0;
-
-		for(tri = 0; tri < count / 3; tri++) if(tri_z[tri] == z) tri_num++;
-
-		deferred_draws[defer].count = tri_num * 3;
-		deferred_draws[defer].clip = clip;
-		deferred_draws[defer].mipmap = mipmap;
-		deferred_draws[defer].primitivetype = primitivetype;
-		deferred_draws[defer].vertextype = vertextype;
-		deferred_draws[defer].vertexcount = tri_num * 3;
-		deferred_draws[defer].indices = driver_malloc(sizeof(*indices) * tri_num * 3);
-		deferred_draws[defer].vertices = driver_malloc(sizeof(*vertices) * tri_num * 3);
-		gl_save_state(&deferred_draws[defer].state);
-		deferred_draws[defer].drawn = false;
-		deferred_draws[defer].z = z;
-
-		for(tri = 0; tri < count / 3 && vert_index < tri_num * 3; tri++)
-		{
-			if(tri_z[tri] == z)
-			{
-				memcpy(&deferred_draws[defer].vertices[vert_index + 0], &vertices[indices[tri * 3 + 0]], sizeof(*vertices));
-				memcpy(&deferred_draws[defer].vertices[vert_index + 1], &vertices[indices[tri * 3 + 1]], sizeof(*vertices));
-				memcpy(&deferred_draws[defer].vertices[vert_index + 2], &vertices[indices[tri * 3 + 2]], sizeof(*vertices));
-				deferred_draws[defer].indices[vert_index + 0] = vert_index + 0;
-				deferred_draws[defer].indices[vert_index + 1] = vert_index + 1;
-				deferred_draws[defer].indices[vert_index + 2] = vert_index + 2;
-
-				vert_index += 3;
-
-				tri_deferred[tri] = true;
-			}
-		}
-
-		if(vert_index < tri_num * 3) error("deferred draw z mismatch\n");
+		struct nvertex *dest = &tri_vertices[num_tris * 3];
+		word *tri_indices = &indices[tri * 3];
 
-		num_deferred++;
+		for(i = 0; i < 3; i++) memcpy(&dest[i], &vertices[tri_indices[i]], sizeof(*dest));
 
-		while(defer_index < count / 3 && tri_deferred[defer_index]) defer_index++;
+		// the sort is stable so the call index is an implicit tiebreak,
+		// triangles at the same depth keep their submission order
+		tri_keys[num_tris] = gl_depth_sort_key((depth[tri_indices[0]] + depth[tri_indices[1]] + depth[tri_indices[2]]) / 3.0f);
+		tri_draw[num_tris] = num_deferred - 1;
+		num_tris++;
 	}
 
-	driver_free(tri_deferred);
-	driver_free(tri_z);
+	PROFILE_END();
 
 	return true;
 }
 
-// draw all the layers we've accumulated in the correct order and reset queue
+// number of draw calls needed to render the triangles in the given order
+uint deferred_count_runs(uint *order)
+{
+	uint runs = 0;
+	uint i;
+
+	for(i = 0; i < num_tris; i++) if(i == 0 || tri_draw[order[i]] != tri_draw[order[i - 1]]) runs++;
+
+	return runs;
+}
+
+// draw the queued transparency calls into the transparency targets
+void deferred_draw_oit()
+{
+	uint i;
+
+	for(i = 0; i < num_deferred; i++)
+	{
+		struct deferred_draw *draw = deferred_get(i);
+
+		if(!draw->oit || draw->discarded) continue;
+
+		gl_load_state(&draw->state);
+
+		gl_begin_oit();
+		gl_draw_indexed_primitive(GL_TRIANGLES, draw->vertextype, draw->vertices, draw->vertexcount, draw->indices, draw->count, 0, draw->clip, draw->mipmap);
+		gl_end_oit();
+
+		stats.deferred++;
+	}
+}
+
+// draw all the triangles we've accumulated in the correct order and reset
+// queue
 void gl_draw_deferred()
 {
 	struct driver_state saved_state;
+	struct nvertex *run_vertices;
+	word *run_indices;
+	uint max_run = min(num_tris, RUN_MAX_TRIS) * 3;
+	uint i = 0;
+
+	PROFILE_BEGIN("gl_draw_deferred");
 
-	if(num_deferred == 0) return;
+	if(num_deferred == 0)
+	{
+		PROFILE_END();
+		return;
+	}
 
 	gl_save_state(&saved_state);
 
 	nodefer = true;
 
-	stats.deferred += num_deferred;
+	// all opaque geometry is in place, the transparent layer goes below
+	// anything sorted
+	deferred_draw_oit();
+	gl_composite_oit();
+
+	if(num_tris > stats.deferred_peak) stats.deferred_peak = num_tris;
 
-	while(true)
+	gl_radix_sort(tri_keys, tri_order, tri_scratch, num_tris);
+
+	// past the soft cap, merge layers of similar depth by dropping low key
+	// bits until the draw count fits, merged triangles are drawn in submission
+	// order and in the worst case sorting is lost altogether
+	if(deferred_soft_cap && deferred_count_runs(tri_order) > deferred_soft_cap)
 	{
-		uint i;
-		double z = -1.0;
-		uint next = -1;
+		uint *keys = frame_alloc(sizeof(*keys) * num_tris);
+		uint shift = 0;
 
-		for(i = 0; i < num_deferred; i++)
+		do
 		{
-			if(deferred_draws[i].z > z && !deferred_draws[i].drawn)
-			{
-				next = i;
-				z = deferred_draws[i].z;
-			}
-		}
+			shift += 4;
+
+			for(i = 0; i < num_tris; i++) keys[i] = shift < 32 ? tri_keys[i] & (0xFFFFFFFF << shift) : 0;
+
+			gl_radix_sort(keys, tri_order, tri_scratch, num_tris);
+		} while(shift < 32 && deferred_count_runs(tri_order) > deferred_soft_cap);
+
+		stats.deferred_merged++;
+	}
+
+	// gathered vertices for the run being drawn
+	run_vertices = frame_alloc(sizeof(*run_vertices) * max_run);
+	run_indices = frame_alloc(sizeof(*run_indices) * max_run);
+
+	for(i = 0; i < max_run; i++) run_indices[i] = i;
 
-		if(next == -1) break;
+	i = 0;
 
-		gl_load_state(&deferred_draws[next].state);
+	while(i < num_tris)
+	{
+		uint index = tri_draw[tri_order[i]];
+		struct deferred_draw *draw = deferred_get(index);
+		uint start = i;
+		uint n, j;
+
+		while(i < num_tris && tri_draw[tri_order[i]] == index && i - start < RUN_MAX_TRIS) i++;
+
+		if(draw->discarded) continue;
+
+		n = i - start;
+
+		for(j = 0; j < n; j++) memcpy(&run_vertices[j * 3], &tri_vertices[tri_order[start + j] * 3], sizeof(*run_vertices) * 3);
+
+		gl_load_state(&draw->state);
 		internal_set_renderstate(V_DEPTHTEST, 1, 0);
 		internal_set_renderstate(V_DEPTHMASK, 1, 0);
 
-		gl_draw_indexed_primitive(deferred_draws[next].primitivetype, 
-								  deferred_draws[next].vertextype, 
-								  deferred_draws[next].vertices, 
-								  deferred_draws[next].vertexcount, 
-								  deferred_draws[next].indices, 
-								  deferred_draws[next].count, 
-								  0, 
-								  deferred_draws[next].clip, 
-								  deferred_draws[next].mipmap
-								  );
-
-		driver_free(deferred_draws[next].vertices);
-		driver_free(deferred_draws[next].indices);
-		deferred_draws[next].drawn = true;
+		gl_draw_indexed_primitive(GL_TRIANGLES, draw->vertextype, run_vertices, n * 3, run_indices, n * 3, 0, draw->clip, draw->mipmap);
+
+		stats.deferred++;
 	}
 
 	num_deferred = 0;
+	num_tris = 0;
 
 	nodefer = false;
 
 	gl_load_state(&saved_state);
+
+	PROFILE_END();
 }
 
 // a texture is being unloaded, invalidate any pending draw calls associated
-// with it and perform the necessary cleanup
+// with it
 void gl_check_deferred(struct texture_set *texture_set)
 {
 	uint i;
 
 	for(i = 0; i < num_deferred; i++)
 	{
-		if(deferred_draws[i].state.texture_set == texture_set)
-		{
-			driver_free(deferred_draws[i].vertices);
-			driver_free(deferred_draws[i].indices);
-			deferred_draws[i].drawn = true;
-		}
+		struct deferred_draw *draw = deferred_get(i);
+
+		if(draw->state.texture_set == texture_set) draw->discarded = true;
 	}
 }
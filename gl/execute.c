@@ -0,0 +1,451 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * gl/execute.c - executes recorded command streams
+ *
+ * Used by the render thread, the inline path taken while capturing and the
+ * standalone replayer. Keep this file free of Windows and game dependencies,
+ * everything it needs beyond OpenGL is declared below.
+ */
+
+#include <gl/glew.h>
+#include <string.h>
+
+#include "../types.h"
+#include "../cfg.h"
+#include "../gl.h"
+
+extern uint width;
+extern uint height;
+extern uint x_offset;
+extern uint y_offset;
+extern uint output_size_x;
+extern uint output_size_y;
+extern bool indirect_rendering;
+
+extern GLuint indirect_texture;
+extern GLuint indirect_fbo;
+
+extern uint main_program;
+extern uint post_program;
+extern uint yuv_program;
+
+// state last applied by the executor, used to skip redundant GL calls
+struct
+{
+	bool valid;
+	GLuint program;
+	GLuint texture;
+	uint blend_mode;
+	bool wireframe;
+	bool cullface;
+	bool nocull;
+	bool depthtest;
+	bool depthmask;
+	bool shademode;
+	bool alphatest;
+	uint alphafunc;
+	uint alpharef;
+	bool clip;
+	int scissor[4];
+	struct matrix world_matrix;
+} applied;
+
+struct execute_stats execute_stats;
+
+// OpenGL side of gl_set_blend_func, returns false for unknown blend modes
+bool gl_apply_blend_func(uint blend_mode)
+{
+	glBlendEquation(GL_FUNC_ADD);
+
+	switch(blend_mode)
+	{
+		case BLEND_AVG:
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			break;
+		case BLEND_ADD:
+			glBlendFunc(GL_ONE, GL_ONE);
+			break;
+		case BLEND_SUB:
+			glBlendFunc(GL_ONE, GL_ONE);
+			glBlendEquation(GL_FUNC_REVERSE_SUBTRACT);
+			break;
+		case BLEND_25P:
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+			break;
+		case BLEND_NONE:
+			if(fancy_transparency) glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			else glBlendFunc(GL_ONE, GL_ZERO);
+			break;
+
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+// prepare for game rendering
+void gl_prepare_render()
+{
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, indirect_fbo);
+
+	glViewport(0, 0, internal_size_x, internal_size_y);
+}
+
+// default render state for the context doing the actual rendering
+void gl_init_render_state()
+{
+	glEnableClientState(GL_COLOR_ARRAY);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	glDepthFunc(GL_LEQUAL);
+	glFrontFace(GL_CW);
+	glEnable(GL_BLEND);
+	glEnable(GL_TEXTURE_2D);
+
+	glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
+
+	if(use_mipmaps) glHint(GL_GENERATE_MIPMAP_HINT, GL_NICEST);
+
+#ifdef SINGLE_STEP
+	glDrawBuffer(GL_FRONT);
+#endif
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0.0, (double)width, (double)height, 0.0, 1.0, -1.0);
+
+	if(indirect_rendering) gl_prepare_render();
+	else glViewport(x_offset, y_offset, output_size_x, output_size_y);
+}
+
+void apply_program(GLuint program)
+{
+	if(applied.valid && applied.program == program) return;
+
+	glUseProgram(program);
+	execute_stats.state_changes++;
+
+	if(program == main_program) glUniform1i(glGetUniformLocation(program, "tex"), 0);
+	else if(program == yuv_program)
+	{
+		glUniform1i(glGetUniformLocation(program, "y_tex"), 0);
+		glUniform1i(glGetUniformLocation(program, "u_tex"), 1);
+		glUniform1i(glGetUniformLocation(program, "v_tex"), 2);
+	}
+
+	applied.program = program;
+}
+
+// bring the context in line with a recorded driver state, mirrors what
+// internal_set_renderstate & co do on the game thread
+void apply_state(struct cmd_draw *draw)
+{
+	struct cmd_state *state = &draw->state;
+
+	apply_program(draw->program);
+
+	if(draw->yuv_textures[0])
+	{
+		glActiveTexture(GL_TEXTURE0 + 2);
+		glBindTexture(GL_TEXTURE_2D, draw->yuv_textures[1]);
+		glActiveTexture(GL_TEXTURE0 + 1);
+		glBindTexture(GL_TEXTURE_2D, draw->yuv_textures[0]);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	if(!applied.valid || applied.texture != state->texture_handle)
+	{
+		execute_stats.state_changes++;
+		glBindTexture(GL_TEXTURE_2D, state->texture_handle);
+		applied.texture = state->texture_handle;
+	}
+
+	if(!applied.valid || applied.blend_mode != state->blend_mode)
+	{
+		execute_stats.state_changes++;
+		gl_apply_blend_func(state->blend_mode);
+		applied.blend_mode = state->blend_mode;
+	}
+
+	if(!applied.valid || applied.wireframe != state->wireframe)
+	{
+		execute_stats.state_changes++;
+		glPolygonMode(GL_FRONT_AND_BACK, state->wireframe ? GL_LINE : GL_FILL);
+		applied.wireframe = state->wireframe;
+	}
+
+	if(!applied.valid || applied.cullface != state->cullface || applied.nocull != state->nocull)
+	{
+		execute_stats.state_changes++;
+		if(state->nocull) glDisable(GL_CULL_FACE);
+		else
+		{
+			glEnable(GL_CULL_FACE);
+			glCullFace(state->cullface ? GL_FRONT : GL_BACK);
+		}
+		applied.cullface = state->cullface;
+		applied.nocull = state->nocull;
+	}
+
+	if(!applied.valid || applied.depthtest != state->depthtest)
+	{
+		execute_stats.state_changes++;
+		if(state->depthtest) glEnable(GL_DEPTH_TEST);
+		else glDisable(GL_DEPTH_TEST);
+		applied.depthtest = state->depthtest;
+	}
+
+	if(!applied.valid || applied.depthmask != state->depthmask)
+	{
+		execute_stats.state_changes++;
+		glDepthMask(state->depthmask ? GL_TRUE : GL_FALSE);
+		applied.depthmask = state->depthmask;
+	}
+
+	if(!applied.valid || applied.alphatest != state->alphatest)
+	{
+		execute_stats.state_changes++;
+		if(state->alphatest) glEnable(GL_ALPHA_TEST);
+		else glDisable(GL_ALPHA_TEST);
+		applied.alphatest = state->alphatest;
+	}
+
+	if(!applied.valid || applied.alphafunc != state->alphafunc || applied.alpharef != state->alpharef)
+	{
+		GLenum func;
+
+		execute_stats.state_changes++;
+
+		switch(state->alphafunc)
+		{
+			case 0: func = GL_NEVER; break;
+			case 1: func = GL_ALWAYS; break;
+			case 2: func = GL_LESS; break;
+			case 3: func = GL_LEQUAL; break;
+			case 4: func = GL_EQUAL; break;
+			case 5: func = GL_GEQUAL; break;
+			case 6: func = GL_GREATER; break;
+			case 7: func = GL_NOTEQUAL; break;
+			default: func = GL_LEQUAL; break;
+		}
+
+		glAlphaFunc(func, state->alpharef / 255.0f);
+		applied.alphafunc = state->alphafunc;
+		applied.alpharef = state->alpharef;
+	}
+
+	if(!applied.valid || applied.shademode != state->shademode)
+	{
+		execute_stats.state_changes++;
+		glShadeModel(state->shademode ? GL_SMOOTH : GL_FLAT);
+		applied.shademode = state->shademode;
+	}
+
+	if(!applied.valid || applied.clip != draw->clip)
+	{
+		execute_stats.state_changes++;
+		if(draw->clip) glEnable(GL_SCISSOR_TEST);
+		else glDisable(GL_SCISSOR_TEST);
+		applied.clip = draw->clip;
+	}
+
+	if(!applied.valid || memcmp(applied.scissor, draw->scissor, sizeof(applied.scissor)))
+	{
+		execute_stats.state_changes++;
+		glScissor(draw->scissor[0], draw->scissor[1], draw->scissor[2], draw->scissor[3]);
+		memcpy(applied.scissor, draw->scissor, sizeof(applied.scissor));
+	}
+
+	if(!applied.valid || memcmp(&applied.world_matrix, &state->world_matrix, sizeof(applied.world_matrix)))
+	{
+		execute_stats.state_changes++;
+		glMatrixMode(GL_MODELVIEW);
+		glLoadMatrixf(&state->world_matrix.m[0][0]);
+		memcpy(&applied.world_matrix, &state->world_matrix, sizeof(applied.world_matrix));
+	}
+
+	applied.valid = true;
+}
+
+// upload uniforms and vertex data, the executor equivalent of the tail end of
+// gl_draw_indexed_primitive
+void submit_draw(struct cmd_draw *draw, struct nvertex *vertices, word *indices)
+{
+	GLint filter = draw->state.texture_filter ? GL_LINEAR : GL_NEAREST;
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+
+	if(draw->program != 0)
+	{
+		if(draw->vertextype != TLVERTEX)
+		{
+			glUniformMatrix4fv(glGetUniformLocation(draw->program, "d3dprojection_matrix"), 1, false, &draw->state.d3dprojection_matrix.m[0][0]);
+			glUniformMatrix4fv(glGetUniformLocation(draw->program, "d3dviewport_matrix"), 1, false, &draw->viewport_matrix.m[0][0]);
+		}
+
+		glUniform1i(glGetUniformLocation(draw->program, "vertextype"), draw->vertextype);
+		glUniform1i(glGetUniformLocation(draw->program, "fb_texture"), draw->state.fb_texture);
+		glUniform1i(glGetUniformLocation(draw->program, "modulate_alpha"), draw->modulate_alpha);
+		glUniform1i(glGetUniformLocation(draw->program, "texture"), draw->state.texture_handle != 0);
+		glUniform1i(glGetUniformLocation(draw->program, "blend_mode"), draw->state.blend_mode);
+		if(draw->program == yuv_program) glUniform1i(glGetUniformLocation(draw->program, "full_range"), draw->full_range);
+	}
+
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(*vertices), &vertices[0].color.color);
+	glVertexPointer(draw->vertextype == TLVERTEX ? 4 : 3, GL_FLOAT, sizeof(*vertices), &vertices[0]._);
+	glTexCoordPointer(2, GL_FLOAT, sizeof(*vertices), &vertices[0].u);
+	glDrawElements(draw->primitivetype, draw->count, GL_UNSIGNED_SHORT, indices);
+}
+
+// flush game rendering to the back buffer and swap, see gl_prepare_flip
+void execute_flip()
+{
+	struct nvertex vertices[] = {
+		{1.0f, 1.0f, 1.0f, 1.0f, 0xffffffff, 0, 1.0f, 1.0f},
+		{1.0f, -1.0f, 1.0f, 1.0f, 0xffffffff, 0, 1.0f, 0.0f},
+		{-1.0f, -1.0f, 1.0f, 1.0f, 0xffffffff, 0, 0.0f, 0.0f},
+		{-1.0f, 1.0f, 1.0f, 1.0f, 0xffffffff, 0, 0.0f, 1.0f},
+	};
+	word indices[] = {0, 1, 2, 3};
+	struct cmd_draw draw;
+
+	if(indirect_rendering)
+	{
+		memset(&draw, 0, sizeof(draw));
+		draw.state.texture_handle = indirect_texture;
+		draw.state.texture_filter = true;
+		draw.program = post_program;
+		draw.primitivetype = GL_QUADS;
+		draw.vertextype = TLVERTEX;
+		draw.count = 4;
+		draw.modulate_alpha = true;
+
+		glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_VIEWPORT_BIT | GL_COLOR_BUFFER_BIT);
+
+		glBindTexture(GL_TEXTURE_2D, indirect_texture);
+
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+
+		glDisable(GL_SCISSOR_TEST);
+
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		glDisable(GL_BLEND);
+		glDisable(GL_DEPTH_TEST);
+		glDisable(GL_ALPHA_TEST);
+
+		glUseProgram(post_program);
+
+		if(post_program)
+		{
+			glUniform1i(glGetUniformLocation(post_program, "tex"), 0);
+			glUniform1f(glGetUniformLocation(post_program, "width"), (float)internal_size_x);
+			glUniform1f(glGetUniformLocation(post_program, "height"), (float)internal_size_y);
+		}
+
+		glMatrixMode(GL_MODELVIEW);
+		glPushMatrix();
+		glLoadIdentity();
+
+		glMatrixMode(GL_PROJECTION);
+		glPushMatrix();
+		glLoadIdentity();
+
+		glViewport(x_offset, y_offset, output_size_x, output_size_y);
+
+		submit_draw(&draw, vertices, indices);
+
+		glMatrixMode(GL_PROJECTION);
+		glPopMatrix();
+		glMatrixMode(GL_MODELVIEW);
+		glPopMatrix();
+
+		glPopAttrib();
+	}
+
+	gl_swap_buffers();
+
+	if(indirect_rendering) gl_prepare_render();
+
+	applied.valid = false;
+}
+
+// run all commands in a frame, returns false if an unknown command was found
+bool gl_execute_frame(struct cmd_frame *frame)
+{
+	uint i;
+
+	if(frame->fence)
+	{
+		glWaitSync(frame->fence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(frame->fence);
+	}
+
+	// the context may have been used by someone else since the last frame
+	applied.valid = false;
+
+	for(i = 0; i < frame->num_cmds; i++)
+	{
+		struct gl_cmd *cmd = &frame->cmds[i];
+
+		switch(cmd->type)
+		{
+			case CMD_DRAW:
+				execute_stats.draw_calls++;
+				apply_state(&cmd->u.draw);
+				submit_draw(&cmd->u.draw, (struct nvertex *)&frame->data[cmd->u.draw.vertices], (word *)&frame->data[cmd->u.draw.indices]);
+				break;
+
+			case CMD_CLEAR:
+				glPushAttrib(GL_DEPTH_BUFFER_BIT | GL_SCISSOR_BIT | GL_COLOR_BUFFER_BIT);
+				glEnable(GL_DEPTH_TEST);
+				glDepthMask(GL_TRUE);
+				glDisable(GL_SCISSOR_TEST);
+				glClearColor(cmd->u.clear.color[0], cmd->u.clear.color[1], cmd->u.clear.color[2], cmd->u.clear.color[3]);
+				glClear(cmd->u.clear.mask);
+				glPopAttrib();
+				break;
+
+			case CMD_COPY_FRAMEBUFFER:
+				glBindTexture(GL_TEXTURE_2D, cmd->u.copy.texture);
+				glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, cmd->u.copy.x, cmd->u.copy.y, cmd->u.copy.w, cmd->u.copy.h, 0);
+				glBindTexture(GL_TEXTURE_2D, applied.texture);
+				break;
+
+			case CMD_DELETE_TEXTURES:
+				glDeleteTextures(cmd->u.del.count, (GLuint *)&frame->data[cmd->u.del.textures]);
+				applied.valid = false;
+				break;
+
+			case CMD_FLIP:
+				execute_flip();
+				break;
+
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
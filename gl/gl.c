@@ -34,7 +34,7 @@
 #include "../log.h"
 #include "../matrix.h"
 
-struct matrix d3dviewport_matrix = {
+MATRIX_ALIGN struct matrix d3dviewport_matrix = {
 	1.0f, 0.0f, 0.0f, 0.0f,
 	0.0f, 1.0f, 0.0f, 0.0f,
 	0.0f, 0.0f, 1.0f, 0.0f,
@@ -123,7 +123,8 @@ void gl_draw_movie_quad_yuv(GLuint *yuv_textures, int movie_width, int movie_hei
 	if(yuv_program)
 	{
 		gl_use_yuv_program();
-		glUniform1i(glGetUniformLocation(current_program, "full_range"), full_range);
+		if(gl_is_recording()) gl_record_yuv(yuv_textures, full_range);
+		else glUniform1i(glGetUniformLocation(current_program, "full_range"), full_range);
 		gl_draw_movie_quad_common(movie_width, movie_height);
 		gl_use_main_program();
 	}
@@ -181,6 +182,8 @@ void gl_draw_indexed_primitive(GLenum primitivetype, uint vertextype, struct nve
 	// should never happen, broken 3rd-party models cause this
 	if(!count) return;
 
+	PROFILE_BEGIN("gl_draw_indexed_primitive");
+
 	// scissor test is used to emulate D3D viewports
 	if(clip) glEnable(GL_SCISSOR_TEST);
 	else glDisable(GL_SCISSOR_TEST);
@@ -188,6 +191,7 @@ void gl_draw_indexed_primitive(GLenum primitivetype, uint vertextype, struct nve
 	if(vertextype > TLVERTEX)
 	{
 		unexpected_once("vertextype > TLVERTEX\n");
+		PROFILE_END();
 		return;
 	}
 
@@ -197,6 +201,34 @@ void gl_draw_indexed_primitive(GLenum primitivetype, uint vertextype, struct nve
 		// special cases can signal back to this function that the draw call has
 		// been handled in some other manner
 		current_state.texture_filter = saved_texture_filter;
+		PROFILE_END();
+		return;
+	}
+
+	if(vertex_log)
+	{
+		log = fopen("vert.log", "ab");
+
+		fprintf(log, "Vertextype: %i\n", vertextype);
+
+		for(i = 0; i < vertexcount; i++)
+		{
+			fprintf(log, "%f\t\t%f\t\t%f\t\t%f\t\t%f\t\t%f\n", vertices[i]._.x, vertices[i]._.y, vertices[i]._.z, vertices[i].color.w, vertices[i].u, vertices[i].v);
+		}
+
+		fclose(log);
+	}
+
+	// the render thread owns the context, copy this draw into the command
+	// stream along with the render state it depends on
+	if(gl_is_recording())
+	{
+		gl_record_draw(primitivetype, vertextype, vertices, vertexcount, indices, count, clip);
+
+		stats.vertex_count += count;
+
+		current_state.texture_filter = saved_texture_filter;
+		PROFILE_END();
 		return;
 	}
 
@@ -221,20 +253,6 @@ void gl_draw_indexed_primitive(GLenum primitivetype, uint vertextype, struct nve
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	}
 
-	if(vertex_log)
-	{
-		log = fopen("vert.log", "ab");
-
-		fprintf(log, "Vertextype: %i\n", vertextype);
-
-		for(i = 0; i < vertexcount; i++)
-		{
-			fprintf(log, "%f\t\t%f\t\t%f\t\t%f\t\t%f\t\t%f\n", vertices[i]._.x, vertices[i]._.y, vertices[i]._.z, vertices[i].color.w, vertices[i].u, vertices[i].v);
-		}
-
-		fclose(log);
-	}
-
 	// upload shader uniforms
 	if(current_program != 0)
 	{
@@ -265,6 +283,8 @@ void gl_draw_indexed_primitive(GLenum primitivetype, uint vertextype, struct nve
 	stats.vertex_count += count;
 
 	current_state.texture_filter = saved_texture_filter;
+
+	PROFILE_END();
 }
 
 void gl_set_world_matrix(struct matrix *matrix)
@@ -284,35 +304,11 @@ void gl_set_blend_func(uint blend_mode)
 {
 	if(trace_all) trace("set blend mode %i\n", blend_mode);
 
-	glUniform1i(glGetUniformLocation(current_program, "blend_mode"), blend_mode);
+	if(!gl_is_recording()) glUniform1i(glGetUniformLocation(current_program, "blend_mode"), blend_mode);
 
 	current_state.blend_mode = blend_mode;
 
-	glBlendEquation(GL_FUNC_ADD);
-
-	switch(blend_mode)
-	{
-		case BLEND_AVG:
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-			break;
-		case BLEND_ADD:
-			glBlendFunc(GL_ONE, GL_ONE);
-			break;
-		case BLEND_SUB:
-			glBlendFunc(GL_ONE, GL_ONE);
-			glBlendEquation(GL_FUNC_REVERSE_SUBTRACT);
-			break;
-		case BLEND_25P:
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-			break;
-		case BLEND_NONE:
-			if(fancy_transparency) glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-			else glBlendFunc(GL_ONE, GL_ZERO);
-			break;
-
-		default:
-			unexpected("Unknown blend mode %i\n", blend_mode);
-	}
+	if(!gl_apply_blend_func(blend_mode)) unexpected("Unknown blend mode %i\n", blend_mode);
 }
 
 // draw text on screen using the game font
@@ -369,10 +365,10 @@ bool gl_draw_text(uint x, uint y, uint color, uint alpha, char *fmt, ...)
 
 	gl_save_state(&saved_state);
 
-	vertices_a = driver_malloc(len * sizeof(struct nvertex) * 4);
-	indices_a = driver_malloc(len * 2 * 4);
-	vertices_b = driver_malloc(len * sizeof(struct nvertex) * 4);
-	indices_b = driver_malloc(len * 2 * 4);
+	vertices_a = frame_alloc(len * sizeof(struct nvertex) * 4);
+	indices_a = frame_alloc(len * 2 * 4);
+	vertices_b = frame_alloc(len * sizeof(struct nvertex) * 4);
+	indices_b = frame_alloc(len * 2 * 4);
 
 	for(i = 0; i < len; i++)
 	{
@@ -461,11 +457,6 @@ bool gl_draw_text(uint x, uint y, uint color, uint alpha, char *fmt, ...)
 
 	nodefer = false;
 
-	driver_free(vertices_a);
-	driver_free(indices_a);
-	driver_free(vertices_b);
-	driver_free(indices_b);
-
 	gl_load_state(&saved_state);
 
 	return true;
@@ -533,14 +524,6 @@ void gl_prepare_flip()
 	glPopAttrib();
 }
 
-// prepare for game rendering
-void gl_prepare_render()
-{
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, indirect_fbo);
-
-	glViewport(0, 0, internal_size_x, internal_size_y);
-}
-
 bool gl_load_shaders()
 {
 	uint max_interpolators;
@@ -608,3 +591,29 @@ bool gl_init_postprocessing()
 {
 	return (post_program = gl_create_program(0, post_source, "postprocessing")) != 0;
 }
+
+bool gl_init_oit()
+{
+	if(!GLEW_ARB_draw_buffers_blend || !GLEW_ARB_texture_float)
+	{
+		error("No support for per-buffer blending or float textures, cannot do order-independent transparency\n");
+		return false;
+	}
+
+	oit_program = gl_create_program(0, oit_source, "oit");
+
+	if(!oit_program) return false;
+
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, indirect_fbo);
+
+	if(!gl_init_oit_targets())
+	{
+		error("Driver didn't accept our transparency targets\n");
+		glDeleteProgram(oit_program);
+		oit_program = 0;
+
+		return false;
+	}
+
+	return true;
+}
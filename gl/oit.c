@@ -0,0 +1,218 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * gl/oit.c - weighted blended order-independent transparency
+ *
+ * Alternative to the triangle sort in gl/deferred.c. Transparent draws are
+ * queued until all opaque geometry of the frame is drawn and then go to two
+ * extra color attachments of the indirect framebuffer, an accumulation target
+ * summing premultiplied color and coverage and a revealage target multiplying
+ * the remaining background visibility. Both are resolved into the main color
+ * buffer once per frame by the composite shader.
+ *
+ * The main fragment shader is used unchanged, its single output is written to
+ * both targets with different blend functions per draw buffer. That limits
+ * the weight function to a constant so overlapping layers are averaged
+ * rather than depth weighted.
+ *
+ * Free of Windows and game dependencies like gl/execute.c, see
+ * replay/oit_diff.c.
+ */
+
+#include <gl/glew.h>
+
+#include "../types.h"
+#include "../gl.h"
+
+extern uint internal_size_x;
+extern uint internal_size_y;
+
+extern GLuint indirect_fbo;
+
+GLuint oit_accum_texture;
+GLuint oit_reveal_texture;
+uint oit_program = 0;
+
+// something was drawn since the last composite
+bool oit_pending = false;
+
+GLuint oit_create_target()
+{
+	GLuint texture;
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F_ARB, internal_size_x, internal_size_y, 0, GL_RGBA, GL_FLOAT, 0);
+
+	return texture;
+}
+
+// reset the targets to an empty transparent layer
+void oit_clear()
+{
+	glPushAttrib(GL_COLOR_BUFFER_BIT | GL_SCISSOR_BIT);
+
+	glDisable(GL_SCISSOR_TEST);
+
+	glDrawBuffer(GL_COLOR_ATTACHMENT1_EXT);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glDrawBuffer(GL_COLOR_ATTACHMENT2_EXT);
+	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glPopAttrib();
+
+	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+}
+
+// attach the accumulation and revealage targets to the indirect framebuffer,
+// which must be bound, oit_program has to be loaded by the caller
+bool gl_init_oit_targets()
+{
+	GLint texture;
+	bool ret;
+
+	if(!GLEW_ARB_draw_buffers_blend || !GLEW_ARB_texture_float) return false;
+
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+
+	oit_accum_texture = oit_create_target();
+	oit_reveal_texture = oit_create_target();
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT1_EXT, GL_TEXTURE_2D, oit_accum_texture, 0);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT2_EXT, GL_TEXTURE_2D, oit_reveal_texture, 0);
+
+	ret = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) == GL_FRAMEBUFFER_COMPLETE_EXT;
+
+	if(!ret)
+	{
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT1_EXT, GL_TEXTURE_2D, 0, 0);
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT2_EXT, GL_TEXTURE_2D, 0, 0);
+		glDeleteTextures(1, &oit_accum_texture);
+		glDeleteTextures(1, &oit_reveal_texture);
+
+		return false;
+	}
+
+	oit_clear();
+
+	return true;
+}
+
+// route the following draw calls to the transparency targets, the caller
+// restores blending, depth writes and the draw buffer with gl_end_oit
+void gl_begin_oit()
+{
+	GLenum buffers[] = {GL_COLOR_ATTACHMENT1_EXT, GL_COLOR_ATTACHMENT2_EXT};
+
+	glDrawBuffers(2, buffers);
+
+	glBlendEquation(GL_FUNC_ADD);
+	glBlendFuncSeparateiARB(0, GL_SRC_ALPHA, GL_ONE, GL_ONE, GL_ONE);
+	glBlendFunciARB(1, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+
+	// transparent surfaces never occlude each other
+	glDepthMask(GL_FALSE);
+
+	oit_pending = true;
+}
+
+void gl_end_oit()
+{
+	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+}
+
+// blend the transparent layer over the main color buffer and start a new one
+void gl_composite_oit()
+{
+	GLfloat vertices[] = {
+		-1.0f, -1.0f, 0.0f, 0.0f,
+		 1.0f, -1.0f, 1.0f, 0.0f,
+		 1.0f,  1.0f, 1.0f, 1.0f,
+		-1.0f,  1.0f, 0.0f, 1.0f,
+	};
+	GLint program;
+
+	if(!oit_pending) return;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+	glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_POLYGON_BIT);
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_ALPHA_TEST);
+	glDisable(GL_CULL_FACE);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glDepthMask(GL_FALSE);
+
+	// result = color * (1 - revealage) + background * revealage
+	glEnable(GL_BLEND);
+	glBlendEquation(GL_FUNC_ADD);
+	glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+	glUseProgram(oit_program);
+	glUniform1i(glGetUniformLocation(oit_program, "accum_tex"), 0);
+	glUniform1i(glGetUniformLocation(oit_program, "reveal_tex"), 1);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, oit_reveal_texture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, oit_accum_texture);
+
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(2, GL_FLOAT, sizeof(GLfloat) * 4, &vertices[0]);
+	glTexCoordPointer(2, GL_FLOAT, sizeof(GLfloat) * 4, &vertices[2]);
+	glDrawArrays(GL_QUADS, 0, 4);
+
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+
+	glPopClientAttrib();
+	glPopAttrib();
+
+	glUseProgram(program);
+
+	oit_clear();
+
+	oit_pending = false;
+}
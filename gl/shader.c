@@ -25,6 +25,7 @@
 
 #include "../types.h"
 #include "../log.h"
+#include "../gl.h"
 
 uint main_program = 0;
 uint post_program = 0;
@@ -180,7 +181,7 @@ void gl_use_post_program()
 	glUseProgram(post_program);
 	current_program = post_program;
 
-	if(post_program != 0)
+	if(post_program != 0 && !gl_is_recording())
 	{
 		glUniform1i(glGetUniformLocation(current_program, "tex"), 0);
 		glUniform1f(glGetUniformLocation(current_program, "width"), (float)internal_size_x);
@@ -194,7 +195,7 @@ void gl_use_main_program()
 	glUseProgram(main_program);
 	current_program = main_program;
 
-	if(main_program != 0)
+	if(main_program != 0 && !gl_is_recording())
 	{
 		glUniform1i(glGetUniformLocation(current_program, "tex"), 0);
 	}
@@ -206,7 +207,7 @@ void gl_use_yuv_program()
 	glUseProgram(yuv_program);
 	current_program = yuv_program;
 
-	if(yuv_program != 0)
+	if(yuv_program != 0 && !gl_is_recording())
 	{
 		glUniform1i(glGetUniformLocation(current_program, "y_tex"), 0);
 		glUniform1i(glGetUniformLocation(current_program, "u_tex"), 1);
@@ -83,8 +83,8 @@ bool gl_special_case(GLenum primitivetype, uint vertextype, struct nvertex *vert
 				double factor = (double)internal_size_x / (double)width;
 				double inv_factor = 0.5 / factor;
 				uint new_count = ((uint)(4 * factor)) * 2;
-				struct nvertex *_vertices = driver_malloc(new_count * sizeof(*_vertices));
-				word *_indices = driver_malloc(new_count * sizeof(*_indices));
+				struct nvertex *_vertices = frame_alloc(new_count * sizeof(*_vertices));
+				word *_indices = frame_alloc(new_count * sizeof(*_indices));
 
 				for(j = 0; j < new_count; j += 2)
 				{
@@ -108,9 +108,6 @@ bool gl_special_case(GLenum primitivetype, uint vertextype, struct nvertex *vert
 				}
 
 				gl_draw_indexed_primitive(primitivetype, vertextype, _vertices, new_count, _indices, new_count, graphics_object, false, true);
-
-				driver_free(_vertices);
-				driver_free(_indices);
 			}
 
 			return true;
@@ -182,8 +179,8 @@ bool gl_special_case(GLenum primitivetype, uint vertextype, struct nvertex *vert
 			double factor = (double)internal_size_y / (double)height;
 			double inv_factor = 0.5 / factor;
 			uint new_count = ((uint)((vertexcount + 2) * factor)) * 2;
-			struct nvertex *_vertices = driver_malloc(new_count * sizeof(*_vertices));
-			word *_indices = driver_malloc(new_count * sizeof(*_indices));
+			struct nvertex *_vertices = frame_alloc(new_count * sizeof(*_vertices));
+			word *_indices = frame_alloc(new_count * sizeof(*_indices));
 
 			for(i = 0; i < new_count; i += 2)
 			{
@@ -211,9 +208,6 @@ bool gl_special_case(GLenum primitivetype, uint vertextype, struct nvertex *vert
 
 			gl_draw_indexed_primitive(primitivetype, vertextype, _vertices, new_count, _indices, new_count, graphics_object, false, true);
 
-			driver_free(_vertices);
-			driver_free(_indices);
-
 			return true;
 		}
 	}
@@ -139,6 +139,14 @@ GLuint gl_commit_compressed_buffer(void *data, uint width, uint height, uint for
 	return gl_commit_pixel_buffer_generic(data, width, height, format, 0, size, true);
 }
 
+// delete OpenGL textures, with a render thread active this has to wait until
+// the frame currently being recorded is done with them
+void gl_delete_textures(uint count, GLuint *textures)
+{
+	if(gl_is_recording()) gl_record_delete_textures(count, textures);
+	else glDeleteTextures(count, textures);
+}
+
 // apply OpenGL texture for a certain palette in a texture set, possibly
 // replacing an existing texture which will then be unloaded
 void gl_replace_texture(struct texture_set *texture_set, uint palette_index, uint new_texture)
@@ -148,7 +156,7 @@ void gl_replace_texture(struct texture_set *texture_set, uint palette_index, uin
 	if(VREF(texture_set, texturehandle[palette_index]) != 0)
 	{
 		if(VREF(texture_set, ogl.external)) glitch("oops, may have messed up an external texture\n");
-		glDeleteTextures(1, VREFP(texture_set, texturehandle[palette_index]));
+		gl_delete_textures(1, VREFP(texture_set, texturehandle[palette_index]));
 	}
 
 	VRASS(texture_set, texturehandle[palette_index], new_texture);
@@ -207,15 +215,10 @@ void gl_set_texture(GLuint texture)
 {
 	if(trace_all) trace("set texture %i\n", texture);
 
-	if(texture)
-	{
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glUniform1i(glGetUniformLocation(current_program, "texture"), 1);
-	}
-	else
-	{
-		glUniform1i(glGetUniformLocation(current_program, "texture"), 0);
-	}
+	if(texture) glBindTexture(GL_TEXTURE_2D, texture);
+
+	// uniforms live in the shared program object, the render thread sets them
+	if(!gl_is_recording()) glUniform1i(glGetUniformLocation(current_program, "texture"), texture ? 1 : 0);
 
 	current_state.texture_handle = texture;
 	current_state.texture_set = 0;
@@ -0,0 +1,99 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * gl/zsort.c - depth keys and the radix sort used to order deferred triangles
+ *
+ * No game or Windows dependencies so it can be benchmarked on its own, see
+ * replay/zsort_bench.c.
+ */
+
+#include <string.h>
+
+#include "../types.h"
+#include "../gl.h"
+
+// map a depth value to a key that puts the farthest triangle first when
+// sorted in ascending order
+uint gl_depth_sort_key(float z)
+{
+	union
+	{
+		float f;
+		uint u;
+	} v;
+
+	v.f = z;
+
+	// make the float bit pattern order like an unsigned integer
+	if(v.u & 0x80000000) v.u = ~v.u;
+	else v.u |= 0x80000000;
+
+	return ~v.u;
+}
+
+// stable LSD radix sort, fills order with indices into keys from the smallest
+// key to the largest, scratch must have room for count entries
+void gl_radix_sort(uint *keys, uint *order, uint *scratch, uint count)
+{
+	uint counts[4][256];
+	uint *src = order;
+	uint *dst = scratch;
+	uint *tmp;
+	uint pass, i;
+
+	for(i = 0; i < count; i++) order[i] = i;
+
+	if(count < 2) return;
+
+	// histograms for all four passes in one go
+	memset(counts, 0, sizeof(counts));
+
+	for(i = 0; i < count; i++)
+	{
+		counts[0][keys[i] & 0xFF]++;
+		counts[1][(keys[i] >> 8) & 0xFF]++;
+		counts[2][(keys[i] >> 16) & 0xFF]++;
+		counts[3][keys[i] >> 24]++;
+	}
+
+	for(pass = 0; pass < 4; pass++)
+	{
+		uint shift = pass * 8;
+		uint sum = 0;
+
+		// every key has the same value in this byte, nothing would move
+		if(counts[pass][(keys[0] >> shift) & 0xFF] == count) continue;
+
+		for(i = 0; i < 256; i++)
+		{
+			uint c = counts[pass][i];
+
+			counts[pass][i] = sum;
+			sum += c;
+		}
+
+		for(i = 0; i < count; i++) dst[counts[pass][(keys[src[i]] >> shift) & 0xFF]++] = src[i];
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	if(src != order) memcpy(order, src, sizeof(*order) * count);
+}
@@ -0,0 +1,178 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * lgp.c - case-insensitive hash index over an LGP archive's table of contents
+ *
+ * Replaces the game's two character lookup table and the linear searches
+ * through its buckets and conflict lists. No game or Windows dependencies so
+ * it can be benchmarked on its own, see replay/lgp_bench.c.
+ */
+
+#include <string.h>
+
+#include "lgp.h"
+
+// ASCII only, like _stricmp in the C locale
+#define LOWER(c) ((c) >= 'A' && (c) <= 'Z' ? (c) + 'a' - 'A' : (c))
+
+// FNV-1a over the lower case string, continuing from hash
+uint lgp_hash(uint hash, char *str, uint len)
+{
+	uint i;
+
+	for(i = 0; i < len && str[i]; i++)
+	{
+		hash ^= (unsigned char)LOWER(str[i]);
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+uint lgp_name_hash(char *name)
+{
+	return lgp_hash(2166136261u, name, sizeof(((struct lgp_toc_entry *)0)->name));
+}
+
+uint lgp_dir_hash(char *name, char *dir)
+{
+	return lgp_hash(lgp_hash(lgp_name_hash(name), "/", 1), dir, sizeof(((struct conflict_entry *)0)->name));
+}
+
+int lgp_name_equal(char *a, char *b, uint len)
+{
+	uint i;
+
+	for(i = 0; i < len; i++)
+	{
+		if(LOWER(a[i]) != LOWER(b[i])) return 0;
+		if(!a[i]) return 1;
+	}
+
+	return !b[i];
+}
+
+struct lgp_index_entry *lgp_find_entry(struct lgp_index *index, uint hash, char *name, char *dir)
+{
+	uint slot = hash & index->mask;
+
+	while(index->entries[slot].file)
+	{
+		struct lgp_index_entry *entry = &index->entries[slot];
+
+		if(entry->hash == hash && (entry->dir != 0) == (dir != 0) && lgp_name_equal(index->toc[entry->name].name, name, sizeof(index->toc->name)))
+		{
+			if(!dir || lgp_name_equal(entry->dir->name, dir, sizeof(entry->dir->name))) return entry;
+		}
+
+		slot = (slot + 1) & index->mask;
+	}
+
+	return &index->entries[slot];
+}
+
+// number of index entries needed for an archive, keeps the table at most half
+// full
+uint lgp_index_size(struct lgp_toc_entry *toc, uint num_files, struct conflict_list *conflicts)
+{
+	uint count = num_files;
+	uint size = 16;
+	uint i;
+
+	for(i = 0; i < num_files; i++)
+	{
+		if(toc[i].conflict) count += conflicts[toc[i].conflict - 1].num_conflicts;
+	}
+
+	while(size < count * 2) size <<= 1;
+
+	return size;
+}
+
+// index every file name and every directory of conflicting file names, the
+// first TOC entry wins if a name appears more than once just like it does in
+// the game's own lookup
+void lgp_build_index(struct lgp_index *index, struct lgp_index_entry *entries, uint size, struct lgp_toc_entry *toc, uint num_files, struct conflict_list *conflicts)
+{
+	uint i, j;
+
+	index->toc = toc;
+	index->num_files = num_files;
+	index->mask = size - 1;
+	index->entries = entries;
+
+	memset(entries, 0, sizeof(*entries) * size);
+
+	for(i = 0; i < num_files; i++)
+	{
+		uint hash = lgp_name_hash(toc[i].name);
+		struct lgp_index_entry *entry = lgp_find_entry(index, hash, toc[i].name, 0);
+
+		if(!entry->file)
+		{
+			entry->hash = hash;
+			entry->file = i + 1;
+			entry->name = i;
+		}
+
+		if(toc[i].conflict)
+		{
+			struct conflict_list *conflict = &conflicts[toc[i].conflict - 1];
+
+			for(j = 0; j < conflict->num_conflicts; j++)
+			{
+				struct conflict_entry *dir = &conflict->conflict_entries[j];
+
+				if(dir->toc_index >= num_files) continue;
+
+				hash = lgp_dir_hash(toc[i].name, dir->name);
+				entry = lgp_find_entry(index, hash, toc[i].name, dir->name);
+
+				if(entry->file) continue;
+
+				entry->hash = hash;
+				entry->file = dir->toc_index + 1;
+				entry->name = i;
+				entry->dir = dir;
+			}
+		}
+	}
+}
+
+// find a file by name, conflicting names are resolved using dir, returns the
+// TOC index or -1 if there is no such file
+int lgp_index_lookup(struct lgp_index *index, char *name, char *dir, bool *resolved_conflict)
+{
+	struct lgp_index_entry *entry = lgp_find_entry(index, lgp_name_hash(name), name, 0);
+	uint file = entry->file;
+
+	if(resolved_conflict) *resolved_conflict = false;
+
+	if(!file) return -1;
+
+	if(!index->toc[file - 1].conflict) return file - 1;
+
+	entry = lgp_find_entry(index, lgp_dir_hash(name, dir), name, dir);
+
+	if(!entry->file) return -1;
+
+	if(resolved_conflict) *resolved_conflict = true;
+
+	return entry->file - 1;
+}
@@ -0,0 +1,77 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * lgp.h - LGP archive structures and the hashed table of contents index
+ */
+
+#ifndef _LGP_H_
+#define _LGP_H_
+
+#include "types.h"
+
+struct lgp_toc_entry
+{
+	char name[16];
+	uint offset;
+	word unknown1;
+	word conflict;
+};
+
+struct lookup_table_entry
+{
+	unsigned short toc_offset;
+	unsigned short num_files;
+};
+
+struct conflict_entry
+{
+	char name[128];
+	unsigned short toc_index;
+};
+
+struct conflict_list
+{
+	uint num_conflicts;
+	struct conflict_entry *conflict_entries;
+};
+
+struct lgp_index_entry
+{
+	uint hash;
+	// TOC index + 1, 0 marks an empty slot
+	uint file;
+	// TOC index of the entry the name was taken from
+	uint name;
+	// directory for conflicting file names, 0 for plain names
+	struct conflict_entry *dir;
+};
+
+struct lgp_index
+{
+	struct lgp_toc_entry *toc;
+	uint num_files;
+	uint mask;
+	struct lgp_index_entry *entries;
+};
+
+uint lgp_index_size(struct lgp_toc_entry *toc, uint num_files, struct conflict_list *conflicts);
+void lgp_build_index(struct lgp_index *index, struct lgp_index_entry *entries, uint size, struct lgp_toc_entry *toc, uint num_files, struct conflict_list *conflicts);
+int lgp_index_lookup(struct lgp_index *index, char *name, char *dir, bool *resolved_conflict);
+
+#endif
@@ -0,0 +1,122 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * limiter.c - frame limiter that sleeps most of the way and spins the rest
+ *
+ * Sleeping alone is too coarse to hit a frame deadline and spinning alone
+ * keeps a core busy for the whole frame. The limiter sleeps until shortly
+ * before the deadline, leaving room for the sleep overshoot it has measured
+ * so far, and spins for the remainder. Deadlines advance by exactly one frame
+ * period so the long-run frame rate matches the requested one.
+ *
+ * No game or Windows dependencies so it can be tested on its own, see
+ * replay/limiter_test.c.
+ */
+
+#include <string.h>
+
+#include "limiter.h"
+
+// busy-wait at least this long before the deadline
+#define SPIN_MS 1.0
+
+// sleeps shorter than this aren't worth it
+#define MIN_SLEEP_US 500
+
+
+void limiter_init(struct frame_limiter *limiter, struct limiter_clock *clock)
+{
+	limiter->clock = clock;
+	limiter->framerate = 0.0;
+	limiter->deadline = 0.0;
+	limiter->overshoot = 0.0;
+	memset(limiter->errors, 0, sizeof(limiter->errors));
+	limiter->next_error = 0;
+	limiter->spin = clock->frequency * SPIN_MS / 1000.0;
+	limiter->slept = 0.0;
+	limiter->spun = 0.0;
+}
+
+// wait for the end of the current frame
+void limiter_wait(struct frame_limiter *limiter, double framerate)
+{
+	struct limiter_clock *clock = limiter->clock;
+	double period = clock->frequency / framerate;
+	time_t now = clock->now(clock->context);
+	time_t start;
+	uint i;
+
+	// start over on a new frame rate
+	if(framerate != limiter->framerate)
+	{
+		limiter->framerate = framerate;
+		limiter->deadline = (double)now;
+	}
+
+	limiter->deadline += period;
+
+	if(now >= limiter->deadline)
+	{
+		// more than a frame behind, after loading for example, don't try to
+		// catch up by rushing through the next few frames
+		if(now - limiter->deadline > period) limiter->deadline = (double)now;
+
+		return;
+	}
+
+	while(true)
+	{
+		double budget = limiter->deadline - now - limiter->spin - limiter->overshoot;
+		uint us;
+		double error;
+
+		if(budget <= 0.0) break;
+
+		us = (uint)(budget * 1000000.0 / clock->frequency);
+
+		if(us < MIN_SLEEP_US) break;
+
+		start = now;
+		clock->sleep(clock->context, us);
+		now = clock->now(clock->context);
+
+		limiter->slept += now - start;
+
+		// plan for the worst overshoot among the last few sleeps
+		error = (now - start) - us * clock->frequency / 1000000.0;
+
+		if(error < 0.0) error = 0.0;
+
+		limiter->errors[limiter->next_error] = error;
+		limiter->next_error = (limiter->next_error + 1) % LIMITER_HISTORY;
+
+		limiter->overshoot = 0.0;
+
+		for(i = 0; i < LIMITER_HISTORY; i++)
+		{
+			if(limiter->errors[i] > limiter->overshoot) limiter->overshoot = limiter->errors[i];
+		}
+	}
+
+	start = now;
+
+	while(now < limiter->deadline) now = clock->now(clock->context);
+
+	limiter->spun += now - start;
+}
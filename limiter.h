@@ -0,0 +1,68 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * limiter.h - frame limiter that sleeps most of the way and spins the rest
+ */
+
+#ifndef _LIMITER_H_
+#define _LIMITER_H_
+
+#include <time.h>
+
+#include "types.h"
+
+// number of recent sleeps the overshoot estimate is based on
+#define LIMITER_HISTORY 64
+
+// time source used by the limiter, swapped out for a simulated one in
+// replay/limiter_test.c
+struct limiter_clock
+{
+	// current time in ticks
+	time_t (*now)(void *context);
+	// block for about the given number of microseconds
+	void (*sleep)(void *context, uint us);
+	// ticks per second
+	double frequency;
+	void *context;
+};
+
+struct frame_limiter
+{
+	struct limiter_clock *clock;
+	double framerate;
+	// end of the current frame in ticks, fractional so rounding the frame
+	// period doesn't add up to drift
+	double deadline;
+	// how much longer than requested recent sleeps have taken, in ticks
+	double errors[LIMITER_HISTORY];
+	uint next_error;
+	// worst of the above
+	double overshoot;
+	// time left to busy-wait after sleeping, in ticks
+	double spin;
+	// ticks spent sleeping and spinning, for statistics
+	double slept;
+	double spun;
+};
+
+void limiter_init(struct frame_limiter *limiter, struct limiter_clock *clock);
+void limiter_wait(struct frame_limiter *limiter, double framerate);
+
+#endif
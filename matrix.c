@@ -22,10 +22,15 @@
 
 #include <string.h>
 #include <math.h>
+#include <xmmintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
 
 #include "matrix.h"
-#include "math.h"
-#include "log.h"
 
 void add_vector(struct point3d *a, struct point3d *b, struct point3d *dest)
 {
@@ -79,14 +84,14 @@ void cross_product(struct point3d *a, struct point3d *b, struct point3d *dest)
 	dest->z = a->x * b->y - a->y * b->x;
 }
 
-void transform_point(struct matrix *matrix, struct point3d *point, struct point3d *dest)
+void transform_point_scalar(struct matrix *matrix, struct point3d *point, struct point3d *dest)
 {
 	dest->x = matrix->_11 * point->x + matrix->_21 * point->y + matrix->_31 * point->z + matrix->_41;
 	dest->y = matrix->_12 * point->x + matrix->_22 * point->y + matrix->_32 * point->z + matrix->_42;
 	dest->z = matrix->_13 * point->x + matrix->_23 * point->y + matrix->_33 * point->z + matrix->_43;
 }
 
-void transform_point_w(struct matrix *matrix, struct point3d *point, struct point4d *dest)
+void transform_point_w_scalar(struct matrix *matrix, struct point3d *point, struct point4d *dest)
 {
 	dest->x = matrix->_11 * point->x + matrix->_21 * point->y + matrix->_31 * point->z + matrix->_41;
 	dest->y = matrix->_12 * point->x + matrix->_22 * point->y + matrix->_32 * point->z + matrix->_42;
@@ -94,7 +99,7 @@ void transform_point_w(struct matrix *matrix, struct point3d *point, struct poin
 	dest->w = matrix->_14 * point->x + matrix->_24 * point->y + matrix->_34 * point->z + matrix->_44;
 }
 
-void transform_point4d(struct matrix *matrix, struct point4d *point, struct point4d *dest)
+void transform_point4d_scalar(struct matrix *matrix, struct point4d *point, struct point4d *dest)
 {
 	dest->x = matrix->_11 * point->x + matrix->_21 * point->y + matrix->_31 * point->z + matrix->_41 * point->w;
 	dest->y = matrix->_12 * point->x + matrix->_22 * point->y + matrix->_32 * point->z + matrix->_42 * point->w;
@@ -102,7 +107,22 @@ void transform_point4d(struct matrix *matrix, struct point4d *point, struct poin
 	dest->w = matrix->_14 * point->x + matrix->_24 * point->y + matrix->_34 * point->z + matrix->_44 * point->w;
 }
 
-void transpose_matrix(struct matrix *matrix, struct matrix *dest)
+// screen space depth (z / w) of count points stored as separate x, y and z
+// arrays
+void transform_depths_scalar(struct matrix *matrix, float *x, float *y, float *z, float *dest, unsigned int count)
+{
+	unsigned int i;
+
+	for(i = 0; i < count; i++)
+	{
+		float tz = matrix->_13 * x[i] + matrix->_23 * y[i] + matrix->_33 * z[i] + matrix->_43;
+		float tw = matrix->_14 * x[i] + matrix->_24 * y[i] + matrix->_34 * z[i] + matrix->_44;
+
+		dest[i] = tz / tw;
+	}
+}
+
+void transpose_matrix_scalar(struct matrix *matrix, struct matrix *dest)
 {
 	dest->_11 = matrix->_11;
 	dest->_12 = matrix->_21;
@@ -122,7 +142,7 @@ void transpose_matrix(struct matrix *matrix, struct matrix *dest)
 	dest->_44 = matrix->_44;
 }
 
-void multiply_matrix(struct matrix *a, struct matrix *b, struct matrix *dest)
+void multiply_matrix_scalar(struct matrix *a, struct matrix *b, struct matrix *dest)
 {
 
 #define MMUL(I, J, N) a->m[I - 1][N - 1] * b->m[N - 1][J - 1]
@@ -241,7 +261,13 @@ float determinant_3x3(struct matrix *m)
 		m->_11 * m->_23 * m->_32 - m->_12 * m->_21 * m->_33 - m->_13 * m->_22 * m->_31;
 }
 
-void inverse_matrix(struct matrix *matrix, struct matrix *dest)
+// inverse of a rotation and translation matrix, returns 0 and leaves dest
+// untouched if the matrix is scaled
+//
+// uses the scalar routines directly, the SSE ones are slower here as the
+// transposed matrix is patched with scalar stores and then reloaded a row at
+// a time
+int inverse_matrix(struct matrix *matrix, struct matrix *dest)
 {
 	float det = determinant_3x3(matrix);
 
@@ -249,17 +275,147 @@ void inverse_matrix(struct matrix *matrix, struct matrix *dest)
 	{
 		struct point3d translation;
 
-		transpose_matrix(matrix, dest);
+		transpose_matrix_scalar(matrix, dest);
 		dest->_14 = matrix->_14;
 		dest->_24 = matrix->_24;
 		dest->_34 = matrix->_34;
 		dest->_44 = matrix->_44;
 
-		transform_point(dest, (struct point3d *)&matrix->_41, &translation);
+		transform_point_scalar(dest, (struct point3d *)&matrix->_41, &translation);
 
 		dest->_41 = -translation.x;
 		dest->_42 = -translation.y;
 		dest->_43 = -translation.z;
+
+		return 1;
 	}
-	else glitch_once("Non-uniform scaling: %f\n", det);
+
+	return 0;
+}
+
+// SSE versions, the matrix is loaded a row at a time with unaligned loads as
+// matrices embedded in game structures are only 4-byte aligned, row vector
+// convention like the scalar code
+
+void transform_point_sse(struct matrix *matrix, struct point3d *point, struct point3d *dest)
+{
+	__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(point->x), _mm_loadu_ps(matrix->m[0])), _mm_mul_ps(_mm_set1_ps(point->y), _mm_loadu_ps(matrix->m[1]))),
+		_mm_add_ps(_mm_mul_ps(_mm_set1_ps(point->z), _mm_loadu_ps(matrix->m[2])), _mm_loadu_ps(matrix->m[3])));
+
+	_mm_storel_pi((__m64 *)&dest->x, r);
+	_mm_store_ss(&dest->z, _mm_movehl_ps(r, r));
+}
+
+void transform_point_w_sse(struct matrix *matrix, struct point3d *point, struct point4d *dest)
+{
+	__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(point->x), _mm_loadu_ps(matrix->m[0])), _mm_mul_ps(_mm_set1_ps(point->y), _mm_loadu_ps(matrix->m[1]))),
+		_mm_add_ps(_mm_mul_ps(_mm_set1_ps(point->z), _mm_loadu_ps(matrix->m[2])), _mm_loadu_ps(matrix->m[3])));
+
+	_mm_storeu_ps(&dest->x, r);
+}
+
+void transform_point4d_sse(struct matrix *matrix, struct point4d *point, struct point4d *dest)
+{
+	__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(point->x), _mm_loadu_ps(matrix->m[0])), _mm_mul_ps(_mm_set1_ps(point->y), _mm_loadu_ps(matrix->m[1]))),
+		_mm_add_ps(_mm_mul_ps(_mm_set1_ps(point->z), _mm_loadu_ps(matrix->m[2])), _mm_mul_ps(_mm_set1_ps(point->w), _mm_loadu_ps(matrix->m[3]))));
+
+	_mm_storeu_ps(&dest->x, r);
+}
+
+// four points per iteration
+void transform_depths_sse(struct matrix *matrix, float *x, float *y, float *z, float *dest, unsigned int count)
+{
+	__m128 m13 = _mm_set1_ps(matrix->_13), m23 = _mm_set1_ps(matrix->_23), m33 = _mm_set1_ps(matrix->_33), m43 = _mm_set1_ps(matrix->_43);
+	__m128 m14 = _mm_set1_ps(matrix->_14), m24 = _mm_set1_ps(matrix->_24), m34 = _mm_set1_ps(matrix->_34), m44 = _mm_set1_ps(matrix->_44);
+	unsigned int i;
+
+	for(i = 0; i + 4 <= count; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(&x[i]);
+		__m128 py = _mm_loadu_ps(&y[i]);
+		__m128 pz = _mm_loadu_ps(&z[i]);
+		__m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m13, px), _mm_mul_ps(m23, py)), _mm_add_ps(_mm_mul_ps(m33, pz), m43));
+		__m128 tw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m14, px), _mm_mul_ps(m24, py)), _mm_add_ps(_mm_mul_ps(m34, pz), m44));
+
+		_mm_storeu_ps(&dest[i], _mm_div_ps(tz, tw));
+	}
+
+	transform_depths_scalar(matrix, &x[i], &y[i], &z[i], &dest[i], count - i);
+}
+
+void transpose_matrix_sse(struct matrix *matrix, struct matrix *dest)
+{
+	__m128 r0 = _mm_loadu_ps(matrix->m[0]);
+	__m128 r1 = _mm_loadu_ps(matrix->m[1]);
+	__m128 r2 = _mm_loadu_ps(matrix->m[2]);
+	__m128 r3 = _mm_loadu_ps(matrix->m[3]);
+
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	_mm_storeu_ps(dest->m[0], r0);
+	_mm_storeu_ps(dest->m[1], r1);
+	_mm_storeu_ps(dest->m[2], r2);
+	_mm_storeu_ps(dest->m[3], r3);
+}
+
+// all of b is loaded up front and each row of a is read before the same row
+// of dest is written, dest may be the same matrix as a or b
+void multiply_matrix_sse(struct matrix *a, struct matrix *b, struct matrix *dest)
+{
+	__m128 b0 = _mm_loadu_ps(b->m[0]);
+	__m128 b1 = _mm_loadu_ps(b->m[1]);
+	__m128 b2 = _mm_loadu_ps(b->m[2]);
+	__m128 b3 = _mm_loadu_ps(b->m[3]);
+	__m128 rows[4];
+	int i;
+
+	for(i = 0; i < 4; i++)
+	{
+		rows[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a->m[i][0]), b0), _mm_mul_ps(_mm_set1_ps(a->m[i][1]), b1)),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a->m[i][2]), b2), _mm_mul_ps(_mm_set1_ps(a->m[i][3]), b3)));
+	}
+
+	for(i = 0; i < 4; i++) _mm_storeu_ps(dest->m[i], rows[i]);
+}
+
+// scalar until matrix_init has checked the CPU
+void (*transform_point)(struct matrix *matrix, struct point3d *point, struct point3d *dest) = transform_point_scalar;
+void (*transform_point_w)(struct matrix *matrix, struct point3d *point, struct point4d *dest) = transform_point_w_scalar;
+void (*transform_point4d)(struct matrix *matrix, struct point4d *point, struct point4d *dest) = transform_point4d_scalar;
+void (*transform_depths)(struct matrix *matrix, float *x, float *y, float *z, float *dest, unsigned int count) = transform_depths_scalar;
+void (*transpose_matrix)(struct matrix *matrix, struct matrix *dest) = transpose_matrix_scalar;
+void (*multiply_matrix)(struct matrix *a, struct matrix *b, struct matrix *dest) = multiply_matrix_scalar;
+
+int cpu_has_sse()
+{
+#ifdef _MSC_VER
+	int regs[4];
+
+	__cpuid(regs, 1);
+
+	return (regs[3] >> 25) & 1;
+#else
+	unsigned int eax, ebx, ecx, edx;
+
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+
+	return (edx >> 25) & 1;
+#endif
+}
+
+// select the fastest version of each routine, returns nonzero if SSE is used
+//
+// transform_point_w stays scalar, its SSE version is no faster as measured by
+// replay/matrix_bench
+int matrix_init()
+{
+	if(!cpu_has_sse()) return 0;
+
+	transform_point = transform_point_sse;
+	transform_point4d = transform_point4d_sse;
+	transform_depths = transform_depths_sse;
+	transpose_matrix = transpose_matrix_sse;
+	multiply_matrix = multiply_matrix_sse;
+
+	return 1;
 }
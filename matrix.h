@@ -26,6 +26,14 @@
 #define M_PI       3.14159265358979323846f
 #define DEG2RAD(X) ((X) * (M_PI/180.0f))
 
+// for matrices owned by the driver, keeps them within a cache line and on the
+// alignment SSE loads prefer, matrices inside game structures can't be moved
+#ifdef _MSC_VER
+#define MATRIX_ALIGN __declspec(align(16))
+#else
+#define MATRIX_ALIGN __attribute__((aligned(16)))
+#endif
+
 struct matrix
 {
 	union
@@ -77,11 +85,18 @@ float vector_length(struct point3d *vector);
 void normalize_vector(struct point3d *vector);
 float dot_product(struct point3d *a, struct point3d *b);
 void cross_product(struct point3d *a, struct point3d *b, struct point3d *dest);
-void transform_point(struct matrix *matrix, struct point3d *point, struct point3d *dest);
-void transform_point_w(struct matrix *matrix, struct point3d *point, struct point4d *dest);
-void transform_point4d(struct matrix *matrix, struct point4d *point, struct point4d *dest);
-void transpose_matrix(struct matrix *matrix, struct matrix *dest);
-void multiply_matrix(struct matrix *a, struct matrix *b, struct matrix *dest);
+void transform_point_scalar(struct matrix *matrix, struct point3d *point, struct point3d *dest);
+void transform_point_w_scalar(struct matrix *matrix, struct point3d *point, struct point4d *dest);
+void transform_point4d_scalar(struct matrix *matrix, struct point4d *point, struct point4d *dest);
+void transform_depths_scalar(struct matrix *matrix, float *x, float *y, float *z, float *dest, unsigned int count);
+void transpose_matrix_scalar(struct matrix *matrix, struct matrix *dest);
+void multiply_matrix_scalar(struct matrix *a, struct matrix *b, struct matrix *dest);
+void transform_point_sse(struct matrix *matrix, struct point3d *point, struct point3d *dest);
+void transform_point_w_sse(struct matrix *matrix, struct point3d *point, struct point4d *dest);
+void transform_point4d_sse(struct matrix *matrix, struct point4d *point, struct point4d *dest);
+void transform_depths_sse(struct matrix *matrix, float *x, float *y, float *z, float *dest, unsigned int count);
+void transpose_matrix_sse(struct matrix *matrix, struct matrix *dest);
+void multiply_matrix_sse(struct matrix *a, struct matrix *b, struct matrix *dest);
 void multiply_matrix_unary(struct matrix *a, struct matrix *b);
 void identity_matrix(struct matrix *matrix);
 void uniform_scaling_matrix(float scale, struct matrix *matrix);
@@ -92,6 +107,16 @@ void rotation_matrix_z(float angle, struct matrix *matrix);
 void rotate_matrix_x(float angle, struct matrix *matrix);
 void rotate_matrix_y(float angle, struct matrix *matrix);
 void rotate_matrix_z(float angle, struct matrix *matrix);
-void inverse_matrix(struct matrix *matrix, struct matrix *dest);
+int inverse_matrix(struct matrix *matrix, struct matrix *dest);
+
+// runtime selected versions of the routines above, see matrix_init
+extern void (*transform_point)(struct matrix *matrix, struct point3d *point, struct point3d *dest);
+extern void (*transform_point_w)(struct matrix *matrix, struct point3d *point, struct point4d *dest);
+extern void (*transform_point4d)(struct matrix *matrix, struct point4d *point, struct point4d *dest);
+extern void (*transform_depths)(struct matrix *matrix, float *x, float *y, float *z, float *dest, unsigned int count);
+extern void (*transpose_matrix)(struct matrix *matrix, struct matrix *dest);
+extern void (*multiply_matrix)(struct matrix *a, struct matrix *b, struct matrix *dest);
+
+int matrix_init();
 
 #endif
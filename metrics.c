@@ -0,0 +1,222 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * metrics.c - rolling frame time percentiles and counter averages
+ *
+ * Frame times are kept per game mode, both as a histogram over the last
+ * METRICS_WINDOW frames for the show_stats display and as a histogram over the
+ * whole session that is written to metrics_file on exit. Counters from
+ * driver_stats are sampled once per frame, before common_flip resets them, and
+ * averaged the same way. Percentiles are accurate to METRICS_BUCKET_US.
+ *
+ * No game or Windows dependencies, callers pass in the frame time.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "metrics.h"
+
+struct metrics_series metrics_series[METRICS_MAX_SERIES];
+uint num_metrics_series;
+
+struct metrics_counter metrics_counters[METRICS_MAX_COUNTERS];
+uint num_metrics_counters;
+
+// sample value each frame under the given name
+void metrics_add_counter(char *name, uint *value)
+{
+	struct metrics_counter *counter;
+
+	if(num_metrics_counters == METRICS_MAX_COUNTERS) return;
+
+	counter = &metrics_counters[num_metrics_counters++];
+
+	memset(counter, 0, sizeof(*counter));
+	counter->name = name;
+	counter->value = value;
+}
+
+struct metrics_series *metrics_get_series(char *mode)
+{
+	uint i;
+
+	for(i = 0; i < num_metrics_series; i++) if(!strcmp(metrics_series[i].name, mode)) return &metrics_series[i];
+
+	if(num_metrics_series == METRICS_MAX_SERIES) return 0;
+
+	memset(&metrics_series[i], 0, sizeof(metrics_series[i]));
+	metrics_series[i].name = mode;
+
+	return &metrics_series[num_metrics_series++];
+}
+
+uint metrics_bucket(uint us)
+{
+	uint bucket = us / METRICS_BUCKET_US;
+
+	return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
+
+// upper edge of the bucket holding the given fraction of frames, in
+// milliseconds, frames in the overflow bucket are reported as the maximum
+double metrics_percentile(struct frame_histogram *histogram, double fraction, uint max)
+{
+	uint target = (uint)(histogram->count * fraction + 0.5);
+	uint seen = 0;
+	uint i;
+
+	if(!histogram->count) return 0.0;
+
+	if(target < 1) target = 1;
+
+	for(i = 0; i < METRICS_BUCKETS - 1; i++)
+	{
+		seen += histogram->buckets[i];
+
+		if(seen >= target)
+		{
+			double edge = (i + 1) * METRICS_BUCKET_US / 1000.0;
+
+			// never report more than the longest frame
+			return edge < max / 1000.0 ? edge : max / 1000.0;
+		}
+	}
+
+	return max / 1000.0;
+}
+
+// record one frame, mode is the game mode the frame belonged to
+void metrics_frame(char *mode, uint frame_us)
+{
+	struct metrics_series *series = metrics_get_series(mode);
+	uint i;
+
+	if(series)
+	{
+		// the window is full, forget the oldest frame
+		if(series->recent.count == METRICS_WINDOW)
+		{
+			uint old = series->window[series->next];
+
+			series->recent.buckets[metrics_bucket(old)]--;
+			series->recent.sum -= old;
+			series->recent.count--;
+		}
+
+		series->window[series->next] = frame_us;
+		series->next = (series->next + 1) % METRICS_WINDOW;
+
+		series->recent.buckets[metrics_bucket(frame_us)]++;
+		series->recent.sum += frame_us;
+		series->recent.count++;
+
+		series->session.buckets[metrics_bucket(frame_us)]++;
+		series->session.sum += frame_us;
+		series->session.count++;
+		if(frame_us > series->session.max) series->session.max = frame_us;
+	}
+
+	for(i = 0; i < num_metrics_counters; i++)
+	{
+		struct metrics_counter *counter = &metrics_counters[i];
+		uint value = *counter->value;
+
+		if(counter->frames >= METRICS_WINDOW) counter->recent_sum -= counter->window[counter->next];
+
+		counter->window[counter->next] = value;
+		counter->next = (counter->next + 1) % METRICS_WINDOW;
+
+		counter->recent_sum += value;
+		counter->session_sum += value;
+		counter->frames++;
+		if(value > counter->max) counter->max = value;
+	}
+}
+
+// format the rolling numbers for the current mode for the show_stats display
+void metrics_print(char *mode, char *buffer, uint size)
+{
+	struct metrics_series *series = metrics_get_series(mode);
+	uint len = 0;
+	uint i;
+
+	buffer[0] = 0;
+
+	if(series && series->recent.count)
+	{
+		uint max = 0;
+		int ret;
+
+		// the rolling maximum isn't tracked incrementally
+		for(i = 0; i < series->recent.count; i++) if(series->window[i] > max) max = series->window[i];
+
+		ret = _snprintf(buffer, size, "frame time: avg %.2f, p50 %.2f, p95 %.2f, p99 %.2f, max %.2f ms\n", series->recent.sum / series->recent.count / 1000.0, metrics_percentile(&series->recent, 0.50, max), metrics_percentile(&series->recent, 0.95, max), metrics_percentile(&series->recent, 0.99, max), max / 1000.0);
+
+		if(ret > 0) len = ret;
+	}
+
+	for(i = 0; i < num_metrics_counters && len < size; i++)
+	{
+		struct metrics_counter *counter = &metrics_counters[i];
+		uint frames = counter->frames < METRICS_WINDOW ? counter->frames : METRICS_WINDOW;
+		int ret;
+
+		if(!frames) break;
+
+		ret = _snprintf(&buffer[len], size - len, "avg %s: %.1f\n", counter->name, counter->recent_sum / frames);
+
+		if(ret < 0) break;
+
+		len += ret;
+	}
+
+	buffer[size - 1] = 0;
+}
+
+// write session totals as CSV, one line per mode and one per counter
+bool metrics_dump(char *filename)
+{
+	FILE *f = fopen(filename, "w");
+	uint i;
+
+	if(!f) return false;
+
+	fprintf(f, "kind,name,frames,avg,p50,p95,p99,max\n");
+
+	for(i = 0; i < num_metrics_series; i++)
+	{
+		struct frame_histogram *session = &metrics_series[i].session;
+
+		fprintf(f, "frame_ms,%s,%u,%.3f,%.2f,%.2f,%.2f,%.3f\n", metrics_series[i].name, session->count, session->sum / session->count / 1000.0, metrics_percentile(session, 0.50, session->max), metrics_percentile(session, 0.95, session->max), metrics_percentile(session, 0.99, session->max), session->max / 1000.0);
+	}
+
+	for(i = 0; i < num_metrics_counters; i++)
+	{
+		struct metrics_counter *counter = &metrics_counters[i];
+
+		if(!counter->frames) continue;
+
+		fprintf(f, "counter,%s,%u,%.2f,,,,%u\n", counter->name, counter->frames, counter->session_sum / counter->frames, counter->max);
+	}
+
+	fclose(f);
+
+	return true;
+}
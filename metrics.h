@@ -0,0 +1,76 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * metrics.h - rolling frame time percentiles and counter averages
+ */
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include "types.h"
+
+// frames in the rolling window, 10 seconds at 60fps
+#define METRICS_WINDOW 600
+
+// histogram resolution, frames longer than METRICS_BUCKETS * METRICS_BUCKET_US
+// all end up in the last bucket
+#define METRICS_BUCKET_US 250
+#define METRICS_BUCKETS 400
+
+#define METRICS_MAX_SERIES 32
+#define METRICS_MAX_COUNTERS 16
+
+struct frame_histogram
+{
+	uint buckets[METRICS_BUCKETS];
+	uint count;
+	double sum;
+	uint max;
+};
+
+// frame times for one game mode
+struct metrics_series
+{
+	char *name;
+	// last METRICS_WINDOW frame times in microseconds
+	uint window[METRICS_WINDOW];
+	uint next;
+	struct frame_histogram recent;
+	struct frame_histogram session;
+};
+
+// per-frame value of a driver_stats counter
+struct metrics_counter
+{
+	char *name;
+	uint *value;
+	uint window[METRICS_WINDOW];
+	uint next;
+	uint frames;
+	double recent_sum;
+	double session_sum;
+	uint max;
+};
+
+void metrics_add_counter(char *name, uint *value);
+void metrics_frame(char *mode, uint frame_us);
+void metrics_print(char *mode, char *buffer, uint size);
+bool metrics_dump(char *filename);
+
+#endif
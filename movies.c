@@ -69,11 +69,15 @@ void movie_init()
 	movies->loop = (void *)GetProcAddress(movie_lib, "loop");
 	movies->stop_movie = (void *)GetProcAddress(movie_lib, "stop_movie");
 	movies->get_movie_frame = (void *)GetProcAddress(movie_lib, "get_movie_frame");
+	movies->draw_current_frame = (void *)GetProcAddress(movie_lib, "draw_current_frame");
+	// optional, movies are prepared synchronously without it
+	movies->prepare_movie_async = (void *)GetProcAddress(movie_lib, "prepare_movie_async");
 
 	if(!(movies->movie_init && 
 		movies->prepare_movie && 
 		movies->release_movie_objects && 
 		movies->update_movie_sample && 
+		movies->draw_current_frame && 
 		movies->loop && 
 		movies->stop_movie &&
 		movies->get_movie_frame))
@@ -99,7 +103,10 @@ bool ff7_prepare_movie(char *name, uint loop, struct dddevice **dddevice, uint d
 	ff7_externals.movie_object->global_movie_flag = 0;
 	ff7_externals.movie_object->field_E0 = !((struct ff7_game_obj *)common_externals.get_game_object())->field_968;
 
-	movies->prepare_movie(name);
+	// opened and probed in the background, the plugin waits for it when the
+	// movie is first used
+	if(movies->prepare_movie_async) movies->prepare_movie_async(name);
+	else movies->prepare_movie(name);
 
 	ff7_externals.movie_object->global_movie_flag = 1;
 
@@ -183,15 +190,16 @@ uint ff7_get_movie_frame()
 }
 
 uint ff8_movie_frames;
+char ff8_movie_name[512];
 
 void ff8_prepare_movie(unsigned char disc, unsigned char movie)
 {
-	char fmvName[512];
+	char *fmvName = ff8_movie_name;
 	char camName[512];
 	FILE *camFile;
-	uint camOffset = 0;
+	uint camSize;
 
-	_snprintf(fmvName, sizeof(fmvName), "%s/data/movies/disc%02i_%02ih.avi", basedir, disc, movie);
+	_snprintf(fmvName, sizeof(ff8_movie_name), "%s/data/movies/disc%02i_%02ih.avi", basedir, disc, movie);
 	_snprintf(camName, sizeof(camName), "%s/data/movies/disc%02i_%02i.cam", basedir, disc, movie);
 
 	if(trace_all || trace_movies) trace("prepare_movie %s\n", fmvName);
@@ -203,16 +211,27 @@ void ff8_prepare_movie(unsigned char disc, unsigned char movie)
 		if(!camFile)
 		{
 			error("could not load camera data from %s\n", camName);
+
+			// don't let start_movie open it anyway
+			ff8_movie_name[0] = 0;
+			ff8_movie_frames = 0;
 			return;
 		}
-		
-		while(!feof(camFile) && !ferror(camFile))
-		{
-			uint res = fread(&ff8_externals.movie_object->camdata_buffer[camOffset], 1, 4096, camFile);
 
-			if(res > 0) camOffset += res;
+		fseek(camFile, 0, SEEK_END);
+		camSize = ftell(camFile);
+		fseek(camFile, 0, SEEK_SET);
+
+		if(camSize > sizeof(ff8_externals.movie_object->camdata_buffer))
+		{
+			glitch("camera data in %s is too big, truncating\n", camName);
+			camSize = sizeof(ff8_externals.movie_object->camdata_buffer);
 		}
 
+		if(fread(ff8_externals.movie_object->camdata_buffer, 1, camSize, camFile) != camSize) error("could not read camera data from %s\n", camName);
+
+		fclose(camFile);
+
 		ff8_externals.movie_object->movie_intro_pak = false;
 	}
 	else ff8_externals.movie_object->movie_intro_pak = true;
@@ -222,7 +241,9 @@ void ff8_prepare_movie(unsigned char disc, unsigned char movie)
 
 	ff8_externals.movie_object->movie_frame = 0;
 
-	ff8_movie_frames = movies->prepare_movie(fmvName);
+	// the frame count isn't needed until the movie starts
+	if(movies->prepare_movie_async) movies->prepare_movie_async(fmvName);
+	else ff8_movie_frames = movies->prepare_movie(fmvName);
 }
 
 void ff8_release_movie_objects()
@@ -236,6 +257,9 @@ void ff8_start_movie()
 {
 	if(trace_all || trace_movies) trace("start_movie\n");
 
+	// picks up the movie prepared in the background
+	if(movies->prepare_movie_async && ff8_movie_name[0]) ff8_movie_frames = movies->prepare_movie(ff8_movie_name);
+
 	if(ff8_externals.movie_object->movie_intro_pak) ff8_externals.movie_object->field_2 = ff8_movie_frames;
 	else
 	{
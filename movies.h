@@ -35,6 +35,7 @@ struct movie_plugin
 	void (*loop)();
 	void (*stop_movie)();
 	uint (*get_movie_frame)();
+	void (*prepare_movie_async)(char *);
 };
 
 void movie_init();
@@ -0,0 +1,317 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * profile.c - hierarchical zone profiler, see PROFILE in compile_cfg.h
+ *
+ * Zones are opened and closed with PROFILE_BEGIN() and PROFILE_END() and may
+ * nest. Each thread records its closed zones into its own ring buffer so
+ * recording never takes a lock, older events are overwritten once the ring is
+ * full. Ctrl+F10 writes the contents of all rings to profile_<frame>.json in
+ * the game directory as a Chrome trace (chrome://tracing or
+ * ui.perfetto.dev). The time spent in each zone on the main thread during the
+ * last frame is shown through the show_stats option.
+ *
+ * Nothing in here is compiled without PROFILE.
+ */
+
+#include <windows.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "log.h"
+#include "common.h"
+#include "globals.h"
+
+#ifdef PROFILE
+
+// events kept per thread, about 1.5MB each
+#define PROFILE_RING_SIZE (64 * 1024)
+
+#define PROFILE_MAX_DEPTH 32
+#define PROFILE_MAX_THREADS 16
+
+// distinct zones shown ingame
+#define PROFILE_MAX_TOTALS 16
+
+struct profile_event
+{
+	const char *name;
+	time_t start;
+	time_t end;
+};
+
+struct profile_zone
+{
+	const char *name;
+	time_t start;
+};
+
+struct profile_thread
+{
+	uint id;
+	char *name;
+	// number of events ever recorded, the ring holds the last
+	// PROFILE_RING_SIZE of them
+	volatile uint head;
+	// first event of the current frame
+	uint frame_start;
+	uint depth;
+	struct profile_zone stack[PROFILE_MAX_DEPTH];
+	struct profile_event events[PROFILE_RING_SIZE];
+};
+
+struct profile_total
+{
+	const char *name;
+	time_t time;
+	uint calls;
+};
+
+DWORD profile_tls = TLS_OUT_OF_INDEXES;
+
+CRITICAL_SECTION profile_lock;
+struct profile_thread *profile_threads[PROFILE_MAX_THREADS];
+uint num_profile_threads;
+
+struct profile_total profile_totals[PROFILE_MAX_TOTALS];
+uint num_profile_totals;
+
+time_t profile_frequency;
+
+bool profile_key;
+
+// must be called before any other thread is started
+void profile_init()
+{
+	if(profile_tls != TLS_OUT_OF_INDEXES) return;
+
+	profile_tls = TlsAlloc();
+
+	if(profile_tls == TLS_OUT_OF_INDEXES) error("couldn't allocate profiler thread storage\n");
+
+	InitializeCriticalSection(&profile_lock);
+	QueryPerformanceFrequency((LARGE_INTEGER *)&profile_frequency);
+}
+
+struct profile_thread *profile_get_thread()
+{
+	struct profile_thread *thread;
+
+	if(profile_tls == TLS_OUT_OF_INDEXES) return 0;
+
+	thread = TlsGetValue(profile_tls);
+
+	if(thread) return thread;
+
+	EnterCriticalSection(&profile_lock);
+
+	if(num_profile_threads < PROFILE_MAX_THREADS)
+	{
+		thread = driver_calloc(sizeof(*thread), 1);
+		thread->id = GetCurrentThreadId();
+		thread->name = num_profile_threads ? "thread" : "main";
+
+		profile_threads[num_profile_threads++] = thread;
+
+		TlsSetValue(profile_tls, thread);
+	}
+
+	LeaveCriticalSection(&profile_lock);
+
+	if(!thread) glitch_once("too many threads to profile\n");
+
+	return thread;
+}
+
+// name the calling thread in the trace
+void profile_thread(char *name)
+{
+	struct profile_thread *thread = profile_get_thread();
+
+	if(thread) thread->name = name;
+}
+
+void profile_begin(const char *name)
+{
+	struct profile_thread *thread = profile_get_thread();
+
+	if(!thread) return;
+
+	// zones deeper than this are silently merged into their parent
+	if(thread->depth < PROFILE_MAX_DEPTH)
+	{
+		thread->stack[thread->depth].name = name;
+		QueryPerformanceCounter((LARGE_INTEGER *)&thread->stack[thread->depth].start);
+	}
+
+	thread->depth++;
+}
+
+void profile_end()
+{
+	struct profile_thread *thread = profile_get_thread();
+	struct profile_event *event;
+
+	if(!thread) return;
+
+	if(!thread->depth)
+	{
+		unexpected_once("PROFILE_END without PROFILE_BEGIN\n");
+		return;
+	}
+
+	thread->depth--;
+
+	if(thread->depth >= PROFILE_MAX_DEPTH) return;
+
+	event = &thread->events[thread->head % PROFILE_RING_SIZE];
+
+	event->name = thread->stack[thread->depth].name;
+	event->start = thread->stack[thread->depth].start;
+	QueryPerformanceCounter((LARGE_INTEGER *)&event->end);
+
+	thread->head++;
+}
+
+// add up the zones the calling thread closed since the last call
+void profile_frame()
+{
+	struct profile_thread *thread = profile_get_thread();
+	uint i, j;
+
+	if(!thread) return;
+
+	num_profile_totals = 0;
+
+	if(thread->head - thread->frame_start > PROFILE_RING_SIZE) thread->frame_start = thread->head - PROFILE_RING_SIZE;
+
+	for(i = thread->frame_start; i != thread->head; i++)
+	{
+		struct profile_event *event = &thread->events[i % PROFILE_RING_SIZE];
+
+		for(j = 0; j < num_profile_totals; j++) if(profile_totals[j].name == event->name) break;
+
+		if(j == num_profile_totals)
+		{
+			if(num_profile_totals == PROFILE_MAX_TOTALS) continue;
+
+			profile_totals[j].name = event->name;
+			profile_totals[j].time = 0;
+			profile_totals[j].calls = 0;
+			num_profile_totals++;
+		}
+
+		profile_totals[j].time += event->end - event->start;
+		profile_totals[j].calls++;
+	}
+
+	thread->frame_start = thread->head;
+}
+
+// format the last frame's totals for the show_stats display
+void profile_print_totals(char *buffer, uint size)
+{
+	uint i;
+	uint len = 0;
+
+	buffer[0] = 0;
+
+	for(i = 0; i < num_profile_totals && len < size; i++)
+	{
+		int ret = _snprintf(&buffer[len], size - len, "%s: %I64u us (%u)\n", profile_totals[i].name, (profile_totals[i].time * 1000000) / profile_frequency, profile_totals[i].calls);
+
+		if(ret < 0) break;
+
+		len += ret;
+	}
+
+	buffer[size - 1] = 0;
+}
+
+// write all rings out as a Chrome trace
+void profile_dump()
+{
+	char filename[BASEDIR_LENGTH + 1024];
+	double us_per_tick = 1000000.0 / profile_frequency;
+	time_t origin = 0;
+	uint events = 0;
+	FILE *f;
+	uint i, j;
+
+	_snprintf(filename, sizeof(filename), "%s/profile_%u.json", basedir, frame_counter);
+
+	f = fopen(filename, "w");
+
+	if(!f)
+	{
+		error("couldn't open %s for writing\n", filename);
+		return;
+	}
+
+	EnterCriticalSection(&profile_lock);
+
+	// timestamps are relative to the oldest event still around
+	for(i = 0; i < num_profile_threads; i++)
+	{
+		struct profile_thread *thread = profile_threads[i];
+		uint first = thread->head > PROFILE_RING_SIZE ? thread->head - PROFILE_RING_SIZE : 0;
+
+		if(thread->head && (!origin || thread->events[first % PROFILE_RING_SIZE].start < origin)) origin = thread->events[first % PROFILE_RING_SIZE].start;
+	}
+
+	fprintf(f, "{\"traceEvents\":[\n");
+
+	for(i = 0; i < num_profile_threads; i++)
+	{
+		struct profile_thread *thread = profile_threads[i];
+		uint head = thread->head;
+		// leave some room for events recorded while we're writing
+		uint first = head > PROFILE_RING_SIZE / 2 ? head - PROFILE_RING_SIZE / 2 : 0;
+
+		fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", thread->id, thread->name);
+
+		for(j = first; j != head; j++)
+		{
+			struct profile_event *event = &thread->events[j % PROFILE_RING_SIZE];
+
+			fprintf(f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.1f,\"dur\":%.1f},\n", event->name, thread->id, (event->start - origin) * us_per_tick, (event->end - event->start) * us_per_tick);
+		}
+
+		events += head - first;
+	}
+
+	LeaveCriticalSection(&profile_lock);
+
+	fprintf(f, "{}]}\n");
+	fclose(f);
+
+	info("wrote %u profiler events to %s\n", events, filename);
+}
+
+// dump the rings on Ctrl+F10
+void profile_poll()
+{
+	bool key = (GetAsyncKeyState(VK_CONTROL) & 0x8000) && (GetAsyncKeyState(VK_F10) & 0x8000);
+
+	if(key && !profile_key) profile_dump();
+
+	profile_key = key;
+}
+
+#endif
@@ -0,0 +1,277 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * replay/lgp_bench.c - benchmark for the hashed LGP table of contents index
+ *
+ * Builds a synthetic archive TOC laid out the way the game expects it, with
+ * files named like those in char.lgp and battle.lgp, grouped by their two
+ * character lookup table bucket and a share of names that exist in several
+ * directories, then resolves every file through the game's lookup table
+ * search, the full archive scan used when the lookup table is broken and the
+ * hashed index in lgp.c. Exits with an error if the
+ * index ever disagrees with the lookup table.
+ *
+ * Build on Linux:
+ *
+ *   gcc -O2 -o lgp_bench replay/lgp_bench.c lgp.c
+ *
+ * Usage: lgp_bench [files] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "../lgp.h"
+
+// every CONFLICT_EVERY-th name exists in several directories
+#define CONFLICT_EVERY 20
+#define MAX_DIRS 3
+
+struct query
+{
+	char name[16];
+	char dir[128];
+	int expected;
+};
+
+struct lgp_toc_entry *toc;
+struct lookup_table_entry lookup_table[30 * 30];
+struct conflict_list conflicts[1000];
+struct query *queries;
+uint num_files;
+uint num_queries;
+
+double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// same bucket mapping as lgp_lookup_value in ff7/file.c
+int lookup_value(unsigned char c)
+{
+	if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+
+	if(c == '.') return -1;
+
+	if(c < 'a' && c >= '0' && c <= '9') c += 'a' - '0';
+
+	if(c == '_') c = 'k';
+	if(c == '-') c = 'l';
+
+	return c - 'a';
+}
+
+uint bucket(char *name)
+{
+	return lookup_value(name[0]) * 30 + lookup_value(name[1]) + 1;
+}
+
+int compare_names(const void *a, const void *b)
+{
+	uint ba = bucket((char *)a);
+	uint bb = bucket((char *)b);
+
+	if(ba != bb) return ba < bb ? -1 : 1;
+
+	return strcmp((char *)a, (char *)b);
+}
+
+// the game's lookup, as in the original lgp_open_file
+int lookup_table_search(char *name, char *dir)
+{
+	struct lookup_table_entry *entry = &lookup_table[bucket(name)];
+	uint i, j;
+
+	for(i = 0; i < entry->num_files; i++)
+	{
+		struct lgp_toc_entry *toc_entry = &toc[entry->toc_offset + i - 1];
+
+		if(strcasecmp(toc_entry->name, name)) continue;
+
+		if(!toc_entry->conflict) return entry->toc_offset + i - 1;
+
+		for(j = 0; j < conflicts[toc_entry->conflict - 1].num_conflicts; j++)
+		{
+			struct conflict_entry *conflict = &conflicts[toc_entry->conflict - 1].conflict_entries[j];
+
+			if(!strcasecmp(conflict->name, dir)) return conflict->toc_index;
+		}
+
+		return -1;
+	}
+
+	return -1;
+}
+
+// fallback used by the game's lookup when the table is broken
+int full_scan(char *name, char *dir)
+{
+	uint i;
+
+	for(i = 0; i < num_files; i++)
+	{
+		if(!strcasecmp(toc[i].name, name) && !toc[i].conflict) return i;
+	}
+
+	return -1;
+}
+
+// names are unique per directory, conflicting names get one TOC entry per
+// directory and share a conflict list
+void build_archive(uint files)
+{
+	char (*names)[16] = calloc(files, 16);
+	uint num_conflicts = 0;
+	uint i, j;
+
+	// model archives name their files with a four letter counter, which piles
+	// them up in a handful of lookup table buckets
+	for(i = 0; i < files; i++) sprintf(names[i], "%c%c%c%c.%s", 'a' + (i / (26 * 26 * 26)) % 26, 'a' + (i / (26 * 26)) % 26, 'a' + (i / 26) % 26, 'a' + i % 26, i % 3 ? "p" : "tex");
+
+	qsort(names, files, 16, compare_names);
+
+	toc = calloc(files * MAX_DIRS, sizeof(*toc));
+	queries = calloc(files * MAX_DIRS, sizeof(*queries));
+
+	for(i = 0; i < files; i++)
+	{
+		uint n = 1;
+
+		if(i % CONFLICT_EVERY == 0 && num_conflicts < 1000) n = 2 + rand() % (MAX_DIRS - 1);
+
+		for(j = 0; j < n; j++)
+		{
+			strcpy(toc[num_files + j].name, names[i]);
+			toc[num_files + j].offset = (num_files + j) * 4096;
+
+			strcpy(queries[num_queries].name, names[i]);
+			// mix up the case like the game does
+			queries[num_queries].name[0] -= 'a' - 'A';
+
+			if(n > 1)
+			{
+				struct conflict_list *conflict = &conflicts[num_conflicts];
+
+				if(!j) conflict->conflict_entries = calloc(n, sizeof(struct conflict_entry));
+
+				conflict->num_conflicts = n;
+				sprintf(conflict->conflict_entries[j].name, "field/dir%u", j);
+				conflict->conflict_entries[j].toc_index = num_files + j;
+				toc[num_files + j].conflict = num_conflicts + 1;
+
+				strcpy(queries[num_queries].dir, conflict->conflict_entries[j].name);
+				queries[num_queries].dir[0] = 'F';
+			}
+
+			queries[num_queries].expected = num_files + j;
+			num_queries++;
+		}
+
+		if(n > 1) num_conflicts++;
+
+		num_files += n;
+	}
+
+	for(i = 0; i < num_files; i++)
+	{
+		struct lookup_table_entry *entry = &lookup_table[bucket(toc[i].name)];
+
+		if(!entry->num_files) entry->toc_offset = i + 1;
+		entry->num_files++;
+	}
+
+	// the game doesn't open files in TOC order
+	for(i = num_queries - 1; i > 0; i--)
+	{
+		struct query tmp = queries[i];
+
+		j = rand() % (i + 1);
+		queries[i] = queries[j];
+		queries[j] = tmp;
+	}
+
+	free(names);
+}
+
+int main(int argc, char **argv)
+{
+	uint files = argc > 1 ? atoi(argv[1]) : 10000;
+	uint iterations = argc > 2 ? atoi(argv[2]) : 100;
+	struct lgp_index index;
+	struct lgp_index_entry *entries;
+	uint size, iter, i;
+	uint mismatches = 0;
+	uint scan_queries = 0;
+	double start, build_time, t[3];
+	volatile int sink = 0;
+
+	if(!files || !iterations)
+	{
+		fprintf(stderr, "usage: %s [files] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	srand(1);
+
+	build_archive(files);
+
+	size = lgp_index_size(toc, num_files, conflicts);
+	entries = malloc(sizeof(*entries) * size);
+
+	start = now();
+	for(iter = 0; iter < iterations; iter++) lgp_build_index(&index, entries, size, toc, num_files, conflicts);
+	build_time = (now() - start) * 1000000.0 / iterations;
+
+	for(i = 0; i < num_queries; i++)
+	{
+		bool resolved;
+		int ret = lgp_index_lookup(&index, queries[i].name, queries[i].dir, &resolved);
+
+		if(ret != lookup_table_search(queries[i].name, queries[i].dir) || ret != queries[i].expected || resolved != (queries[i].dir[0] != 0))
+		{
+			if(mismatches++ < 10) fprintf(stderr, "mismatch: %s (%s) = %i, expected %i\n", queries[i].name, queries[i].dir, ret, queries[i].expected);
+		}
+
+		if(!queries[i].dir[0]) scan_queries++;
+	}
+
+	start = now();
+	for(iter = 0; iter < iterations; iter++) for(i = 0; i < num_queries; i++) sink += lookup_table_search(queries[i].name, queries[i].dir);
+	t[0] = (now() - start) * 1000000000.0 / ((double)iterations * num_queries);
+
+	// only names without conflicts can be found by the full scan
+	start = now();
+	for(iter = 0; iter < iterations; iter++) for(i = 0; i < num_queries; i++) if(!queries[i].dir[0]) sink += full_scan(queries[i].name, queries[i].dir);
+	t[1] = (now() - start) * 1000000000.0 / ((double)iterations * scan_queries);
+
+	start = now();
+	for(iter = 0; iter < iterations; iter++) for(i = 0; i < num_queries; i++) sink += lgp_index_lookup(&index, queries[i].name, queries[i].dir, 0);
+	t[2] = (now() - start) * 1000000000.0 / ((double)iterations * num_queries);
+
+	printf("{\"toc_entries\": %u, \"lookups\": %u, \"index_entries\": %u, \"build_us\": %.1f, \"lookup_table_ns\": %.1f, \"full_scan_ns\": %.1f, \"index_ns\": %.1f, \"mismatches\": %u}\n", num_files, num_queries, size, build_time, t[0], t[1], t[2], mismatches);
+
+	return mismatches ? 1 : 0;
+}
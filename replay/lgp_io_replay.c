@@ -0,0 +1,249 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * replay/lgp_io_replay.c - replays a recorded LGP access pattern
+ *
+ * Reads the access trace written by the driver (io_trace_file, see
+ * ff7/iotrace.c) and performs the same reads against local copies of the LGP
+ * archives, either the way the original code does it with a seek and a read
+ * for every access or by copying out of a memory mapping. Files outside the
+ * archives are skipped. Run it after dropping the system file cache to
+ * measure cold loads, or twice in a row for warm ones.
+ *
+ * Build on Linux:
+ *
+ *   gcc -O2 -o lgp_io_replay replay/lgp_io_replay.c
+ *
+ * Usage: lgp_io_replay trace.csv lgp_dir [fread|mmap] [repeat]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAX_ARCHIVES 32
+
+struct archive
+{
+	char name[32];
+	FILE *f;
+	unsigned char *data;
+	size_t size;
+	unsigned int reads;
+	unsigned long long bytes;
+	double time;
+};
+
+struct access
+{
+	int archive;
+	int read;
+	unsigned int offset;
+	unsigned int size;
+	double recorded_us;
+};
+
+struct archive archives[MAX_ARCHIVES];
+int num_archives;
+
+struct access *accesses;
+unsigned int num_accesses;
+
+double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+int open_archive(char *dir, char *name, int use_mmap)
+{
+	struct archive *a;
+	char path[1024];
+	int i;
+
+	for(i = 0; i < num_archives; i++) if(!strcmp(archives[i].name, name)) return i;
+
+	if(num_archives == MAX_ARCHIVES) return -1;
+
+	a = &archives[num_archives];
+	snprintf(a->name, sizeof(a->name), "%s", name);
+	snprintf(path, sizeof(path), "%s/%s.lgp", dir, name);
+
+	a->f = fopen(path, "rb");
+
+	if(!a->f)
+	{
+		fprintf(stderr, "couldn't open %s, skipping its accesses\n", path);
+		return -1;
+	}
+
+	if(use_mmap)
+	{
+		struct stat s;
+
+		fstat(fileno(a->f), &s);
+		a->size = s.st_size;
+		a->data = mmap(0, a->size, PROT_READ, MAP_SHARED, fileno(a->f), 0);
+
+		if(a->data == MAP_FAILED)
+		{
+			fprintf(stderr, "couldn't map %s\n", path);
+			fclose(a->f);
+			return -1;
+		}
+	}
+
+	return num_archives++;
+}
+
+void load_trace(char *filename, char *dir, int use_mmap)
+{
+	FILE *f = fopen(filename, "r");
+	char line[2048];
+	unsigned int max = 0;
+
+	if(!f)
+	{
+		fprintf(stderr, "couldn't open %s\n", filename);
+		exit(1);
+	}
+
+	// header
+	fgets(line, sizeof(line), f);
+
+	while(fgets(line, sizeof(line), f))
+	{
+		char op[16], archive[32];
+		double time, duration;
+		unsigned int offset, size;
+		int index;
+
+		if(sscanf(line, "%lf,%lf,%15[^,],%31[^,],%u,%u,", &time, &duration, op, archive, &offset, &size) != 6) continue;
+
+		if(!strcmp(archive, "-")) continue;
+		if(strcmp(op, "read") && strcmp(op, "seek")) continue;
+
+		index = open_archive(dir, archive, use_mmap);
+		if(index < 0) continue;
+
+		if(num_accesses == max)
+		{
+			max = max ? max * 2 : 4096;
+			accesses = realloc(accesses, sizeof(*accesses) * max);
+		}
+
+		accesses[num_accesses].archive = index;
+		accesses[num_accesses].read = !strcmp(op, "read");
+		accesses[num_accesses].offset = offset;
+		accesses[num_accesses].size = size;
+		accesses[num_accesses].recorded_us = duration;
+		num_accesses++;
+	}
+
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	int use_mmap;
+	unsigned int repeat, iter, i;
+	unsigned int max_size = 0;
+	unsigned char *buffer;
+	double recorded = 0.0, total = 0.0;
+	unsigned int checksum = 0;
+
+	if(argc < 3)
+	{
+		fprintf(stderr, "usage: %s trace.csv lgp_dir [fread|mmap] [repeat]\n", argv[0]);
+		return 1;
+	}
+
+	use_mmap = argc > 3 && !strcmp(argv[3], "mmap");
+	repeat = argc > 4 ? atoi(argv[4]) : 1;
+
+	load_trace(argv[1], argv[2], use_mmap);
+
+	for(i = 0; i < num_accesses; i++)
+	{
+		if(accesses[i].size > max_size) max_size = accesses[i].size;
+		recorded += accesses[i].recorded_us;
+	}
+
+	buffer = malloc(max_size + 1);
+
+	for(iter = 0; iter < repeat; iter++)
+	{
+		for(i = 0; i < num_accesses; i++)
+		{
+			struct access *access = &accesses[i];
+			struct archive *a = &archives[access->archive];
+			double start = now();
+			double elapsed;
+			size_t size = 0;
+
+			if(use_mmap)
+			{
+				// seeks only move the read position when mapped
+				if(access->read && access->offset < a->size)
+				{
+					size = access->size;
+					if(size > a->size - access->offset) size = a->size - access->offset;
+					memcpy(buffer, &a->data[access->offset], size);
+				}
+			}
+			else
+			{
+				fseek(a->f, access->offset, SEEK_SET);
+				if(access->read) size = fread(buffer, 1, access->size, a->f);
+			}
+
+			if(size) checksum += buffer[size - 1];
+
+			elapsed = now() - start;
+
+			a->time += elapsed;
+			total += elapsed;
+
+			if(access->read)
+			{
+				a->reads++;
+				a->bytes += size;
+			}
+		}
+	}
+
+	printf("{\"mode\": \"%s\", \"accesses\": %u, \"repeat\": %u, \"recorded_ms\": %.3f, \"replayed_ms\": %.3f, \"checksum\": %u, \"archives\": [", use_mmap ? "mmap" : "fread", num_accesses, repeat, recorded / 1000.0, total * 1000.0 / repeat, checksum);
+
+	for(i = 0; i < (unsigned int)num_archives; i++)
+	{
+		printf("%s\n\t{\"archive\": \"%s\", \"reads\": %u, \"bytes\": %llu, \"ms\": %.3f}", i ? "," : "", archives[i].name, archives[i].reads / repeat, archives[i].bytes / repeat, archives[i].time * 1000.0 / repeat);
+	}
+
+	printf("\n]}\n");
+
+	return 0;
+}
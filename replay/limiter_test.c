@@ -0,0 +1,238 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * replay/limiter_test.c - accuracy and jitter test for the frame limiter
+ *
+ * Runs limiter.c against a simulated clock with a deterministic model of
+ * sleep overshoot and per-frame game work, or against the real clock with
+ * -r. Reports how far the average frame rate is from the requested one, how
+ * late frames end relative to their deadline and how much of the waiting was
+ * spent spinning. Exits with an error if the frame rate drifts or frames end
+ * later than TOLERANCE_US in the simulated runs without random spikes.
+ *
+ * Build on Linux:
+ *
+ *   gcc -O2 -o limiter_test replay/limiter_test.c limiter.c
+ *
+ * Usage: limiter_test [-r] [frames]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../limiter.h"
+
+// 99% of simulated frames must end within this long after their deadline
+#define TOLERANCE_US 50.0
+
+// allowed difference between the average and the requested frame rate
+#define MAX_RATE_ERROR 0.0001
+
+struct sleep_model
+{
+	char *name;
+	// sleeps wake up on a multiple of this, in microseconds, 0 for none
+	uint granularity;
+	// random extra delay up to this many microseconds
+	uint jitter;
+	// one in this many sleeps takes spike microseconds longer
+	uint spike_every;
+	uint spike;
+	// spikes can't be predicted, only the frame rate is checked
+	bool unpredictable;
+};
+
+struct sleep_model models[] = {
+	{"high resolution timer", 0, 200, 0, 0, false},
+	{"1ms timer", 1000, 300, 0, 0, false},
+	{"15.6ms timer", 15625, 500, 0, 0, false},
+	{"occasional 4ms spikes", 0, 200, 50, 4000, true},
+};
+
+// simulated time in nanoseconds
+time_t sim_time;
+struct sleep_model *sim_model;
+unsigned int rng = 1;
+
+unsigned int next_random()
+{
+	rng = rng * 1103515245 + 12345;
+
+	return (rng >> 16) & 0x7FFF;
+}
+
+time_t sim_now(void *context)
+{
+	// every clock read takes a little while
+	sim_time += 100;
+
+	return sim_time;
+}
+
+void sim_sleep(void *context, uint us)
+{
+	time_t wake = sim_time + us * (time_t)1000;
+
+	if(sim_model->granularity)
+	{
+		time_t granularity = sim_model->granularity * (time_t)1000;
+
+		wake = (wake + granularity - 1) / granularity * granularity;
+	}
+
+	wake += (time_t)(next_random() % (sim_model->jitter + 1)) * 1000;
+
+	if(sim_model->spike_every && next_random() % sim_model->spike_every == 0) wake += sim_model->spike * (time_t)1000;
+
+	sim_time = wake;
+}
+
+time_t real_now(void *context)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * (time_t)1000000000 + ts.tv_nsec;
+}
+
+void real_sleep(void *context, uint us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+
+	nanosleep(&ts, 0);
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+	double da = *(double *)a;
+	double db = *(double *)b;
+
+	return da < db ? -1 : da > db;
+}
+
+// returns non-zero if the run failed
+int run(struct limiter_clock *clock, char *name, double framerate, uint frames, int simulated, int check_lateness)
+{
+	struct frame_limiter limiter;
+	double *lateness = malloc(sizeof(double) * frames);
+	double ticks_per_us = clock->frequency / 1000000.0;
+	double rate, rate_error, waited;
+	time_t first = 0, now = 0;
+	uint i;
+	int failed;
+
+	limiter_init(&limiter, clock);
+
+	for(i = 0; i < frames; i++)
+	{
+		// game work, between a tenth and two thirds of the frame
+		uint work_us = (uint)(1000000.0 / framerate * (0.1 + (next_random() % 1000) / 1000.0 * 0.57));
+
+		if(simulated) sim_time += work_us * (time_t)1000;
+		else
+		{
+			time_t end = clock->now(clock->context) + (time_t)(work_us * ticks_per_us);
+
+			while(clock->now(clock->context) < end);
+		}
+
+		limiter_wait(&limiter, framerate);
+
+		now = clock->now(clock->context);
+		lateness[i] = (now - limiter.deadline) / ticks_per_us;
+
+		if(i == 0) first = now;
+	}
+
+	rate = (frames - 1) / ((now - first) / clock->frequency);
+	rate_error = (rate - framerate) / framerate;
+	waited = limiter.slept + limiter.spun;
+
+	qsort(lateness, frames, sizeof(double), compare_doubles);
+
+	failed = simulated && (rate_error > MAX_RATE_ERROR || rate_error < -MAX_RATE_ERROR || (check_lateness && lateness[frames * 99 / 100] > TOLERANCE_US));
+
+	printf("\t{\"clock\": \"%s\", \"framerate\": %.0f, \"measured\": %.4f, \"rate_error\": %.6f, \"late_p50_us\": %.1f, \"late_p99_us\": %.1f, \"late_max_us\": %.1f, \"spin_share\": %.3f, \"overshoot_us\": %.1f, \"ok\": %s}", name, framerate, rate, rate_error, lateness[frames / 2], lateness[frames * 99 / 100], lateness[frames - 1], waited > 0.0 ? limiter.spun / waited : 0.0, limiter.overshoot / ticks_per_us, failed ? "false" : "true");
+
+	free(lateness);
+
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	double framerates[] = {15.0, 30.0, 60.0};
+	struct limiter_clock clock;
+	int real = argc > 1 && !strcmp(argv[1], "-r");
+	uint frames = argc > 1 + real ? atoi(argv[1 + real]) : (real ? 300 : 20000);
+	int failed = 0;
+	int first = 1;
+	uint i, j;
+
+	if(frames < 2)
+	{
+		fprintf(stderr, "usage: %s [-r] [frames]\n", argv[0]);
+		return 1;
+	}
+
+	printf("[\n");
+
+	for(i = 0; i < sizeof(framerates) / sizeof(framerates[0]); i++)
+	{
+		if(real)
+		{
+			clock.now = real_now;
+			clock.sleep = real_sleep;
+			clock.frequency = 1000000000.0;
+			clock.context = 0;
+
+			if(!first) printf(",\n");
+			failed |= run(&clock, "real", framerates[i], frames, 0, 0);
+			first = 0;
+			continue;
+		}
+
+		for(j = 0; j < sizeof(models) / sizeof(models[0]); j++)
+		{
+			sim_model = &models[j];
+			sim_time = 0;
+
+			clock.now = sim_now;
+			clock.sleep = sim_sleep;
+			clock.frequency = 1000000000.0;
+			clock.context = 0;
+
+			if(!first) printf(",\n");
+			failed |= run(&clock, models[j].name, framerates[i], frames, 1, !models[j].unpredictable);
+			first = 0;
+		}
+	}
+
+	printf("\n]\n");
+
+	return failed;
+}
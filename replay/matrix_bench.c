@@ -0,0 +1,259 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * replay/matrix_bench.c - checks and times the SSE matrix routines
+ *
+ * Runs every routine with a runtime selected version in matrix.c on the same
+ * random input in its scalar and SSE form, reports the largest relative
+ * difference between the two and the time per call of each. Exits with an
+ * error if any routine strays from the scalar result by more than TOLERANCE.
+ *
+ * Build on Linux:
+ *
+ *   gcc -O2 -o matrix_bench replay/matrix_bench.c matrix.c -lm
+ *
+ * Usage: matrix_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "../matrix.h"
+
+// float rounding differs as the SSE code sums in a different order
+#define TOLERANCE 0.00001
+
+#define COUNT 1024
+
+MATRIX_ALIGN struct matrix matrices[COUNT];
+MATRIX_ALIGN struct matrix results[2][COUNT];
+struct point3d points3[COUNT];
+struct point4d points4[COUNT];
+struct point3d results3[2][COUNT];
+struct point4d results4[2][COUNT];
+float xs[COUNT], ys[COUNT], zs[COUNT];
+float depths[2][COUNT];
+
+unsigned int iterations;
+int failed = 0;
+int first = 1;
+
+double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+float frand()
+{
+	return rand() / (float)RAND_MAX * 2.0f - 1.0f;
+}
+
+// largest difference relative to the magnitude of the scalar result
+double compare(float *scalar, float *sse, unsigned int count)
+{
+	double max_diff = 0.0;
+	unsigned int i;
+
+	for(i = 0; i < count; i++)
+	{
+		double diff = fabs(scalar[i] - sse[i]) / (fabs(scalar[i]) > 1.0 ? fabs(scalar[i]) : 1.0);
+
+		if(diff > max_diff) max_diff = diff;
+	}
+
+	return max_diff;
+}
+
+void report(char *name, double diff, double scalar_time, double sse_time)
+{
+	if(diff > TOLERANCE) failed = 1;
+
+	printf("%s\t{\"routine\": \"%s\", \"max_diff\": %g, \"scalar_ns\": %.2f, \"sse_ns\": %.2f, \"speedup\": %.2f}", first ? "" : ",\n", name, diff, scalar_time, sse_time, scalar_time / sse_time);
+
+	first = 0;
+}
+
+// nanoseconds per call of body over all inputs
+#define TIME(result, body) { uint iter; unsigned int i; double start = now(); for(iter = 0; iter < iterations; iter++) for(i = 0; i < COUNT; i++) { body; } result = (now() - start) * 1000000000.0 / ((double)iterations * COUNT); }
+
+void bench_multiply()
+{
+	double t[2];
+
+	TIME(t[0], multiply_matrix_scalar(&matrices[i], &matrices[(i + 1) % COUNT], &results[0][i]));
+	TIME(t[1], multiply_matrix_sse(&matrices[i], &matrices[(i + 1) % COUNT], &results[1][i]));
+
+	report("multiply_matrix", compare(&results[0][0]._11, &results[1][0]._11, COUNT * 16), t[0], t[1]);
+}
+
+void bench_transpose()
+{
+	double t[2];
+
+	TIME(t[0], transpose_matrix_scalar(&matrices[i], &results[0][i]));
+	TIME(t[1], transpose_matrix_sse(&matrices[i], &results[1][i]));
+
+	report("transpose_matrix", compare(&results[0][0]._11, &results[1][0]._11, COUNT * 16), t[0], t[1]);
+}
+
+void bench_transform_point()
+{
+	double t[2];
+
+	TIME(t[0], transform_point_scalar(&matrices[i], &points3[i], &results3[0][i]));
+	TIME(t[1], transform_point_sse(&matrices[i], &points3[i], &results3[1][i]));
+
+	report("transform_point", compare(&results3[0][0].x, &results3[1][0].x, COUNT * 3), t[0], t[1]);
+}
+
+void bench_transform_point_w()
+{
+	double t[2];
+
+	TIME(t[0], transform_point_w_scalar(&matrices[i], &points3[i], &results4[0][i]));
+	TIME(t[1], transform_point_w_sse(&matrices[i], &points3[i], &results4[1][i]));
+
+	report("transform_point_w", compare(&results4[0][0].x, &results4[1][0].x, COUNT * 4), t[0], t[1]);
+}
+
+void bench_transform_point4d()
+{
+	double t[2];
+
+	TIME(t[0], transform_point4d_scalar(&matrices[i], &points4[i], &results4[0][i]));
+	TIME(t[1], transform_point4d_sse(&matrices[i], &points4[i], &results4[1][i]));
+
+	report("transform_point4d", compare(&results4[0][0].x, &results4[1][0].x, COUNT * 4), t[0], t[1]);
+}
+
+// per point rather than per call, odd count to cover the scalar tail
+void bench_transform_depths()
+{
+	unsigned int count = COUNT - 3;
+	unsigned int iter;
+	double start, t[2];
+
+	start = now();
+	for(iter = 0; iter < iterations; iter++) transform_depths_scalar(&matrices[iter % COUNT], xs, ys, zs, depths[0], count);
+	t[0] = (now() - start) * 1000000000.0 / ((double)iterations * count);
+
+	start = now();
+	for(iter = 0; iter < iterations; iter++) transform_depths_sse(&matrices[iter % COUNT], xs, ys, zs, depths[1], count);
+	t[1] = (now() - start) * 1000000000.0 / ((double)iterations * count);
+
+	report("transform_depths", compare(depths[0], depths[1], count), t[0], t[1]);
+}
+
+// routines that may be built on top of the dispatched ones, timed through the
+// dispatch before and after matrix_init, inverse_matrix always uses the scalar
+// routines and is only here to check its result
+void bench_dispatched(char *name, int rotate)
+{
+	double t[2];
+	int pass;
+
+	for(pass = 0; pass < 2; pass++)
+	{
+		if(pass == 0)
+		{
+			transform_point = transform_point_scalar;
+			transpose_matrix = transpose_matrix_scalar;
+			multiply_matrix = multiply_matrix_scalar;
+		}
+		else matrix_init();
+
+		if(rotate) TIME(t[pass], memcpy(&results[pass][i], &matrices[i], sizeof(struct matrix)); rotate_matrix_y(1.0f, &results[pass][i]))
+		else TIME(t[pass], inverse_matrix(&matrices[i], &results[pass][i]))
+	}
+
+	report(name, compare(&results[0][0]._11, &results[1][0]._11, COUNT * 16), t[0], t[1]);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int i, j;
+
+	iterations = argc > 1 ? atoi(argv[1]) : 2000;
+
+	if(!iterations)
+	{
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	if(!matrix_init())
+	{
+		fprintf(stderr, "no SSE support\n");
+		return 1;
+	}
+
+	srand(1);
+
+	// rotation and translation with some perspective like terms in the last
+	// column, the rotation part is orthonormal so inverse_matrix accepts it
+	for(i = 0; i < COUNT; i++)
+	{
+		identity_matrix(&matrices[i]);
+		rotate_matrix_x(frand() * 3.0f, &matrices[i]);
+		rotate_matrix_y(frand() * 3.0f, &matrices[i]);
+		rotate_matrix_z(frand() * 3.0f, &matrices[i]);
+		matrices[i]._41 = frand() * 100.0f;
+		matrices[i]._42 = frand() * 100.0f;
+		matrices[i]._43 = frand() * 100.0f + 200.0f;
+
+		points3[i].x = frand() * 50.0f;
+		points3[i].y = frand() * 50.0f;
+		points3[i].z = frand() * 50.0f;
+		points4[i].x = points3[i].x;
+		points4[i].y = points3[i].y;
+		points4[i].z = points3[i].z;
+		points4[i].w = 1.0f;
+
+		xs[i] = points3[i].x;
+		ys[i] = points3[i].y;
+		zs[i] = points3[i].z;
+	}
+
+	// depth needs a w that varies with z
+	for(i = 0; i < COUNT; i++) for(j = 0; j < 4; j++) if(i & 1) matrices[i].m[j][3] = j == 2 ? 1.0f : 0.0f;
+
+	printf("[\n");
+
+	bench_multiply();
+	bench_transpose();
+	bench_transform_point();
+	bench_transform_point_w();
+	bench_transform_point4d();
+	bench_transform_depths();
+	bench_dispatched("inverse_matrix", 0);
+	bench_dispatched("rotate_matrix_y", 1);
+
+	printf("\n]\n");
+
+	if(failed) fprintf(stderr, "SSE results differ from the scalar versions by more than %g\n", TOLERANCE);
+
+	return failed;
+}
@@ -0,0 +1,332 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * replay/movie_sync_test.c - A/V sync and audio throughput test for the movie
+ * plugin's audio path
+ *
+ * Plays a synthetic movie in real time through ffmpeg_movies/audio.c: a
+ * decoder thread writes one frame's worth of PCM at a time into the audio
+ * ring, the null sink plays it on a clock that can run slightly fast or slow
+ * or start late like a real sound device, and video frames are presented
+ * on their own clock which is pulled towards the audio clock with
+ * audio_sync_correction the same way update_movie_sample does it. Reports
+ * how far each presented frame is from the audio clock and exits with an
+ * error if the p99 error goes over TOLERANCE_MS once the clocks have locked.
+ * Also measures how fast the ring moves data with nothing holding it back.
+ *
+ * Build on Linux:
+ *
+ *   gcc -O2 -pthread -o movie_sync_test replay/movie_sync_test.c ffmpeg_movies/audio.c -lm
+ *
+ * Usage: movie_sync_test [-o file.wav] [seconds]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../ffmpeg_movies/audio.h"
+
+#define FPS 15.0
+#define SAMPLE_RATE 22050
+#define CHANNELS 2
+#define BITS 16
+
+// seconds of decoded audio the decoder can get ahead, as in the plugin
+#define AUDIO_RING_SIZE 2
+
+// frames presented before this many seconds are not counted, the clocks are
+// still locking on
+#define SETTLE_TIME 1.0
+
+// p99 distance of a presented frame from the audio clock
+#define TOLERANCE_MS 5.0
+
+struct device_model
+{
+	char *name;
+	// the sound device clock runs this much faster than the system clock
+	double drift;
+	// and starts playing this many seconds after it was told to
+	double latency;
+};
+
+struct device_model models[] =
+{
+	{"exact", 0.0, 0.0},
+	{"fast 0.5%", 0.005, 0.0},
+	{"slow 0.5%", -0.005, 0.0},
+	{"start latency 50ms", 0.0, 0.05},
+	{"slow 1%, latency 30ms", -0.01, 0.03},
+};
+
+struct device
+{
+	struct device_model *model;
+	double start;
+};
+
+struct decoder
+{
+	struct audio_ring *ring;
+	uint frames;
+	volatile int quit;
+	double tone;
+};
+
+double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+void sleep_ms(double ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = (long)(ms * 1000000.0);
+
+	nanosleep(&ts, 0);
+}
+
+// what the sound device thinks the time is
+double device_now(void *context)
+{
+	struct device *device = context;
+	double t = now() - device->start - device->model->latency;
+
+	if(t < 0.0) t = 0.0;
+
+	return device->start + t * (1.0 + device->model->drift);
+}
+
+int compare(const void *a, const void *b)
+{
+	double x = *(double *)a;
+	double y = *(double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+// one frame of a sine tone per step, like audio interleaved with video in an
+// AVI, waiting for room in the ring when too far ahead
+void *decoder_main(void *parameter)
+{
+	struct decoder *decoder = parameter;
+	uint samples = (uint)(SAMPLE_RATE / FPS);
+	short *buffer = malloc(samples * CHANNELS * 2);
+	uint frame, i;
+
+	for(frame = 0; frame < decoder->frames && !decoder->quit; frame++)
+	{
+		char *data = (char *)buffer;
+		uint size = samples * CHANNELS * 2;
+
+		for(i = 0; i < samples; i++)
+		{
+			buffer[i * 2] = (short)(sin(decoder->tone) * 8000.0);
+			buffer[i * 2 + 1] = buffer[i * 2];
+			decoder->tone += 2.0 * 3.14159265358979 * 440.0 / SAMPLE_RATE;
+		}
+
+		while(size && !decoder->quit)
+		{
+			uint written = audio_ring_write(decoder->ring, data, size);
+
+			data += written;
+			size -= written;
+
+			if(size) sleep_ms(1.0);
+		}
+	}
+
+	free(buffer);
+
+	return 0;
+}
+
+int run(struct device_model *model, double seconds, char *filename, int first)
+{
+	struct audio_ring ring;
+	struct audio_sink *sink;
+	struct device device;
+	struct decoder decoder;
+	pthread_t thread;
+	uint frames = (uint)(seconds * FPS);
+	double *errors = malloc(frames * sizeof(double));
+	uint num_errors = 0;
+	double start_time;
+	double max = 0.0;
+	double sum = 0.0;
+	double p99;
+	uint frame;
+
+	audio_ring_init(&ring, SAMPLE_RATE * CHANNELS * 2 * AUDIO_RING_SIZE);
+
+	device.model = model;
+	device.start = now();
+
+	sink = audio_null_sink(&ring, CHANNELS, SAMPLE_RATE, BITS, filename, device_now, &device);
+
+	decoder.ring = &ring;
+	decoder.frames = frames + (uint)FPS;
+	decoder.quit = 0;
+	decoder.tone = 0.0;
+
+	pthread_create(&thread, 0, decoder_main, &decoder);
+
+	// let the decoder get ahead a bit, like the game does between
+	// prepare_movie and the first update_movie_sample
+	sleep_ms(50.0);
+
+	sink->update(sink);
+	device.start = now();
+	sink->start(sink);
+	start_time = now();
+
+	for(frame = 0; frame < frames; frame++)
+	{
+		double t;
+
+		// sync_to_audio
+		if(frame > 0 && sink->update(sink)) start_time += audio_sync_correction(now() - start_time, sink->clock(sink));
+
+		// wait for this frame's presentation time
+		while((t = now() - start_time) < frame / FPS)
+		{
+			if(frame / FPS - t > 0.002) sleep_ms(1.0);
+			sink->update(sink);
+		}
+
+		sink->update(sink);
+
+		if(t > SETTLE_TIME)
+		{
+			double error = fabs(frame / FPS - sink->clock(sink)) * 1000.0;
+
+			errors[num_errors++] = error;
+			sum += error;
+			if(error > max) max = error;
+		}
+	}
+
+	decoder.quit = 1;
+	pthread_join(thread, 0);
+
+	sink->release(sink);
+	audio_ring_free(&ring);
+
+	qsort(errors, num_errors, sizeof(double), compare);
+	p99 = num_errors ? errors[(uint)(num_errors * 0.99)] : 0.0;
+
+	printf("%s\t{\"model\": \"%s\", \"frames\": %u, \"mean_error_ms\": %.3f, \"p99_error_ms\": %.3f, \"max_error_ms\": %.3f}", first ? "" : ",\n", model->name, num_errors, num_errors ? sum / num_errors : 0.0, p99, max);
+
+	free(errors);
+
+	return p99 > TOLERANCE_MS;
+}
+
+void *throughput_reader(void *parameter)
+{
+	struct decoder *decoder = parameter;
+	char buffer[4096];
+	uint total = 0;
+
+	while(total < decoder->frames) total += audio_ring_read(decoder->ring, buffer, sizeof(buffer));
+
+	return 0;
+}
+
+// move data through the ring as fast as both sides can go
+void throughput()
+{
+	struct audio_ring ring;
+	struct decoder reader;
+	pthread_t thread;
+	uint total = 256 * 1024 * 1024;
+	char buffer[4410];
+	uint written = 0;
+	double start;
+
+	audio_ring_init(&ring, SAMPLE_RATE * CHANNELS * 2 * AUDIO_RING_SIZE);
+	memset(buffer, 0, sizeof(buffer));
+
+	reader.ring = &ring;
+	reader.frames = total;
+
+	start = now();
+
+	pthread_create(&thread, 0, throughput_reader, &reader);
+
+	while(written < total)
+	{
+		uint size = total - written < sizeof(buffer) ? total - written : sizeof(buffer);
+
+		written += audio_ring_write(&ring, buffer, size);
+	}
+
+	pthread_join(thread, 0);
+
+	printf(",\n\t{\"ring_throughput_mb_per_s\": %.1f, \"realtime_factor\": %.0f}", total / (now() - start) / (1024.0 * 1024.0), total / (now() - start) / (SAMPLE_RATE * CHANNELS * 2));
+
+	audio_ring_free(&ring);
+}
+
+int main(int argc, char *argv[])
+{
+	char *filename = 0;
+	double seconds = 3.0;
+	int failed = 0;
+	uint i;
+
+	if(argc > 2 && !strcmp(argv[1], "-o"))
+	{
+		filename = argv[2];
+		argc -= 2;
+		argv += 2;
+	}
+
+	if(argc > 2 || (argc == 2 && (seconds = atof(argv[1])) <= SETTLE_TIME))
+	{
+		fprintf(stderr, "usage: movie_sync_test [-o file.wav] [seconds]\n");
+		return 1;
+	}
+
+	printf("[\n");
+
+	// only the first run is written to the file
+	for(i = 0; i < sizeof(models) / sizeof(models[0]); i++) failed |= run(&models[i], seconds, i ? 0 : filename, i == 0);
+
+	throughput();
+
+	printf("\n]\n");
+
+	if(failed) fprintf(stderr, "presented frames are more than %gms away from the audio clock\n", TOLERANCE_MS);
+
+	return failed;
+}
@@ -0,0 +1,425 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * replay/oit_diff.c - compares weighted blended transparency to sorting
+ *
+ * Renders synthetic scenes of overlapping alpha blended quads over opaque
+ * geometry twice on a headless EGL context, once sorted far to near with the
+ * depth keys and radix sort from gl/zsort.c and once unsorted through the
+ * transparency targets of gl/oit.c, then reports how far the two images are
+ * apart. Mesa's software rasterizer is enough to run it.
+ *
+ * Both paths follow the driver and hold the transparent quads back until the
+ * end of the frame, the late_opaque scene submits its opaque quads after the
+ * transparent ones to check they still hide them.
+ *
+ * Build on Linux the same way as the replayer:
+ *
+ *   gcc -O2 -fms-extensions -Iinc -I. -o oit_diff replay/oit_diff.c gl/oit.c gl/zsort.c -lGLEW -lEGL -lGL
+ *
+ * Usage: oit_diff [-s shaders/oit.frag] [-o prefix]
+ *
+ * With -o the sorted and composited images of each scene are written to
+ * <prefix><scene>_sorted.tga and <prefix><scene>_oit.tga.
+ */
+
+#include <gl/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../types.h"
+#include "../gl.h"
+
+#define SIZE 256
+
+// channel difference above which a pixel counts as different
+#define THRESHOLD 8
+
+// globals normally provided by the driver
+uint internal_size_x = SIZE;
+uint internal_size_y = SIZE;
+
+GLuint indirect_texture;
+GLuint indirect_fbo;
+
+struct quad
+{
+	float x, y, w, h;
+	float z;
+	unsigned char color[4];
+};
+
+struct scene
+{
+	char *name;
+	uint quads;
+	uint min_alpha;
+	uint max_alpha;
+	// opaque geometry is submitted after the transparent quads
+	bool late_opaque;
+};
+
+// from barely overlapping to heavily layered effects
+struct scene scenes[] = {
+	{"single",        1,  64, 192, false},
+	{"sparse",       16,  64, 192, false},
+	{"layered",      64,  64, 192, false},
+	{"dense_faint", 256,  16,  64, false},
+	{"dense_solid", 256, 160, 240, false},
+	{"late_opaque",  64,  64, 192, true},
+};
+
+struct quad opaque[8];
+struct quad transparent[256];
+
+uint keys[256];
+uint order[256];
+uint scratch[256];
+
+unsigned char sorted_pixels[SIZE * SIZE * 4];
+unsigned char oit_pixels[SIZE * SIZE * 4];
+
+float frand(float min, float max)
+{
+	return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+void random_quad(struct quad *quad, float min_size, float max_size, uint min_alpha, uint max_alpha)
+{
+	quad->w = frand(min_size, max_size);
+	quad->h = frand(min_size, max_size);
+	quad->x = frand(-1.0f, 1.0f - quad->w);
+	quad->y = frand(-1.0f, 1.0f - quad->h);
+	quad->z = frand(-0.9f, 0.9f);
+	quad->color[0] = rand() & 0xFF;
+	quad->color[1] = rand() & 0xFF;
+	quad->color[2] = rand() & 0xFF;
+	quad->color[3] = min_alpha + rand() % (max_alpha - min_alpha + 1);
+}
+
+void draw_quad(struct quad *quad)
+{
+	glColor4ubv(quad->color);
+
+	glBegin(GL_QUADS);
+	glVertex3f(quad->x, quad->y, quad->z);
+	glVertex3f(quad->x + quad->w, quad->y, quad->z);
+	glVertex3f(quad->x + quad->w, quad->y + quad->h, quad->z);
+	glVertex3f(quad->x, quad->y + quad->h, quad->z);
+	glEnd();
+}
+
+void begin_frame()
+{
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, indirect_fbo);
+	glViewport(0, 0, SIZE, SIZE);
+
+	glClearColor(0.2f, 0.3f, 0.4f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+}
+
+// opaque geometry, written to depth like the game would
+void draw_opaque()
+{
+	uint i;
+
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+
+	for(i = 0; i < sizeof(opaque) / sizeof(opaque[0]); i++) draw_quad(&opaque[i]);
+}
+
+// the game's submission order, transparent quads are only queued and drawn
+// by the caller once the frame is done
+void submit_frame(struct scene *scene)
+{
+	begin_frame();
+
+	if(!scene->late_opaque) draw_opaque();
+
+	// queueing the transparent quads draws nothing
+
+	if(scene->late_opaque) draw_opaque();
+}
+
+void read_pixels(unsigned char *pixels)
+{
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+	glReadPixels(0, 0, SIZE, SIZE, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+}
+
+// what gl/deferred.c does, far to near with depth writes
+void render_sorted(struct scene *scene)
+{
+	uint i;
+
+	submit_frame(scene);
+
+	for(i = 0; i < scene->quads; i++) keys[i] = gl_depth_sort_key(transparent[i].z);
+
+	gl_radix_sort(keys, order, scratch, scene->quads);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	for(i = 0; i < scene->quads; i++) draw_quad(&transparent[order[i]]);
+
+	read_pixels(sorted_pixels);
+}
+
+// what gl/deferred.c does in modes listed in oit_modes, submission order
+void render_oit(struct scene *scene)
+{
+	uint i;
+
+	submit_frame(scene);
+
+	glEnable(GL_BLEND);
+
+	gl_begin_oit();
+
+	for(i = 0; i < scene->quads; i++) draw_quad(&transparent[i]);
+
+	gl_end_oit();
+
+	gl_composite_oit();
+
+	read_pixels(oit_pixels);
+}
+
+bool write_tga(char *filename, unsigned char *pixels)
+{
+	unsigned char header[18];
+	FILE *f = fopen(filename, "wb");
+
+	if(!f)
+	{
+		fprintf(stderr, "couldn't open %s for writing\n", filename);
+		return false;
+	}
+
+	memset(header, 0, sizeof(header));
+	header[2] = 2;
+	header[12] = SIZE & 0xFF;
+	header[13] = SIZE >> 8;
+	header[14] = SIZE & 0xFF;
+	header[15] = SIZE >> 8;
+	header[16] = 32;
+	header[17] = 8;
+
+	fwrite(header, sizeof(header), 1, f);
+	fwrite(pixels, SIZE * SIZE * 4, 1, f);
+	fclose(f);
+
+	return true;
+}
+
+char *read_file(char *filename)
+{
+	FILE *f = fopen(filename, "rb");
+	char *buffer;
+	long size;
+
+	if(!f)
+	{
+		fprintf(stderr, "couldn't open %s\n", filename);
+		return 0;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	buffer = malloc(size + 1);
+	buffer[fread(buffer, 1, size, f)] = 0;
+	fclose(f);
+
+	return buffer;
+}
+
+bool load_oit_program(char *filename)
+{
+	char *source = read_file(filename);
+	GLuint shader;
+	GLint status = GL_FALSE;
+	char log[4096];
+
+	if(!source) return false;
+
+	shader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(shader, 1, (const GLchar **)&source, 0);
+	glCompileShader(shader);
+	free(source);
+
+	oit_program = glCreateProgram();
+	glAttachShader(oit_program, shader);
+	glLinkProgram(oit_program);
+	glGetProgramiv(oit_program, GL_LINK_STATUS, &status);
+
+	if(status != GL_TRUE)
+	{
+		glGetProgramInfoLog(oit_program, sizeof(log), 0, log);
+		fprintf(stderr, "failed to link %s:\n%s\n", filename, log);
+		return false;
+	}
+
+	return true;
+}
+
+bool init_context()
+{
+	static const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	static const EGLint surface_attribs[] = {
+		EGL_WIDTH, SIZE,
+		EGL_HEIGHT, SIZE,
+		EGL_NONE
+	};
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay display;
+	EGLConfig config;
+	EGLSurface surface;
+	EGLContext context;
+	EGLint num_configs;
+	GLuint depthbuffer;
+
+	if(get_platform_display) display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+	else display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0) || !eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs < 1)
+	{
+		fprintf(stderr, "could not initialize EGL\n");
+		return false;
+	}
+
+	eglBindAPI(EGL_OPENGL_API);
+
+	surface = eglCreatePbufferSurface(display, config, surface_attribs);
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, 0);
+
+	if(surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context))
+	{
+		fprintf(stderr, "could not create OpenGL context\n");
+		return false;
+	}
+
+	glewExperimental = GL_TRUE;
+	glewInit();
+
+	// same setup as gl_init_indirect
+	glGenTextures(1, &indirect_texture);
+	glBindTexture(GL_TEXTURE_2D, indirect_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SIZE, SIZE, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8, 0);
+
+	glGenFramebuffersEXT(1, &indirect_fbo);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, indirect_fbo);
+
+	glGenRenderbuffersEXT(1, &depthbuffer);
+	glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, depthbuffer);
+	glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT, SIZE, SIZE);
+	glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, depthbuffer);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, indirect_texture, 0);
+
+	if(!gl_init_oit_targets())
+	{
+		fprintf(stderr, "transparency targets not supported by %s\n", glGetString(GL_RENDERER));
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	char *shader = "shaders/oit.frag";
+	char *prefix = 0;
+	char filename[1024];
+	uint s, i;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-s") && i + 1 < argc) shader = argv[++i];
+		else if(!strcmp(argv[i], "-o") && i + 1 < argc) prefix = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: %s [-s shaders/oit.frag] [-o prefix]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if(!init_context() || !load_oit_program(shader)) return 1;
+
+	printf("{\"renderer\": \"%s\", \"threshold\": %u, \"scenes\": [\n", glGetString(GL_RENDERER), THRESHOLD);
+
+	for(s = 0; s < sizeof(scenes) / sizeof(scenes[0]); s++)
+	{
+		struct scene *scene = &scenes[s];
+		uint max_diff = 0, different = 0;
+		double total_diff = 0.0;
+
+		srand(s + 1);
+
+		for(i = 0; i < sizeof(opaque) / sizeof(opaque[0]); i++) random_quad(&opaque[i], 0.2f, 0.8f, 255, 255);
+		for(i = 0; i < scene->quads; i++) random_quad(&transparent[i], 0.1f, 0.6f, scene->min_alpha, scene->max_alpha);
+
+		render_sorted(scene);
+		render_oit(scene);
+
+		for(i = 0; i < SIZE * SIZE; i++)
+		{
+			uint c, pixel_diff = 0;
+
+			for(c = 0; c < 3; c++)
+			{
+				uint diff = abs(sorted_pixels[i * 4 + c] - oit_pixels[i * 4 + c]);
+
+				if(diff > pixel_diff) pixel_diff = diff;
+				total_diff += diff;
+			}
+
+			if(pixel_diff > max_diff) max_diff = pixel_diff;
+			if(pixel_diff > THRESHOLD) different++;
+		}
+
+		printf("\t{\"name\": \"%s\", \"quads\": %u, \"max_diff\": %u, \"mean_diff\": %.3f, \"different_pixels\": %.4f}%s\n",
+			scene->name, scene->quads, max_diff, total_diff / (SIZE * SIZE * 3), different / (double)(SIZE * SIZE), s + 1 < sizeof(scenes) / sizeof(scenes[0]) ? "," : "");
+
+		if(prefix)
+		{
+			snprintf(filename, sizeof(filename), "%s%s_sorted.tga", prefix, scene->name);
+			write_tga(filename, sorted_pixels);
+			snprintf(filename, sizeof(filename), "%s%s_oit.tga", prefix, scene->name);
+			write_tga(filename, oit_pixels);
+		}
+	}
+
+	printf("]}\n");
+
+	return 0;
+}
@@ -0,0 +1,736 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * replay/replay.c - standalone player for frame captures
+ *
+ * Plays back files written with the capture_file option through the same
+ * executor the driver uses (gl/execute.c), on a headless EGL context. Needs
+ * neither the game nor a GPU, Mesa's software rasterizer will do.
+ *
+ * Build on Linux with the system GLEW headers reachable as gl/glew.h:
+ *
+ *   mkdir -p inc && ln -s /usr/include/GL inc/gl
+ *   gcc -O2 -fms-extensions -Iinc -I. -o ff7_replay replay/replay.c gl/execute.c -lGLEW -lEGL -lGL
+ *
+ * Usage: ff7_replay [-n loops] [-o last_frame.tga] capture_file
+ *        ff7_replay -s suite [-n loops] [-f json|csv] [-l label]
+ *
+ * The second form is the renderer benchmark. Every capture listed in the
+ * suite file (see replay/bench_suite.txt) is played back the given number of
+ * times in a fresh context and per-frame averages are written to stdout, the
+ * label (e.g. a commit hash) is copied to the output to help tracking runs.
+ */
+
+#include <gl/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../types.h"
+#include "../gl.h"
+
+// globals normally provided by the driver, filled in from the capture header
+uint width;
+uint height;
+uint x_offset;
+uint y_offset;
+uint output_size_x;
+uint output_size_y;
+uint internal_size_x;
+uint internal_size_y;
+bool indirect_rendering;
+bool fancy_transparency;
+bool use_mipmaps = false;
+
+GLuint indirect_texture;
+GLuint indirect_fbo;
+
+uint main_program;
+uint post_program;
+uint yuv_program;
+
+EGLDisplay display;
+EGLConfig config;
+EGLSurface surface;
+EGLContext context;
+
+char renderer[256];
+
+uint window_width;
+uint window_height;
+
+uint frames_executed;
+
+// capture names to local names
+GLuint *texture_map;
+uint texture_map_max;
+GLuint captured_programs[3];
+GLuint local_programs[3];
+
+// scratch copy of the current frame, names are rewritten in place
+struct cmd_frame frame;
+
+struct bench_result
+{
+	char name[64];
+	uint frames;
+	double cpu_time;
+	double wall_time;
+	uint draw_calls;
+	uint state_changes;
+	unsigned long long bytes_uploaded;
+	uint deferred;
+	uint vertex_count;
+	uint texture_reloads;
+};
+
+struct bench_result result;
+
+void gl_swap_buffers()
+{
+	eglSwapBuffers(display, surface);
+
+	frames_executed++;
+}
+
+void *xrealloc(void *ptr, size_t size)
+{
+	void *ret = realloc(ptr, size);
+
+	if(!ret && size)
+	{
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	return ret;
+}
+
+bool init_display()
+{
+	static const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLint num_configs;
+
+	if(get_platform_display) display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+	else display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0))
+	{
+		fprintf(stderr, "could not initialize EGL\n");
+		return false;
+	}
+
+	if(!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs < 1)
+	{
+		fprintf(stderr, "no suitable EGL config\n");
+		return false;
+	}
+
+	eglBindAPI(EGL_OPENGL_API);
+
+	return true;
+}
+
+// new context and window sized surface for each capture, nothing carries over
+bool init_context()
+{
+	EGLint surface_attribs[] = {
+		EGL_WIDTH, 0,
+		EGL_HEIGHT, 0,
+		EGL_NONE
+	};
+	GLenum err;
+
+	surface_attribs[1] = window_width;
+	surface_attribs[3] = window_height;
+
+	surface = eglCreatePbufferSurface(display, config, surface_attribs);
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, 0);
+
+	if(surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context))
+	{
+		fprintf(stderr, "could not create OpenGL context\n");
+		return false;
+	}
+
+	// GLEW may complain about the missing GLX display, the GL entry points
+	// are loaded regardless
+	glewExperimental = GL_TRUE;
+	err = glewInit();
+
+	if(!glGenFramebuffersEXT || !glCreateProgram)
+	{
+		fprintf(stderr, "glewInit failed: %s\n", glewGetErrorString(err));
+		return false;
+	}
+
+	strncpy(renderer, (char *)glGetString(GL_RENDERER), sizeof(renderer) - 1);
+
+	return true;
+}
+
+void destroy_context()
+{
+	uint i;
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display, context);
+	eglDestroySurface(display, surface);
+
+	// all objects went away with the context
+	memset(texture_map, 0, sizeof(*texture_map) * texture_map_max);
+
+	for(i = 0; i < 3; i++)
+	{
+		captured_programs[i] = 0;
+		local_programs[i] = 0;
+	}
+
+	main_program = 0;
+	post_program = 0;
+	yuv_program = 0;
+	indirect_texture = 0;
+	indirect_fbo = 0;
+}
+
+// same setup as gl_init_indirect
+bool init_indirect()
+{
+	GLuint depthbuffer;
+
+	glGenTextures(1, &indirect_texture);
+	glBindTexture(GL_TEXTURE_2D, indirect_texture);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffersEXT(1, &indirect_fbo);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, indirect_fbo);
+
+	glGenRenderbuffersEXT(1, &depthbuffer);
+	glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, depthbuffer);
+	glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT, internal_size_x, internal_size_y);
+	glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, depthbuffer);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, internal_size_x, internal_size_y, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8, 0);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, indirect_texture, 0);
+
+	if(glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT)
+	{
+		fprintf(stderr, "incomplete framebuffer for indirect rendering\n");
+		return false;
+	}
+
+	return true;
+}
+
+GLuint compile_shader(GLenum type, char *source)
+{
+	GLuint shader = glCreateShader(type);
+	GLint status = GL_FALSE;
+	char log[4096];
+
+	glShaderSource(shader, 1, (const GLchar **)&source, 0);
+	glCompileShader(shader);
+
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+	if(status != GL_TRUE)
+	{
+		glGetShaderInfoLog(shader, sizeof(log), 0, log);
+		fprintf(stderr, "shader compile log:\n%s\n", log);
+	}
+
+	return shader;
+}
+
+void load_shader(struct capture_shader *shader)
+{
+	char *vs = (char *)&shader[1];
+	char *fs = vs + shader->vertex_size;
+	GLuint program;
+	GLint status = GL_FALSE;
+
+	if(shader->kind > PROGRAM_YUV) return;
+
+	captured_programs[shader->kind] = shader->program;
+
+	// programs only need to be built once when looping
+	if(local_programs[shader->kind]) return;
+
+	program = glCreateProgram();
+
+	if(shader->vertex_size) glAttachShader(program, compile_shader(GL_VERTEX_SHADER, vs));
+	if(shader->fragment_size) glAttachShader(program, compile_shader(GL_FRAGMENT_SHADER, fs));
+
+	glLinkProgram(program);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+	if(status != GL_TRUE)
+	{
+		fprintf(stderr, "failed to link captured program %i\n", shader->program);
+		glDeleteProgram(program);
+		return;
+	}
+
+	local_programs[shader->kind] = program;
+
+	switch(shader->kind)
+	{
+		case PROGRAM_MAIN: main_program = program; break;
+		case PROGRAM_POST: post_program = program; break;
+		case PROGRAM_YUV: yuv_program = program; break;
+	}
+}
+
+GLuint map_program(GLuint program)
+{
+	uint i;
+
+	if(!program) return 0;
+
+	for(i = 0; i < 3; i++) if(captured_programs[i] == program) return local_programs[i];
+
+	return 0;
+}
+
+// local texture for a captured name, created on first use
+GLuint map_texture(GLuint texture)
+{
+	if(!texture) return 0;
+
+	if(texture >= texture_map_max)
+	{
+		uint new_max = texture + 1 > texture_map_max * 2 ? texture + 1 : texture_map_max * 2;
+
+		texture_map = xrealloc(texture_map, sizeof(*texture_map) * new_max);
+		memset(&texture_map[texture_map_max], 0, sizeof(*texture_map) * (new_max - texture_map_max));
+		texture_map_max = new_max;
+	}
+
+	if(!texture_map[texture]) glGenTextures(1, &texture_map[texture]);
+
+	return texture_map[texture];
+}
+
+void load_texture(struct capture_texture *texture)
+{
+	glBindTexture(GL_TEXTURE_2D, map_texture(texture->texture));
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texture->width, texture->height, 0, GL_BGRA, GL_UNSIGNED_BYTE, &texture[1]);
+
+	result.bytes_uploaded += texture->width * texture->height * 4;
+}
+
+// copy a captured frame and translate all object names
+void prepare_frame(struct capture_frame *header)
+{
+	struct gl_cmd *cmds = (struct gl_cmd *)&header[1];
+	unsigned char *data = (unsigned char *)&cmds[header->num_cmds];
+	uint i, j;
+
+	if(header->num_cmds > frame.max_cmds)
+	{
+		frame.max_cmds = header->num_cmds;
+		frame.cmds = xrealloc(frame.cmds, sizeof(*frame.cmds) * frame.max_cmds);
+	}
+
+	if(header->data_size > frame.data_max)
+	{
+		frame.data_max = header->data_size;
+		frame.data = xrealloc(frame.data, frame.data_max);
+	}
+
+	memcpy(frame.cmds, cmds, sizeof(*cmds) * header->num_cmds);
+	memcpy(frame.data, data, header->data_size);
+	frame.num_cmds = header->num_cmds;
+	frame.data_size = header->data_size;
+	frame.fence = 0;
+
+	result.deferred += header->deferred;
+	result.vertex_count += header->vertex_count;
+	result.texture_reloads += header->texture_reloads;
+
+	for(i = 0; i < frame.num_cmds; i++)
+	{
+		struct gl_cmd *cmd = &frame.cmds[i];
+
+		switch(cmd->type)
+		{
+			case CMD_DRAW:
+				cmd->u.draw.program = map_program(cmd->u.draw.program);
+				cmd->u.draw.state.texture_handle = map_texture(cmd->u.draw.state.texture_handle);
+				cmd->u.draw.yuv_textures[0] = map_texture(cmd->u.draw.yuv_textures[0]);
+				cmd->u.draw.yuv_textures[1] = map_texture(cmd->u.draw.yuv_textures[1]);
+				result.bytes_uploaded += sizeof(struct nvertex) * cmd->u.draw.vertexcount + sizeof(word) * cmd->u.draw.count;
+				break;
+
+			case CMD_COPY_FRAMEBUFFER:
+				cmd->u.copy.texture = map_texture(cmd->u.copy.texture);
+				break;
+
+			// the captured name may be reused for a new texture after this
+			case CMD_DELETE_TEXTURES:
+				for(j = 0; j < cmd->u.del.count; j++)
+				{
+					GLuint *texture = &((GLuint *)&frame.data[cmd->u.del.textures])[j];
+					GLuint local = map_texture(*texture);
+
+					texture_map[*texture] = 0;
+					*texture = local;
+				}
+				break;
+		}
+	}
+}
+
+bool play(unsigned char *buffer, uint size)
+{
+	uint pos = sizeof(struct capture_header);
+
+	while(pos + sizeof(struct capture_record) <= size)
+	{
+		struct capture_record *record = (struct capture_record *)&buffer[pos];
+		void *payload = &record[1];
+
+		pos += sizeof(*record) + record->size;
+
+		if(pos > size)
+		{
+			fprintf(stderr, "truncated capture\n");
+			return false;
+		}
+
+		switch(record->type)
+		{
+			case CAPTURE_SHADER:
+				load_shader(payload);
+				break;
+
+			case CAPTURE_TEXTURE:
+				load_texture(payload);
+				break;
+
+			case CAPTURE_FRAME:
+				prepare_frame(payload);
+
+				if(!gl_execute_frame(&frame))
+				{
+					fprintf(stderr, "unknown command in frame %i\n", frames_executed);
+					return false;
+				}
+				break;
+
+			default:
+				fprintf(stderr, "unknown record type %i\n", record->type);
+				return false;
+		}
+	}
+
+	return true;
+}
+
+// release everything a previous pass created so each loop starts fresh
+void reset_textures()
+{
+	uint i;
+
+	for(i = 0; i < texture_map_max; i++)
+	{
+		if(texture_map[i]) glDeleteTextures(1, &texture_map[i]);
+		texture_map[i] = 0;
+	}
+}
+
+bool write_tga(char *filename)
+{
+	unsigned char header[18];
+	uint size = window_width * window_height * 4;
+	unsigned char *pixels = xrealloc(0, size);
+	FILE *f = fopen(filename, "wb");
+
+	if(!f)
+	{
+		fprintf(stderr, "couldn't open %s for writing\n", filename);
+		free(pixels);
+		return false;
+	}
+
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, window_width, window_height, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+
+	// uncompressed true color, bottom-up rows just like glReadPixels
+	memset(header, 0, sizeof(header));
+	header[2] = 2;
+	header[12] = window_width & 0xFF;
+	header[13] = window_width >> 8;
+	header[14] = window_height & 0xFF;
+	header[15] = window_height >> 8;
+	header[16] = 32;
+	header[17] = 8;
+
+	fwrite(header, sizeof(header), 1, f);
+	fwrite(pixels, size, 1, f);
+	fclose(f);
+
+	free(pixels);
+
+	return true;
+}
+
+double now(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// play a capture file loops times, fills in result
+bool run_capture(char *filename, uint loops, char *output)
+{
+	struct capture_header *header;
+	unsigned char *buffer;
+	double wall_start, cpu_start;
+	uint size, i;
+	bool ret = false;
+	FILE *f = fopen(filename, "rb");
+
+	if(!f)
+	{
+		fprintf(stderr, "couldn't open %s\n", filename);
+		return false;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	buffer = xrealloc(0, size);
+
+	if(fread(buffer, 1, size, f) != size)
+	{
+		fprintf(stderr, "couldn't read %s\n", filename);
+		fclose(f);
+		free(buffer);
+		return false;
+	}
+
+	fclose(f);
+
+	header = (struct capture_header *)buffer;
+
+	if(size < sizeof(*header) || header->magic != CAPTURE_MAGIC || header->version != CAPTURE_VERSION)
+	{
+		fprintf(stderr, "%s is not a capture file this replayer understands\n", filename);
+		free(buffer);
+		return false;
+	}
+
+	width = header->width;
+	height = header->height;
+	internal_size_x = header->internal_size_x;
+	internal_size_y = header->internal_size_y;
+	output_size_x = header->output_size_x;
+	output_size_y = header->output_size_y;
+	x_offset = header->x_offset;
+	y_offset = header->y_offset;
+	indirect_rendering = header->indirect_rendering;
+	fancy_transparency = header->fancy_transparency;
+
+	window_width = output_size_x + 2 * x_offset;
+	window_height = output_size_y + 2 * y_offset;
+
+	if(!init_context())
+	{
+		free(buffer);
+		return false;
+	}
+
+	if(!indirect_rendering || init_indirect())
+	{
+		gl_init_render_state();
+
+		memset(&execute_stats, 0, sizeof(execute_stats));
+		frames_executed = 0;
+
+		wall_start = now(CLOCK_MONOTONIC);
+		cpu_start = now(CLOCK_PROCESS_CPUTIME_ID);
+
+		for(i = 0; i < loops; i++)
+		{
+			if(i) reset_textures();
+
+			if(!play(buffer, size)) break;
+		}
+
+		glFinish();
+
+		result.cpu_time = now(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+		result.wall_time = now(CLOCK_MONOTONIC) - wall_start;
+		result.frames = frames_executed;
+		result.draw_calls = execute_stats.draw_calls;
+		result.state_changes = execute_stats.state_changes;
+
+		ret = i == loops;
+
+		if(ret && output) ret = write_tga(output);
+	}
+
+	destroy_context();
+	free(buffer);
+
+	return ret;
+}
+
+// per-frame averages of a benchmark result
+double per_frame(double value)
+{
+	return result.frames ? value / result.frames : 0.0;
+}
+
+void print_result(char *format, char *label, bool first)
+{
+	if(!strcmp(format, "csv"))
+	{
+		if(first) printf("label,capture,frames,cpu_ms,wall_ms,draw_calls,state_changes,bytes_uploaded,deferred_layers,vertices,texture_reloads\n");
+
+		printf("%s,%s,%u,%.4f,%.4f,%.1f,%.1f,%.0f,%.1f,%.1f,%.1f\n", label, result.name, result.frames,
+			per_frame(result.cpu_time * 1000.0), per_frame(result.wall_time * 1000.0), per_frame(result.draw_calls),
+			per_frame(result.state_changes), per_frame((double)result.bytes_uploaded), per_frame(result.deferred),
+			per_frame(result.vertex_count), per_frame(result.texture_reloads));
+	}
+	else
+	{
+		printf("%s\n    {\"capture\": \"%s\", \"frames\": %u, \"cpu_ms\": %.4f, \"wall_ms\": %.4f, \"draw_calls\": %.1f, "
+			"\"state_changes\": %.1f, \"bytes_uploaded\": %.0f, \"deferred_layers\": %.1f, \"vertices\": %.1f, \"texture_reloads\": %.1f}",
+			first ? "" : ",", result.name, result.frames,
+			per_frame(result.cpu_time * 1000.0), per_frame(result.wall_time * 1000.0), per_frame(result.draw_calls),
+			per_frame(result.state_changes), per_frame((double)result.bytes_uploaded), per_frame(result.deferred),
+			per_frame(result.vertex_count), per_frame(result.texture_reloads));
+	}
+}
+
+void print_json_header(char *label, uint loops)
+{
+	printf("{\"label\": \"%s\", \"renderer\": \"%s\", \"loops\": %u, \"results\": [", label, renderer, loops);
+}
+
+// suite files list one capture per line as "name path", # starts a comment
+bool run_suite(char *suite, uint loops, char *format, char *label)
+{
+	char line[1024];
+	char name[64];
+	char path[960];
+	uint count = 0;
+	bool ret = true;
+	FILE *f = fopen(suite, "r");
+
+	if(!f)
+	{
+		fprintf(stderr, "couldn't open %s\n", suite);
+		return false;
+	}
+
+	while(fgets(line, sizeof(line), f))
+	{
+		if(line[0] == '#' || sscanf(line, "%63s %959s", name, path) != 2) continue;
+
+		memset(&result, 0, sizeof(result));
+		strcpy(result.name, name);
+
+		if(!run_capture(path, loops, 0))
+		{
+			fprintf(stderr, "skipping %s\n", name);
+			ret = false;
+			continue;
+		}
+
+		// the renderer is only known once a context was created
+		if(!count && strcmp(format, "csv")) print_json_header(label, loops);
+
+		print_result(format, label, count++ == 0);
+	}
+
+	if(strcmp(format, "csv"))
+	{
+		if(!count) print_json_header(label, loops);
+		printf("\n]}\n");
+	}
+
+	fclose(f);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	char *output = 0;
+	char *filename = 0;
+	char *suite = 0;
+	char *format = "json";
+	char *label = "";
+	uint loops = 1;
+	uint i;
+
+	for(i = 1; i < (uint)argc; i++)
+	{
+		if(!strcmp(argv[i], "-n") && i + 1 < (uint)argc) loops = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-o") && i + 1 < (uint)argc) output = argv[++i];
+		else if(!strcmp(argv[i], "-s") && i + 1 < (uint)argc) suite = argv[++i];
+		else if(!strcmp(argv[i], "-f") && i + 1 < (uint)argc) format = argv[++i];
+		else if(!strcmp(argv[i], "-l") && i + 1 < (uint)argc) label = argv[++i];
+		else filename = argv[i];
+	}
+
+	if((!filename && !suite) || !loops)
+	{
+		fprintf(stderr, "usage: %s [-n loops] [-o last_frame.tga] capture_file\n", argv[0]);
+		fprintf(stderr, "       %s -s suite [-n loops] [-f json|csv] [-l label]\n", argv[0]);
+		return 1;
+	}
+
+	if(!init_display()) return 1;
+
+	if(suite) return run_suite(suite, loops, format, label) ? 0 : 1;
+
+	if(!run_capture(filename, loops, output)) return 1;
+
+	printf("Renderer: %s\n", renderer);
+	printf("%u frames in %.3f s, %.3f ms/frame (%.3f ms CPU), %.1f draw calls/frame\n", result.frames, result.wall_time,
+		per_frame(result.wall_time * 1000.0), per_frame(result.cpu_time * 1000.0), per_frame(result.draw_calls));
+
+	return 0;
+}
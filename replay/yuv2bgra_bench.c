@@ -0,0 +1,332 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * replay/yuv2bgra_bench.c - checks and times the YUV420P to BGRA converter
+ *
+ * Converts a synthetic frame with the plain C and SSE2 versions of
+ * ffmpeg_movies/yuv2bgra.c, single threaded and split into row slices across
+ * threads the way the movie plugin does it, in both limited and full range.
+ * The SSE2 output has to match the plain C output exactly and both have to
+ * stay within TOLERANCE of a floating point reference. Built with
+ * -DHAVE_SWSCALE it also times sws_scale with the flags the plugin used for
+ * its BGR24 fallback, and to BGRA for a like for like comparison.
+ *
+ * Build on Linux:
+ *
+ *   gcc -O2 -pthread -o yuv2bgra_bench replay/yuv2bgra_bench.c ffmpeg_movies/yuv2bgra.c
+ *
+ * or with the sws_scale comparison:
+ *
+ *   gcc -O2 -pthread -DHAVE_SWSCALE -o yuv2bgra_bench replay/yuv2bgra_bench.c ffmpeg_movies/yuv2bgra.c `pkg-config --cflags --libs libswscale libavutil`
+ *
+ * Usage: yuv2bgra_bench [width height [iterations [threads]]]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef HAVE_SWSCALE
+#include <libswscale/swscale.h>
+#include <libavutil/pixfmt.h>
+#endif
+
+#include "../ffmpeg_movies/yuv2bgra.h"
+
+// largest difference per channel from the floating point conversion, fixed
+// point coefficients are only accurate to about one part in 128
+#define TOLERANCE 3
+
+#define MAX_THREADS 16
+
+struct slice
+{
+	pthread_t thread;
+	struct yuv2bgra_job *job;
+	uint first;
+	uint last;
+};
+
+uint width = 1280;
+uint height = 720;
+uint iterations = 100;
+uint threads = 4;
+
+unsigned char *planes[3];
+unsigned char *reference;
+unsigned char *output[2];
+
+int failed = 0;
+int first = 1;
+
+double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+unsigned char clamp(double x)
+{
+	if(x < 0.0) return 0;
+	if(x > 255.0) return 255;
+	return (unsigned char)floor(x + 0.5);
+}
+
+// smooth gradients with some noise on top, and every value at least once
+void make_frame()
+{
+	uint x, y;
+
+	srand(1);
+
+	for(y = 0; y < height; y++)
+	{
+		for(x = 0; x < width; x++) planes[0][y * width + x] = (x + y + rand() % 16) & 0xFF;
+	}
+
+	for(y = 0; y < height / 2; y++)
+	{
+		for(x = 0; x < width / 2; x++)
+		{
+			planes[1][y * (width / 2) + x] = (x * 3 + rand() % 8) & 0xFF;
+			planes[2][y * (width / 2) + x] = (y * 5 + x + rand() % 8) & 0xFF;
+		}
+	}
+}
+
+void convert_reference(bool full_range)
+{
+	uint x, y;
+
+	for(y = 0; y < height; y++)
+	{
+		for(x = 0; x < width; x++)
+		{
+			double u = planes[1][(y / 2) * (width / 2) + x / 2] - 128.0;
+			double v = planes[2][(y / 2) * (width / 2) + x / 2] - 128.0;
+			unsigned char *dest = &reference[(y * width + x) * 4];
+			double luma;
+
+			if(full_range)
+			{
+				luma = planes[0][y * width + x];
+				dest[0] = clamp(luma + 1.772 * u);
+				dest[1] = clamp(luma - 0.344136 * u - 0.714136 * v);
+				dest[2] = clamp(luma + 1.402 * v);
+			}
+			else
+			{
+				luma = 1.164383 * (planes[0][y * width + x] - 16.0);
+				dest[0] = clamp(luma + 2.017232 * u);
+				dest[1] = clamp(luma - 0.391762 * u - 0.812968 * v);
+				dest[2] = clamp(luma + 1.596027 * v);
+			}
+
+			dest[3] = 255;
+		}
+	}
+}
+
+void *slice_main(void *parameter)
+{
+	struct slice *slice = parameter;
+
+	yuv2bgra_rows(slice->job, slice->first, slice->last);
+
+	return 0;
+}
+
+// split the frame into even row slices, the last one takes the remainder
+void convert(struct yuv2bgra_job *job, uint num_threads)
+{
+	struct slice slices[MAX_THREADS];
+	uint rows = (height / num_threads) & ~1;
+	uint i;
+
+	if(num_threads == 1)
+	{
+		yuv2bgra_rows(job, 0, height);
+		return;
+	}
+
+	for(i = 0; i < num_threads; i++)
+	{
+		slices[i].job = job;
+		slices[i].first = i * rows;
+		slices[i].last = i == num_threads - 1 ? height : (i + 1) * rows;
+		pthread_create(&slices[i].thread, 0, slice_main, &slices[i]);
+	}
+
+	for(i = 0; i < num_threads; i++) pthread_join(slices[i].thread, 0);
+}
+
+int max_difference(unsigned char *a, unsigned char *b)
+{
+	uint i;
+	int max = 0;
+
+	for(i = 0; i < width * height * 4; i++)
+	{
+		int diff = abs(a[i] - b[i]);
+
+		if(diff > max) max = diff;
+	}
+
+	return max;
+}
+
+void report(char *name, bool full_range, int diff, double time)
+{
+	printf("%s\t{\"converter\": \"%s\", \"range\": \"%s\", \"max_diff\": %i, \"ms\": %.3f, \"mpixels_per_s\": %.1f}", first ? "" : ",\n", name, full_range ? "full" : "limited", diff, time * 1000.0, width * height / time / 1000000.0);
+	first = 0;
+}
+
+double time_converter(struct yuv2bgra_job *job, uint num_threads)
+{
+	double start = now();
+	uint i;
+
+	for(i = 0; i < iterations; i++) convert(job, num_threads);
+
+	return (now() - start) / iterations;
+}
+
+void run(bool full_range)
+{
+	struct yuv2bgra_job job;
+	char name[64];
+	int diff;
+	uint i;
+
+	for(i = 0; i < 3; i++)
+	{
+		job.planes[i] = planes[i];
+		job.strides[i] = i ? width / 2 : width;
+	}
+
+	job.dest_stride = width * 4;
+	job.width = width;
+	job.height = height;
+	job.full_range = full_range;
+
+	convert_reference(full_range);
+
+	yuv2bgra_sse2 = false;
+	job.dest = output[0];
+	convert(&job, 1);
+	diff = max_difference(output[0], reference);
+	if(diff > TOLERANCE) failed = 1;
+	report("c", full_range, diff, time_converter(&job, 1));
+
+	yuv2bgra_sse2 = true;
+	job.dest = output[1];
+
+	// 1, 2, 4 and so on up to the requested thread count
+	for(i = 1; i; i = i == threads ? 0 : (i * 2 > threads ? threads : i * 2))
+	{
+		memset(output[1], 0, width * height * 4);
+		convert(&job, i);
+
+		// has to be bit exact with the plain C version
+		if(memcmp(output[0], output[1], width * height * 4))
+		{
+			fprintf(stderr, "SSE2 output with %u threads differs from the plain C version\n", i);
+			failed = 1;
+		}
+
+		sprintf(name, "sse2 x%u", i);
+		report(name, full_range, max_difference(output[1], reference), time_converter(&job, i));
+	}
+
+#ifdef HAVE_SWSCALE
+	{
+		int src_strides[3] = {width, width / 2, width / 2};
+		const uint8_t *src[3] = {planes[0], planes[1], planes[2]};
+		enum AVPixelFormat formats[2] = {AV_PIX_FMT_BGR24, AV_PIX_FMT_BGRA};
+		uint f;
+
+		for(f = 0; f < 2; f++)
+		{
+			struct SwsContext *ctx = sws_getContext(width, height, full_range ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P, width, height, formats[f], SWS_FAST_BILINEAR | SWS_ACCURATE_RND, 0, 0, 0);
+			int dest_stride = width * (f ? 4 : 3);
+			uint8_t *dest[1] = {output[1]};
+			double start;
+
+			start = now();
+			for(i = 0; i < iterations; i++) sws_scale(ctx, src, src_strides, 0, height, dest, &dest_stride);
+
+			report(f ? "sws_scale bgra" : "sws_scale bgr24", full_range, f ? max_difference(output[1], reference) : -1, (now() - start) / iterations);
+
+			sws_freeContext(ctx);
+		}
+	}
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+	uint i;
+
+	if(argc > 1 && (argc < 3 || argc > 5))
+	{
+		fprintf(stderr, "usage: %s [width height [iterations [threads]]]\n", argv[0]);
+		return 1;
+	}
+
+	if(argc > 2)
+	{
+		width = atoi(argv[1]);
+		height = atoi(argv[2]);
+	}
+
+	if(argc > 3) iterations = atoi(argv[3]);
+	if(argc > 4) threads = atoi(argv[4]);
+
+	if(width < 2 || height < 2 || (width & 1) || iterations < 1 || threads < 1 || threads > MAX_THREADS || height / threads < 2)
+	{
+		fprintf(stderr, "invalid frame size, iteration or thread count\n");
+		return 1;
+	}
+
+	for(i = 0; i < 3; i++) planes[i] = malloc(i ? (width / 2) * (height / 2) + 16 : width * height + 16);
+	reference = malloc(width * height * 4);
+	output[0] = malloc(width * height * 4);
+	output[1] = malloc(width * height * 4);
+
+	make_frame();
+
+	printf("[\n");
+
+	run(false);
+	run(true);
+
+	printf("\n]\n");
+
+	if(failed) fprintf(stderr, "conversion differs from the reference by more than %i\n", TOLERANCE);
+
+	return failed;
+}
@@ -0,0 +1,181 @@
+/* 
+ * ff7_opengl - Complete OpenGL replacement of the Direct3D renderer used in 
+ * the original ports of Final Fantasy VII and Final Fantasy VIII for the PC.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * replay/zsort_bench.c - benchmark for deferred triangle ordering
+ *
+ * Generates a battle effect like workload, lots of small alpha blended calls
+ * made of camera facing quads at scattered depths, and times the depth key
+ * and radix sort used by gl/deferred.c against the per-call layer grouping
+ * and per-layer selection scan it replaced. Only the ordering work is timed,
+ * no GL calls are made.
+ *
+ * Build on Linux the same way as the replayer:
+ *
+ *   gcc -O2 -fms-extensions -Iinc -I. -o zsort_bench replay/zsort_bench.c gl/zsort.c
+ *
+ * Usage: zsort_bench [triangles] [triangles_per_call] [iterations]
+ */
+
+#include <gl/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../types.h"
+#include "../gl.h"
+
+struct layer
+{
+	float z;
+	uint call;
+	uint tris;
+	bool drawn;
+};
+
+double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// the old approach, group each call's triangles by identical Z, then pick the
+// farthest undrawn layer with a linear scan until all are drawn
+uint legacy_order(float *tri_z, uint num_tris, uint tris_per_call, struct layer *layers, bool *tri_deferred)
+{
+	uint num_layers = 0;
+	uint call_start, tri;
+	uint drawn = 0;
+
+	for(call_start = 0; call_start < num_tris; call_start += tris_per_call)
+	{
+		uint count = num_tris - call_start < tris_per_call ? num_tris - call_start : tris_per_call;
+		float *z = &tri_z[call_start];
+		uint defer_index = 0;
+
+		memset(tri_deferred, 0, sizeof(*tri_deferred) * count);
+
+		while(defer_index < count)
+		{
+			struct layer *layer = &layers[num_layers++];
+
+			layer->z = z[defer_index];
+			layer->call = call_start / tris_per_call;
+			layer->tris = 0;
+			layer->drawn = false;
+
+			for(tri = 0; tri < count; tri++) if(z[tri] == layer->z) layer->tris++;
+
+			for(tri = 0; tri < count; tri++) if(z[tri] == layer->z) tri_deferred[tri] = true;
+
+			while(defer_index < count && tri_deferred[defer_index]) defer_index++;
+		}
+	}
+
+	while(true)
+	{
+		uint i;
+		float z = -1.0f;
+		uint next = -1;
+
+		for(i = 0; i < num_layers; i++)
+		{
+			if(layers[i].z > z && !layers[i].drawn)
+			{
+				next = i;
+				z = layers[i].z;
+			}
+		}
+
+		if(next == -1) break;
+
+		layers[next].drawn = true;
+		drawn++;
+	}
+
+	return drawn;
+}
+
+// the new approach, one key per triangle, one sort, count same-call runs
+uint sorted_order(float *tri_z, uint num_tris, uint tris_per_call, uint *keys, uint *order, uint *scratch)
+{
+	uint runs = 0;
+	uint i;
+
+	for(i = 0; i < num_tris; i++) keys[i] = gl_depth_sort_key(tri_z[i]);
+
+	gl_radix_sort(keys, order, scratch, num_tris);
+
+	for(i = 0; i < num_tris; i++) if(i == 0 || order[i] / tris_per_call != order[i - 1] / tris_per_call) runs++;
+
+	return runs;
+}
+
+int main(int argc, char **argv)
+{
+	uint num_tris = argc > 1 ? atoi(argv[1]) : 4096;
+	uint tris_per_call = argc > 2 ? atoi(argv[2]) : 8;
+	uint iterations = argc > 3 ? atoi(argv[3]) : 20;
+	float *tri_z;
+	uint *keys, *order, *scratch;
+	struct layer *layers;
+	bool *tri_deferred;
+	double start, legacy_time, sorted_time;
+	uint layers_drawn = 0, runs = 0;
+	uint i;
+
+	if(!num_tris || !tris_per_call || !iterations)
+	{
+		fprintf(stderr, "usage: %s [triangles] [triangles_per_call] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	tri_z = malloc(sizeof(*tri_z) * num_tris);
+	keys = malloc(sizeof(*keys) * num_tris);
+	order = malloc(sizeof(*order) * num_tris);
+	scratch = malloc(sizeof(*scratch) * num_tris);
+	layers = malloc(sizeof(*layers) * num_tris);
+	tri_deferred = malloc(sizeof(*tri_deferred) * tris_per_call);
+
+	// particles are quads, both triangles of a quad share the same depth
+	srand(1);
+	for(i = 0; i < num_tris; i += 2)
+	{
+		float z = 0.1f + 0.8f * (rand() / (float)RAND_MAX);
+
+		tri_z[i] = z;
+		if(i + 1 < num_tris) tri_z[i + 1] = z;
+	}
+
+	start = now();
+	for(i = 0; i < iterations; i++) layers_drawn = legacy_order(tri_z, num_tris, tris_per_call, layers, tri_deferred);
+	legacy_time = (now() - start) / iterations;
+
+	start = now();
+	for(i = 0; i < iterations; i++) runs = sorted_order(tri_z, num_tris, tris_per_call, keys, order, scratch);
+	sorted_time = (now() - start) / iterations;
+
+	printf("{\"triangles\": %u, \"triangles_per_call\": %u, \"legacy_us\": %.2f, \"legacy_draws\": %u, \"sorted_us\": %.2f, \"sorted_draws\": %u}\n",
+		num_tris, tris_per_call, legacy_time * 1000000.0, layers_drawn, sorted_time * 1000000.0, runs);
+
+	return 0;
+}
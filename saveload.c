@@ -193,7 +193,7 @@ struct ext_cache_data *ext_cache_put(char *name, uint palette_index)
 		return 0;
 	}
 
-	glDeleteTextures(1, &ext_cache[oldest_texture]->data.texture);
+	gl_delete_textures(1, &ext_cache[oldest_texture]->data.texture);
 
 	stats.ext_cache_size -= ext_cache[oldest_texture]->data.size;
 
@@ -214,7 +214,9 @@ uint load_texture_helper(char *png_name, char *ctx_name, uint *width, uint *heig
 
 	if(!(use_compression && compress_textures) || !(ret = read_ctx(ctx_name, width, height)))
 	{
+		PROFILE_BEGIN("read_png");
 		data = read_png(png_name, width, height);
+		PROFILE_END();
 
 		if(!data) return 0;
 
@@ -225,8 +227,10 @@ uint load_texture_helper(char *png_name, char *ctx_name, uint *width, uint *heig
 			ret = gl_compress_pixel_buffer(data, *width, *height, GL_BGRA);
 			if(!write_ctx(ctx_name, *width, *height, ret))
 			{
-				glDeleteTextures(1, &ret);
+				gl_delete_textures(1, &ret);
+				PROFILE_BEGIN("read_png");
 				data = read_png(png_name, width, height);
+				PROFILE_END();
 				ret = gl_commit_pixel_buffer(data, *width, *height, GL_BGRA, true);
 				stats.ext_cache_size += (*width) * (*height) * 4;
 			}
@@ -0,0 +1,13 @@
+// weighted blended transparency composite, see gl/oit.c
+// drawn with glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA)
+
+uniform sampler2D accum_tex;
+uniform sampler2D reveal_tex;
+
+void main()
+{
+	vec4 accum = texture2D(accum_tex, gl_TexCoord[0].st);
+	float reveal = texture2D(reveal_tex, gl_TexCoord[0].st).r;
+
+	gl_FragColor = vec4(accum.rgb / max(accum.a, 0.00001), reveal);
+}